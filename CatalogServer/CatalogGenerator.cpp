@@ -0,0 +1,238 @@
+#include "CatalogGenerator.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+static const char* const RATING_WORDS[] = { "One", "Two", "Three", "Four", "Five" };
+static const char* const ADJECTIVES[] = { "Silent", "Crimson", "Hidden", "Last", "Broken", "Golden", "Wild", "Secret" };
+static const char* const NOUNS[] = { "River", "Garden", "Empire", "Letter", "Winter", "Harbor", "Voyage", "Promise" };
+static const char* const CATEGORIES[] = { "Travel", "Mystery", "Poetry", "Science", "History", "Romance", "Fantasy", "Fiction" };
+
+CatalogGenerator::CatalogGenerator(const CatalogConfig& config) : config_(config) {
+    if (config_.books == 0 || config_.pageSize < 1) {
+        throw runtime_error("Catalogue needs at least one book and a page size of at least 1");
+    }
+    pageCount_ = (config_.books + config_.pageSize - 1) / config_.pageSize;
+}
+
+// splitmix64, a cheap hash with well spread bits
+uint64_t CatalogGenerator::mix(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+CatalogGenerator::Book CatalogGenerator::book(uint64_t id) const {
+    uint64_t h = mix(id);
+
+    Book b;
+    b.id = id;
+    b.title = string("The ") + ADJECTIVES[h % 8] + " " + NOUNS[(h >> 8) % 8] + " " + to_string(id + 1);
+    b.pricePence = 1000 + static_cast<int64_t>((h >> 16) % 5000);
+    b.rating = 1 + static_cast<int>((h >> 32) % 5);
+    b.stock = static_cast<int>((h >> 40) % 30);
+    b.category = CATEGORIES[(h >> 48) % 8];
+
+    ostringstream upc;
+    upc << hex;
+    upc.width(16);
+    upc.fill('0');
+    upc << mix(h);
+    b.upc = upc.str();
+
+    return b;
+}
+
+string CatalogGenerator::formatPrice(int64_t pence) {
+    string cents = to_string(pence % 100);
+    return to_string(pence / 100) + "." + (cents.size() < 2 ? "0" : "") + cents;
+}
+
+// Digits only, no sign or leading junk
+bool CatalogGenerator::parseNumber(const string& text, uint64_t& value) {
+    if (text.empty() || text.size() > 18 || !all_of(text.begin(), text.end(), [](char ch) { return ch >= '0' && ch <= '9'; })) {
+        return false;
+    }
+    value = stoull(text);
+    return true;
+}
+
+bool CatalogGenerator::render(const string& path, const string& origin, string& body, string& contentType) const {
+    contentType = "text/html; charset=utf-8";
+    uint64_t number;
+
+    if (path == "/" || path == "/index.html") {
+        body = listingPage(1, true);
+        return true;
+    }
+
+    const string listingPrefix = "/catalogue/page-";
+    if (path.compare(0, listingPrefix.size(), listingPrefix) == 0 && path.size() > listingPrefix.size() + 5 &&
+        path.compare(path.size() - 5, 5, ".html") == 0) {
+        if (!parseNumber(path.substr(listingPrefix.size(), path.size() - listingPrefix.size() - 5), number) ||
+            number < 1 || number > pageCount_) {
+            return false;
+        }
+        body = listingPage(number, false);
+        return true;
+    }
+
+    const string productPrefix = "/catalogue/book_";
+    const string productSuffix = "/index.html";
+    if (path.compare(0, productPrefix.size(), productPrefix) == 0 && path.size() > productPrefix.size() + productSuffix.size() &&
+        path.compare(path.size() - productSuffix.size(), productSuffix.size(), productSuffix) == 0) {
+        if (!parseNumber(path.substr(productPrefix.size(), path.size() - productPrefix.size() - productSuffix.size()), number) ||
+            number >= config_.books) {
+            return false;
+        }
+        body = productPage(number);
+        return true;
+    }
+
+    const string coverPrefix = "/media/cache/";
+    if (path.compare(0, coverPrefix.size(), coverPrefix) == 0 && path.size() > coverPrefix.size() + 4 &&
+        path.compare(path.size() - 4, 4, ".jpg") == 0) {
+        if (!parseNumber(path.substr(coverPrefix.size(), path.size() - coverPrefix.size() - 4), number) ||
+            number >= config_.books) {
+            return false;
+        }
+        body = cover(number);
+        contentType = "image/jpeg";
+        return true;
+    }
+
+    if (!config_.sitemap) {
+        return false;
+    }
+
+    contentType = "application/xml";
+    if (path == "/sitemap.xml") {
+        body = sitemapIndex(origin);
+        return true;
+    }
+
+    const string sitemapPrefix = "/sitemap-";
+    if (path.compare(0, sitemapPrefix.size(), sitemapPrefix) == 0 && path.size() > sitemapPrefix.size() + 4 &&
+        path.compare(path.size() - 4, 4, ".xml") == 0) {
+        if (!parseNumber(path.substr(sitemapPrefix.size(), path.size() - sitemapPrefix.size() - 4), number) ||
+            number < 1 || (number - 1) * SITEMAP_URLS >= pageCount_) {
+            return false;
+        }
+        body = sitemapPart(number, origin);
+        return true;
+    }
+
+    return false;
+}
+
+// Same markup as books.toscrape.com; index.html is page 1 with links one
+// directory up, like on the real site
+string CatalogGenerator::listingPage(uint64_t page, bool index) const {
+    string prefix = index ? "catalogue/" : "";
+    string media = index ? "" : "../";
+
+    ostringstream html;
+    html << "<!DOCTYPE html>\n<html lang=\"en-us\">\n<head><meta charset=\"utf-8\"><title>All products | Books to Scrape - Sandbox</title></head>\n"
+        << "<body>\n<div class=\"page_inner\"><section>\n<ol class=\"row\">\n";
+
+    uint64_t first = (page - 1) * config_.pageSize;
+    uint64_t last = min<uint64_t>(first + config_.pageSize, config_.books);
+    for (uint64_t id = first; id < last; ++id) {
+        Book b = book(id);
+        string link = prefix + "book_" + to_string(id) + "/index.html";
+
+        html << "<li class=\"col-xs-6 col-sm-4 col-md-3 col-lg-3\">\n<article class=\"product_pod\">\n"
+            << "  <div class=\"image_container\"><a href=\"" << link << "\"><img src=\"" << media << "media/cache/"
+            << id << ".jpg\" alt=\"" << b.title << "\" class=\"thumbnail\"></a></div>\n"
+            << "  <p class=\"star-rating " << RATING_WORDS[b.rating - 1] << "\"><i class=\"icon-star\"></i></p>\n"
+            << "  <h3><a href=\"" << link << "\" title=\"" << b.title << "\">" << b.title.substr(0, 20) << "...</a></h3>\n"
+            << "  <div class=\"product_price\">\n    <p class=\"price_color\">\xC2\xA3" << formatPrice(b.pricePence) << "</p>\n"
+            << "    <p class=\"" << (b.stock > 0 ? "instock" : "outofstock") << " availability\">\n        <i class=\"icon-ok\"></i>\n        "
+            << (b.stock > 0 ? "In stock" : "Out of stock") << "\n    </p>\n  </div>\n</article>\n</li>\n";
+    }
+
+    html << "</ol>\n<div><ul class=\"pager\">\n";
+    if (page > 1) {
+        html << "  <li class=\"previous\"><a href=\"" << prefix << "page-" << page - 1 << ".html\">previous</a></li>\n";
+    }
+    html << "  <li class=\"current\">\n    Page " << page << " of " << pageCount_ << "\n  </li>\n";
+    if (page < pageCount_) {
+        html << "  <li class=\"next\"><a href=\"" << prefix << "page-" << page + 1 << ".html\">next</a></li>\n";
+    }
+    html << "</ul></div>\n</section></div>\n</body>\n</html>\n";
+
+    return html.str();
+}
+
+string CatalogGenerator::productPage(uint64_t id) const {
+    Book b = book(id);
+
+    ostringstream html;
+    html << "<!DOCTYPE html>\n<html lang=\"en-us\">\n<head><meta charset=\"utf-8\"><title>" << b.title << " | Books to Scrape - Sandbox</title></head>\n<body>\n"
+        << "<ul class=\"breadcrumb\">\n  <li><a href=\"../../index.html\">Home</a></li>\n"
+        << "  <li><a href=\"../category/books_1/index.html\">Books</a></li>\n"
+        << "  <li><a href=\"../category/books/" << b.category << "/index.html\">" << b.category << "</a></li>\n"
+        << "  <li class=\"active\">" << b.title << "</li>\n</ul>\n"
+        << "<article class=\"product_page\">\n"
+        << "  <div class=\"col-sm-6 product_main\"><h1>" << b.title << "</h1>\n"
+        << "    <p class=\"price_color\">\xC2\xA3" << formatPrice(b.pricePence) << "</p>\n"
+        << "    <p class=\"star-rating " << RATING_WORDS[b.rating - 1] << "\"></p></div>\n"
+        << "  <div id=\"product_description\" class=\"sub-header\"><h2>Product Description</h2></div>\n"
+        << "  <p>" << b.title << " is a " << b.category << " title, book number " << id + 1
+        << " of " << config_.books << " in this generated catalogue.</p>\n"
+        << "  <table class=\"table table-striped\">\n"
+        << "    <tr><th>UPC</th><td>" << b.upc << "</td></tr>\n"
+        << "    <tr><th>Product Type</th><td>Books</td></tr>\n"
+        << "    <tr><th>Price (excl. tax)</th><td>\xC2\xA3" << formatPrice(b.pricePence) << "</td></tr>\n"
+        << "    <tr><th>Availability</th><td>" << (b.stock > 0 ? "In stock (" + to_string(b.stock) + " available)" : "Out of stock") << "</td></tr>\n"
+        << "    <tr><th>Number of reviews</th><td>0</td></tr>\n"
+        << "  </table>\n</article>\n</body>\n</html>\n";
+
+    return html.str();
+}
+
+string CatalogGenerator::sitemapIndex(const string& origin) const {
+    ostringstream xml;
+    xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<sitemapindex xmlns=\"http://www.sitemaps.org/schemas/sitemap/0.9\">\n";
+
+    uint64_t parts = (pageCount_ + SITEMAP_URLS - 1) / SITEMAP_URLS;
+    for (uint64_t part = 1; part <= parts; ++part) {
+        xml << "  <sitemap><loc>" << origin << "/sitemap-" << part << ".xml</loc></sitemap>\n";
+    }
+    xml << "</sitemapindex>\n";
+
+    return xml.str();
+}
+
+// Listing pages only, product pages are reached from them
+string CatalogGenerator::sitemapPart(uint64_t part, const string& origin) const {
+    ostringstream xml;
+    xml << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        << "<urlset xmlns=\"http://www.sitemaps.org/schemas/sitemap/0.9\">\n";
+
+    uint64_t first = (part - 1) * SITEMAP_URLS + 1;
+    uint64_t last = min(part * SITEMAP_URLS, pageCount_);
+    for (uint64_t page = first; page <= last; ++page) {
+        xml << "  <url><loc>" << origin << "/catalogue/page-" << page << ".html</loc></url>\n";
+    }
+    xml << "</urlset>\n";
+
+    return xml.str();
+}
+
+// A few KB of bytes that differ per book, enough for the image store to hash
+string CatalogGenerator::cover(uint64_t id) {
+    string bytes(2048 + mix(id) % 2048, '\0');
+    uint64_t state = id;
+    for (size_t i = 0; i < bytes.size(); i += 8) {
+        state = mix(state);
+        for (size_t k = 0; k < 8 && i + k < bytes.size(); ++k) {
+            bytes[i + k] = static_cast<char>(state >> (k * 8));
+        }
+    }
+    return bytes;
+}
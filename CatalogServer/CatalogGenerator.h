@@ -0,0 +1,56 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+struct CatalogConfig {
+    uint64_t books = 1000000;
+    int pageSize = 20;
+    bool sitemap = true;        // serve /sitemap.xml (an index of listing-page sitemaps)
+};
+
+// Generates a books.toscrape.com compatible catalogue on the fly. Nothing is
+// stored: every page is rendered from the book ids it shows, and every book
+// from a hash of its id, so the same URL always returns the same bytes.
+//   /index.html, /catalogue/page-N.html   listing pages
+//   /catalogue/book_ID/index.html         product pages
+//   /media/cache/ID.jpg                   covers
+//   /sitemap.xml, /sitemap-N.xml          sitemap index and its parts
+class CatalogGenerator {
+public:
+    explicit CatalogGenerator(const CatalogConfig& config);
+
+    // False if there is no such page. origin ("http://host:port") makes the
+    // sitemap locations absolute, as the protocol requires
+    bool render(const string& path, const string& origin, string& body, string& contentType) const;
+
+    uint64_t pageCount() const { return pageCount_; }
+
+private:
+    static const uint64_t SITEMAP_URLS = 50000;     // per sitemap file, the protocol's limit
+
+    CatalogConfig config_;
+    uint64_t pageCount_;
+
+    struct Book {
+        uint64_t id;
+        string title;
+        int64_t pricePence;
+        int rating;
+        int stock;
+        string upc;
+        string category;
+    };
+    Book book(uint64_t id) const;
+
+    string listingPage(uint64_t page, bool index) const;
+    string productPage(uint64_t id) const;
+    string sitemapIndex(const string& origin) const;
+    string sitemapPart(uint64_t part, const string& origin) const;
+    static string cover(uint64_t id);
+
+    static bool parseNumber(const string& text, uint64_t& value);
+    static string formatPrice(int64_t pence);
+    static uint64_t mix(uint64_t x);
+};
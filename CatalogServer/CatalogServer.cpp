@@ -0,0 +1,321 @@
+#include "CatalogServer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#define CLOSE_SOCKET closesocket
+static const SocketHandle INVALID_HANDLE = INVALID_SOCKET;
+#else
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define CLOSE_SOCKET ::close
+static const SocketHandle INVALID_HANDLE = -1;
+#endif
+
+// Don't get killed by SIGPIPE when the client went away
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+using namespace std;
+
+// Winsock has to be started once per process before any socket call
+static void ensureSocketsInitialized() {
+#ifdef _WIN32
+    static bool initialized = [] {
+        WSADATA data;
+        if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+            throw runtime_error("WSAStartup failed");
+        }
+        return true;
+    }();
+    (void)initialized;
+#endif
+}
+
+CatalogServer::CatalogServer(const CatalogGenerator& catalog, const FaultConfig& faults)
+    : catalog_(catalog), faults_(faults), listener_(INVALID_HANDLE) {
+}
+
+CatalogServer::~CatalogServer() {
+    if (listener_ != INVALID_HANDLE) {
+        CLOSE_SOCKET(listener_);
+    }
+}
+
+void CatalogServer::run(int port) {
+    ensureSocketsInitialized();
+
+    listener_ = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener_ == INVALID_HANDLE) {
+        throw runtime_error("Cannot create socket");
+    }
+
+    int reuse = 1;
+    setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(static_cast<unsigned short>(port));
+
+    if (::bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener_, 256) != 0) {
+        throw runtime_error("Cannot listen on port " + to_string(port));
+    }
+
+    cout << "Serving " << catalog_.pageCount() << " listing pages on http://127.0.0.1:" << port << "/index.html" << endl;
+
+    thread(&CatalogServer::reportLoop, this).detach();
+
+    for (uint64_t connectionId = 0;; ++connectionId) {
+        SocketHandle client = ::accept(listener_, nullptr, nullptr);
+        if (client == INVALID_HANDLE) {
+            continue;
+        }
+        ++connections_;
+        thread(&CatalogServer::serveConnection, this, client, connectionId).detach();
+    }
+}
+
+// One line per second while there is traffic
+void CatalogServer::reportLoop() {
+    uint64_t lastRequests = 0;
+    for (;;) {
+        this_thread::sleep_for(chrono::seconds(1));
+
+        uint64_t requests = requests_.load();
+        if (requests == lastRequests) {
+            continue;
+        }
+        cout << (requests - lastRequests) << " req/s, " << requests << " total, "
+            << bytesSent_.load() / 1024 << " KB sent, " << connections_.load() << " connections | "
+            << "304: " << notModified_.load() << ", 404: " << notFound_.load()
+            << ", 503: " << errors_.load() << ", stalled: " << timeouts_.load()
+            << ", truncated: " << truncated_.load() << endl;
+        lastRequests = requests;
+    }
+}
+
+void CatalogServer::serveConnection(SocketHandle client, uint64_t connectionId) {
+    // Every connection gets its own stream, seeded from the server seed
+    mt19937_64 random(faults_.seed * 1000003 + connectionId);
+    uniform_real_distribution<double> chance(0.0, 1.0);
+
+    // Lognormal latency: median = e^mu, p99 = e^(mu + 2.326 sigma)
+    bool delay = faults_.latencyMedianMs > 0;
+    double sigma = 0.0;
+    if (delay && faults_.latencyP99Ms > faults_.latencyMedianMs) {
+        sigma = log(static_cast<double>(faults_.latencyP99Ms) / faults_.latencyMedianMs) / 2.326;
+    }
+    lognormal_distribution<double> latency(delay ? log(static_cast<double>(faults_.latencyMedianMs)) : 0.0, sigma);
+
+    string buffer;
+    char chunk[4096];
+    bool open = true;
+
+    while (open) {
+        size_t headerEnd;
+        while ((headerEnd = buffer.find("\r\n\r\n")) == string::npos) {
+            int received = static_cast<int>(recv(client, chunk, sizeof(chunk), 0));
+            if (received <= 0 || buffer.size() > MAX_HEADER_BYTES) {
+                CLOSE_SOCKET(client);
+                return;
+            }
+            buffer.append(chunk, received);
+        }
+
+        string request = buffer.substr(0, headerEnd + 2);
+        buffer.erase(0, headerEnd + 4);
+        ++requests_;
+
+        // Request line: METHOD TARGET VERSION, bodies are never expected
+        size_t methodEnd = request.find(' ');
+        size_t targetEnd = methodEnd == string::npos ? string::npos : request.find(' ', methodEnd + 1);
+        if (targetEnd == string::npos) {
+            CLOSE_SOCKET(client);
+            return;
+        }
+        string method = request.substr(0, methodEnd);
+        string target = request.substr(methodEnd + 1, targetEnd - methodEnd - 1);
+        string path = pathOf(target);
+        string origin = originOf(target, headerValue(request, "host"));
+
+        string connection = headerValue(request, "connection");
+        transform(connection.begin(), connection.end(), connection.begin(), ::tolower);
+        open = connection != "close" && request.compare(targetEnd + 1, 8, "HTTP/1.0") != 0;
+
+        if (delay) {
+            this_thread::sleep_for(chrono::milliseconds(static_cast<long long>(latency(random))));
+        }
+
+        if (chance(random) < faults_.timeoutRate) {
+            ++timeouts_;
+            this_thread::sleep_for(chrono::milliseconds(static_cast<int>(STALL_MS)));
+            CLOSE_SOCKET(client);
+            return;
+        }
+
+        string status = "200 OK";
+        string body;
+        string contentType = "text/html; charset=utf-8";
+        string extraHeaders;
+        bool truncate = false;
+
+        if (chance(random) < faults_.errorRate) {
+            ++errors_;
+            status = "503 Service Unavailable";
+            body = "<html><body><h1>503 Service Unavailable</h1></body></html>\n";
+            extraHeaders = "Retry-After: 1\r\n";
+        }
+        else if (method != "GET" && method != "HEAD") {
+            status = "405 Method Not Allowed";
+            extraHeaders = "Allow: GET, HEAD\r\n";
+        }
+        else if (!catalog_.render(path, origin, body, contentType)) {
+            ++notFound_;
+            status = "404 Not Found";
+            body = "<html><body><h1>404 Not Found</h1></body></html>\n";
+            contentType = "text/html; charset=utf-8";
+        }
+        else {
+            string etag = etagOf(body);
+            extraHeaders = "ETag: " + etag + "\r\nCache-Control: max-age=0\r\n";
+
+            if (headerValue(request, "if-none-match") == etag) {
+                ++notModified_;
+                status = "304 Not Modified";
+                body.clear();
+            }
+            else if (chance(random) < faults_.truncateRate) {
+                ++truncated_;
+                truncate = true;
+            }
+        }
+
+        bool hasBody = status.compare(0, 3, "304") != 0;
+        string response = "HTTP/1.1 " + status + "\r\n" +
+            "Content-Type: " + contentType + "\r\n" +
+            (hasBody ? "Content-Length: " + to_string(body.size()) + "\r\n" : string()) +
+            extraHeaders +
+            "Connection: " + (open && !truncate ? "keep-alive" : "close") + "\r\n\r\n";
+
+        if (method != "HEAD") {
+            response += truncate ? body.substr(0, body.size() / 2) : body;
+        }
+
+        if (!sendAll(client, response) || truncate) {
+            CLOSE_SOCKET(client);
+            return;
+        }
+    }
+
+    CLOSE_SOCKET(client);
+}
+
+// Sends in slices of a tenth of the per second allowance when throttled
+bool CatalogServer::sendAll(SocketHandle client, const string& data) {
+    size_t slice = data.size();
+    if (faults_.bandwidthKBps > 0) {
+        slice = max<size_t>(1, static_cast<size_t>(faults_.bandwidthKBps) * 1024 / 10);
+    }
+
+    for (size_t offset = 0; offset < data.size();) {
+        size_t length = min(slice, data.size() - offset);
+        size_t sentSlice = 0;
+        while (sentSlice < length) {
+            int sent = static_cast<int>(send(client, data.data() + offset + sentSlice, static_cast<int>(length - sentSlice), SEND_FLAGS));
+            if (sent <= 0) {
+                return false;
+            }
+            sentSlice += sent;
+        }
+        offset += length;
+        bytesSent_ += length;
+
+        if (slice < data.size() && offset < data.size()) {
+            this_thread::sleep_for(chrono::milliseconds(100));
+        }
+    }
+    return true;
+}
+
+// FNV-1a of the body; pages are generated deterministically, so it stays stable across restarts
+string CatalogServer::etagOf(const string& body) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char ch : body) {
+        hash = (hash ^ ch) * 1099511628211ULL;
+    }
+
+    static const char* const HEX = "0123456789abcdef";
+    string etag = "\"";
+    for (int shift = 60; shift >= 0; shift -= 4) {
+        etag += HEX[(hash >> shift) & 0xF];
+    }
+    return etag + "\"";
+}
+
+// Origin-form "/path?query" or absolute-form "http://host/path" (proxy requests)
+string CatalogServer::pathOf(const string& target) {
+    string path = target;
+
+    size_t scheme = path.find("://");
+    if (scheme != string::npos) {
+        size_t slash = path.find('/', scheme + 3);
+        path = slash == string::npos ? "/" : path.substr(slash);
+    }
+
+    size_t query = path.find_first_of("?#");
+    if (query != string::npos) {
+        path.erase(query);
+    }
+    return path;
+}
+
+// Scheme and host the client asked for, taken from an absolute URI or the Host header
+string CatalogServer::originOf(const string& target, const string& host) {
+    size_t scheme = target.find("://");
+    if (scheme != string::npos) {
+        return target.substr(0, target.find('/', scheme + 3));
+    }
+    return "http://" + (host.empty() ? string("127.0.0.1") : host);
+}
+
+// Case-insensitive lookup of a header, trimmed
+string CatalogServer::headerValue(const string& request, const string& name) {
+    size_t lineStart = request.find("\r\n");
+    while (lineStart != string::npos && lineStart + 2 < request.size()) {
+        lineStart += 2;
+        size_t lineEnd = request.find("\r\n", lineStart);
+        if (lineEnd == string::npos) {
+            lineEnd = request.size();
+        }
+
+        size_t colon = request.find(':', lineStart);
+        if (colon != string::npos && colon < lineEnd && colon - lineStart == name.size() &&
+            equal(name.begin(), name.end(), request.begin() + lineStart,
+                [](char a, char b) { return ::tolower(static_cast<unsigned char>(a)) == ::tolower(static_cast<unsigned char>(b)); })) {
+            size_t valueStart = request.find_first_not_of(" \t", colon + 1);
+            size_t valueEnd = request.find_last_not_of(" \t", lineEnd - 1);
+            if (valueStart == string::npos || valueStart > valueEnd || valueStart >= lineEnd) {
+                return "";
+            }
+            return request.substr(valueStart, valueEnd - valueStart + 1);
+        }
+        lineStart = lineEnd;
+    }
+    return "";
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "CatalogGenerator.h"
+
+using namespace std;
+
+#ifdef _WIN32
+typedef uintptr_t SocketHandle;
+#else
+typedef int SocketHandle;
+#endif
+
+// Faults injected into responses, rates are per request in [0, 1]
+struct FaultConfig {
+    int latencyMedianMs = 0;        // lognormal delay before answering, 0 = none
+    int latencyP99Ms = 0;
+    double errorRate = 0.0;         // answer 503
+    double timeoutRate = 0.0;       // stall, then drop the connection without answering
+    double truncateRate = 0.0;      // full Content-Length, half the body, then drop
+    int bandwidthKBps = 0;          // per connection send limit, 0 = unlimited
+    uint64_t seed = 1;
+};
+
+// HTTP/1.1 server for a generated catalogue, one thread per connection with
+// keep-alive. Also accepts absolute URIs, so it can stand in as http_proxy
+// for books.toscrape.com.
+class CatalogServer {
+public:
+    CatalogServer(const CatalogGenerator& catalog, const FaultConfig& faults);
+    ~CatalogServer();
+
+    CatalogServer(const CatalogServer&) = delete;
+    CatalogServer& operator=(const CatalogServer&) = delete;
+
+    // Blocks, printing a stats line every second
+    void run(int port);
+
+private:
+    static const int STALL_MS = 30000;              // how long a "timed out" request hangs
+    static const size_t MAX_HEADER_BYTES = 16384;
+
+    const CatalogGenerator& catalog_;
+    FaultConfig faults_;
+    SocketHandle listener_;
+
+    atomic<uint64_t> requests_{ 0 };
+    atomic<uint64_t> bytesSent_{ 0 };
+    atomic<uint64_t> notFound_{ 0 };
+    atomic<uint64_t> notModified_{ 0 };
+    atomic<uint64_t> errors_{ 0 };
+    atomic<uint64_t> timeouts_{ 0 };
+    atomic<uint64_t> truncated_{ 0 };
+    atomic<uint64_t> connections_{ 0 };
+
+    void serveConnection(SocketHandle client, uint64_t connectionId);
+    void reportLoop();
+
+    bool sendAll(SocketHandle client, const string& data);
+    static string etagOf(const string& body);
+    static string pathOf(const string& target);
+    static string originOf(const string& target, const string& host);
+    static string headerValue(const string& request, const string& name);
+};
@@ -0,0 +1,65 @@
+#!/bin/sh
+# Crawls a generated catalogue with ShelfScan and prints the crawl's stats.
+#
+#   ./loadtest.sh [PAGES] [SERVER OPTIONS...]
+#
+#   ./loadtest.sh 5000 --books 1m
+#   ./loadtest.sh 2000 --latency 40:400 --error-rate 0.02 --truncate-rate 0.01
+#
+# Environment:
+#   SHELFSCAN        ShelfScan binary (default ../build/ShelfScan, see CMakeLists.txt)
+#   CATALOG_SERVER   CatalogServer binary (default ../build/CatalogServer)
+#   PORT             server port (default 8080)
+#   SHELFSCAN_ARGS   extra ShelfScan options, e.g. "--details --images covers"
+#   WORKDIR          where results and the server log go (default loadtest-run)
+
+set -e
+
+PAGES=${1:-1000}
+[ $# -gt 0 ] && shift
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+SHELFSCAN=${SHELFSCAN:-$HERE/../build/ShelfScan}
+CATALOG_SERVER=${CATALOG_SERVER:-$HERE/../build/CatalogServer}
+PORT=${PORT:-8080}
+WORKDIR=${WORKDIR:-loadtest-run}
+SITE=http://127.0.0.1:$PORT
+
+for BINARY in "$SHELFSCAN" "$CATALOG_SERVER"; do
+    if [ ! -x "$BINARY" ]; then
+        echo "$BINARY not found, build it first: cmake -S . -B build && cmake --build build -j"
+        exit 1
+    fi
+done
+
+mkdir -p "$WORKDIR"
+cd "$WORKDIR"
+
+# Same rules as the built-in schema, but relative cover links resolve against the local server
+sed "s|^base .*|base  $SITE/|" "$HERE/../ShelfScan/schemas/books.toscrape.com.schema" > catalog.schema
+
+# Fresh run every time, no cache from an earlier load test
+rm -f loadtest.txt loadtest.json loadtest.cache
+
+"$CATALOG_SERVER" --port "$PORT" "$@" > server.log 2>&1 &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null' EXIT INT TERM
+
+# Wait for the listener
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    grep -q "^Serving" server.log 2>/dev/null && break
+    sleep 0.5
+done
+if ! kill -0 $SERVER 2>/dev/null; then
+    cat server.log
+    exit 1
+fi
+
+echo "Crawling $PAGES listing pages of $SITE (server: $*)"
+# shellcheck disable=SC2086
+"$SHELFSCAN" --url "$SITE/index.html" --max-pages "$PAGES" --schema catalog.schema \
+    --output loadtest $SHELFSCAN_ARGS > shelfscan.log 2>&1 || echo "ShelfScan exited with an error, see $WORKDIR/shelfscan.log"
+
+sed -n '/=== PERFORMANCE STATS ===/,/^====/p' shelfscan.log
+echo "Server:"
+tail -n 1 server.log
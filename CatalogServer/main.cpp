@@ -0,0 +1,94 @@
+#include "CatalogGenerator.h"
+#include "CatalogServer.h"
+#include <iostream>
+
+using namespace std;
+
+const int DEFAULT_PORT = 8080;
+
+// Usage:
+//   CatalogServer                          1 million books on port 8080
+//   CatalogServer --port N
+//   CatalogServer --books N                catalogue size, "10m" and "500k" work too
+//   CatalogServer --page-size N            books per listing page (default 20)
+//   CatalogServer --no-sitemap             answer 404 for /sitemap.xml
+//   CatalogServer --latency MS[:P99_MS]    lognormal response delay, median and 99th percentile
+//   CatalogServer --error-rate R           share of requests answered with 503
+//   CatalogServer --timeout-rate R         share of requests that hang and get dropped
+//   CatalogServer --truncate-rate R        share of responses cut off half way
+//   CatalogServer --bandwidth KBPS         per connection send limit
+//   CatalogServer --seed N                 seed of the fault injection
+static uint64_t parseCount(const string& text) {
+    uint64_t multiplier = 1;
+    string digits = text;
+    if (!digits.empty() && (digits.back() == 'k' || digits.back() == 'K')) {
+        multiplier = 1000;
+        digits.pop_back();
+    }
+    else if (!digits.empty() && (digits.back() == 'm' || digits.back() == 'M')) {
+        multiplier = 1000000;
+        digits.pop_back();
+    }
+    return stoull(digits) * multiplier;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        int port = DEFAULT_PORT;
+        CatalogConfig config;
+        FaultConfig faults;
+
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+
+            if (arg == "--port" && hasValue) {
+                port = stoi(argv[++i]);
+            }
+            else if (arg == "--books" && hasValue) {
+                config.books = parseCount(argv[++i]);
+            }
+            else if (arg == "--page-size" && hasValue) {
+                config.pageSize = stoi(argv[++i]);
+            }
+            else if (arg == "--no-sitemap") {
+                config.sitemap = false;
+            }
+            else if (arg == "--latency" && hasValue) {
+                string value = argv[++i];
+                size_t colon = value.find(':');
+                faults.latencyMedianMs = stoi(value.substr(0, colon));
+                faults.latencyP99Ms = colon == string::npos ? faults.latencyMedianMs : stoi(value.substr(colon + 1));
+            }
+            else if (arg == "--error-rate" && hasValue) {
+                faults.errorRate = stod(argv[++i]);
+            }
+            else if (arg == "--timeout-rate" && hasValue) {
+                faults.timeoutRate = stod(argv[++i]);
+            }
+            else if (arg == "--truncate-rate" && hasValue) {
+                faults.truncateRate = stod(argv[++i]);
+            }
+            else if (arg == "--bandwidth" && hasValue) {
+                faults.bandwidthKBps = stoi(argv[++i]);
+            }
+            else if (arg == "--seed" && hasValue) {
+                faults.seed = stoull(argv[++i]);
+            }
+            else {
+                cerr << "Unknown argument: " << arg << endl;
+                return 1;
+            }
+        }
+
+        CatalogGenerator catalog(config);
+        CatalogServer server(catalog, faults);
+        server.run(port);
+    }
+    catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,11 +1,19 @@
 #pragma once
+#include <cstdint>
 #include <string>
 
 struct BookData {
     std::string title;
-    float price;
-    int starRating;
+    int64_t priceMinor = 0;     // price in minor units (pence)
+    int starRating = 0;
     std::string availability;
     std::string imageUrl;
-};
+    std::string imageHash;      // SHA-256 of the stored cover, empty if not fetched
 
+    // From the product page, filled only when details are fetched
+    std::string detailUrl;
+    std::string upc;            // stable id of the book, empty if unknown
+    int stockCount = -1;        // -1 = unknown
+    std::string category;
+    std::string description;
+};
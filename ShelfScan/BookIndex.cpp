@@ -0,0 +1,387 @@
+#include "BookIndex.h"
+#include <algorithm>
+#include <bitset>
+#include <numeric>
+#include <set>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/parallel_sort.h>
+#include <tbb/blocked_range.h>
+#include <tbb/enumerable_thread_specific.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+using namespace std;
+using namespace tbb;
+
+static size_t lowestBit(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return index;
+#else
+    return static_cast<size_t>(__builtin_ctzll(bits));
+#endif
+}
+
+Bitmap::Bitmap(size_t size, bool value)
+    : size_(size), words_((size + 63) / 64, value ? ~0ULL : 0ULL) {
+    // Keep bits past the end cleared so count() stays exact
+    if (value && size % 64 != 0) {
+        words_.back() = (1ULL << (size % 64)) - 1;
+    }
+}
+
+void Bitmap::set(size_t index) {
+    words_[index / 64] |= 1ULL << (index % 64);
+}
+
+bool Bitmap::test(size_t index) const {
+    return (words_[index / 64] >> (index % 64)) & 1ULL;
+}
+
+size_t Bitmap::count() const {
+    return parallel_reduce(blocked_range<size_t>(0, words_.size()), size_t(0),
+        [&](const blocked_range<size_t>& r, size_t total) {
+            for (size_t i = r.begin(); i != r.end(); ++i) {
+                total += bitset<64>(words_[i]).count();
+            }
+            return total;
+        },
+        plus<size_t>()
+    );
+}
+
+void Bitmap::intersect(const Bitmap& other) {
+    parallel_for(blocked_range<size_t>(0, words_.size()),
+        [&](const blocked_range<size_t>& r) {
+            for (size_t i = r.begin(); i != r.end(); ++i) {
+                words_[i] &= other.words_[i];
+            }
+        }
+    );
+}
+
+vector<uint32_t> Bitmap::toIds() const {
+    vector<uint32_t> ids;
+    for (size_t w = 0; w < words_.size(); ++w) {
+        uint64_t bits = words_[w];
+        while (bits) {
+            ids.push_back(static_cast<uint32_t>(w * 64 + lowestBit(bits)));
+            bits &= bits - 1;
+        }
+    }
+    return ids;
+}
+
+BookIndex::BookIndex(vector<BookData> books) : books_(move(books)) {
+    buildPriceIndex();
+    buildBitmaps();
+    buildTrigramIndex();
+}
+
+string BookIndex::toLower(const string& text) {
+    string lower = text;
+    for (char& ch : lower) {
+        ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
+    }
+    return lower;
+}
+
+uint32_t BookIndex::trigramKey(const string& text, size_t pos) {
+    return (static_cast<uint32_t>(static_cast<unsigned char>(text[pos])) << 16) |
+        (static_cast<uint32_t>(static_cast<unsigned char>(text[pos + 1])) << 8) |
+        static_cast<uint32_t>(static_cast<unsigned char>(text[pos + 2]));
+}
+
+// Ids ordered by price, ties broken by id so results are stable
+void BookIndex::buildPriceIndex() {
+    byPrice_.resize(books_.size());
+    iota(byPrice_.begin(), byPrice_.end(), 0);
+
+    parallel_sort(byPrice_.begin(), byPrice_.end(),
+        [this](uint32_t a, uint32_t b) {
+            if (books_[a].priceMinor != books_[b].priceMinor) {
+                return books_[a].priceMinor < books_[b].priceMinor;
+            }
+            return a < b;
+        }
+    );
+}
+
+void BookIndex::buildBitmaps() {
+    // Availability classes are few, number them first
+    set<string> classes = parallel_reduce(blocked_range<size_t>(0, books_.size()), set<string>(),
+        [&](const blocked_range<size_t>& r, set<string> found) {
+            for (size_t i = r.begin(); i != r.end(); ++i) {
+                found.insert(books_[i].availability);
+            }
+            return found;
+        },
+        [](set<string> a, const set<string>& b) {
+            a.insert(b.begin(), b.end());
+            return a;
+        }
+    );
+
+    vector<string> classNames(classes.begin(), classes.end());
+    vector<Bitmap> classBitmaps(classNames.size(), Bitmap(books_.size()));
+
+    ratingBitmaps_.assign(6, Bitmap(books_.size()));
+    inStockBitmap_ = Bitmap(books_.size());
+
+    // Every task owns whole 64-bit words, so no two tasks touch the same word
+    size_t wordCount = inStockBitmap_.wordCount();
+    parallel_for(blocked_range<size_t>(0, wordCount),
+        [&](const blocked_range<size_t>& r) {
+            vector<uint64_t> classBits(classNames.size());
+
+            for (size_t w = r.begin(); w != r.end(); ++w) {
+                uint64_t ratingBits[6] = { 0, 0, 0, 0, 0, 0 };
+                uint64_t inStockBits = 0;
+                fill(classBits.begin(), classBits.end(), 0);
+
+                size_t first = w * 64;
+                size_t last = min(first + 64, books_.size());
+
+                for (size_t i = first; i < last; ++i) {
+                    const BookData& book = books_[i];
+                    uint64_t bit = 1ULL << (i - first);
+
+                    if (book.starRating >= 0 && book.starRating <= 5) {
+                        ratingBits[book.starRating] |= bit;
+                    }
+                    if (toLower(book.availability).find("in stock") != string::npos) {
+                        inStockBits |= bit;
+                    }
+
+                    size_t cls = lower_bound(classNames.begin(), classNames.end(), book.availability) - classNames.begin();
+                    classBits[cls] |= bit;
+                }
+
+                for (int rating = 0; rating <= 5; ++rating) {
+                    ratingBitmaps_[rating].setWord(w, ratingBits[rating]);
+                }
+                inStockBitmap_.setWord(w, inStockBits);
+                for (size_t c = 0; c < classBits.size(); ++c) {
+                    classBitmaps[c].setWord(w, classBits[c]);
+                }
+            }
+        }
+    );
+
+    for (size_t c = 0; c < classNames.size(); ++c) {
+        availabilityBitmaps_[classNames[c]] = move(classBitmaps[c]);
+    }
+}
+
+// Trigram postings are built as packed (trigram << 32 | id) pairs,
+// sorted in parallel and then cut into per-trigram id lists
+void BookIndex::buildTrigramIndex() {
+    enumerable_thread_specific<vector<uint64_t>> localPairs;
+
+    parallel_for(blocked_range<size_t>(0, books_.size()),
+        [&](const blocked_range<size_t>& r) {
+            vector<uint64_t>& pairs = localPairs.local();
+            for (size_t i = r.begin(); i != r.end(); ++i) {
+                string title = toLower(books_[i].title);
+                for (size_t pos = 0; pos + 3 <= title.size(); ++pos) {
+                    pairs.push_back((static_cast<uint64_t>(trigramKey(title, pos)) << 32) | i);
+                }
+            }
+        }
+    );
+
+    vector<uint64_t> pairs;
+    for (const auto& local : localPairs) {
+        pairs.insert(pairs.end(), local.begin(), local.end());
+    }
+
+    parallel_sort(pairs.begin(), pairs.end());
+    pairs.erase(unique(pairs.begin(), pairs.end()), pairs.end());
+
+    postingIds_.reserve(pairs.size());
+    for (uint64_t pair : pairs) {
+        uint32_t key = static_cast<uint32_t>(pair >> 32);
+        if (trigramKeys_.empty() || trigramKeys_.back() != key) {
+            trigramKeys_.push_back(key);
+            postingOffsets_.push_back(static_cast<uint32_t>(postingIds_.size()));
+        }
+        postingIds_.push_back(static_cast<uint32_t>(pair));
+    }
+    postingOffsets_.push_back(static_cast<uint32_t>(postingIds_.size()));
+}
+
+// Books whose title contains the text (case insensitive)
+Bitmap BookIndex::matchTitle(const string& text) const {
+    string needle = toLower(text);
+    Bitmap result(books_.size());
+
+    vector<uint32_t> candidates;
+
+    if (needle.size() < 3) {
+        // Too short for trigrams, every title is a candidate
+        candidates.resize(books_.size());
+        iota(candidates.begin(), candidates.end(), 0);
+    }
+    else {
+        // Intersect posting lists, shortest first
+        vector<pair<const uint32_t*, const uint32_t*>> lists;
+        for (size_t pos = 0; pos + 3 <= needle.size(); ++pos) {
+            uint32_t key = trigramKey(needle, pos);
+            auto it = lower_bound(trigramKeys_.begin(), trigramKeys_.end(), key);
+            if (it == trigramKeys_.end() || *it != key) {
+                return result;
+            }
+            size_t k = it - trigramKeys_.begin();
+            lists.emplace_back(postingIds_.data() + postingOffsets_[k], postingIds_.data() + postingOffsets_[k + 1]);
+        }
+
+        sort(lists.begin(), lists.end(),
+            [](const pair<const uint32_t*, const uint32_t*>& a, const pair<const uint32_t*, const uint32_t*>& b) {
+                return (a.second - a.first) < (b.second - b.first);
+            });
+
+        candidates.assign(lists[0].first, lists[0].second);
+        for (size_t l = 1; l < lists.size() && !candidates.empty(); ++l) {
+            vector<uint32_t> next;
+            set_intersection(candidates.begin(), candidates.end(), lists[l].first, lists[l].second, back_inserter(next));
+            candidates.swap(next);
+        }
+    }
+
+    // Trigrams only narrow it down, verify the actual substring
+    vector<char> matches(candidates.size(), 0);
+    parallel_for(blocked_range<size_t>(0, candidates.size()),
+        [&](const blocked_range<size_t>& r) {
+            for (size_t i = r.begin(); i != r.end(); ++i) {
+                matches[i] = toLower(books_[candidates[i]].title).find(needle) != string::npos;
+            }
+        }
+    );
+
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (matches[i]) {
+            result.set(candidates[i]);
+        }
+    }
+    return result;
+}
+
+// Combines all non-price filters, returns false if there are none
+bool BookIndex::matchFilters(const BookQuery& query, Bitmap& filter) const {
+    bool filtered = false;
+    filter = Bitmap(books_.size(), true);
+
+    if (query.starRating > 0) {
+        if (query.starRating > 5) {
+            filter = Bitmap(books_.size());
+            return true;
+        }
+        filter.intersect(ratingBitmaps_[query.starRating]);
+        filtered = true;
+    }
+
+    if (query.inStockOnly) {
+        filter.intersect(inStockBitmap_);
+        filtered = true;
+    }
+
+    if (!query.availability.empty()) {
+        auto it = availabilityBitmaps_.find(query.availability);
+        if (it == availabilityBitmaps_.end()) {
+            filter = Bitmap(books_.size());
+            return true;
+        }
+        filter.intersect(it->second);
+        filtered = true;
+    }
+
+    if (!query.titleContains.empty()) {
+        filter.intersect(matchTitle(query.titleContains));
+        filtered = true;
+    }
+
+    return filtered;
+}
+
+// Slice of byPrice_ with prices inside the requested range
+pair<size_t, size_t> BookIndex::matchPriceRange(const BookQuery& query) const {
+    auto first = byPrice_.begin();
+    auto last = byPrice_.end();
+
+    if (query.hasMinPrice) {
+        first = lower_bound(byPrice_.begin(), byPrice_.end(), query.minPrice,
+            [this](uint32_t id, int64_t price) { return books_[id].priceMinor < price; });
+    }
+    if (query.hasMaxPrice) {
+        last = upper_bound(first, byPrice_.end(), query.maxPrice,
+            [this](int64_t price, uint32_t id) { return price < books_[id].priceMinor; });
+    }
+
+    return make_pair(static_cast<size_t>(first - byPrice_.begin()), static_cast<size_t>(last - byPrice_.begin()));
+}
+
+vector<uint32_t> BookIndex::query(const BookQuery& query) const {
+    Bitmap filter;
+    bool filtered = matchFilters(query, filter);
+    bool priceRange = query.hasMinPrice || query.hasMaxPrice;
+    size_t limit = query.limit > 0 ? query.limit : books_.size();
+
+    vector<uint32_t> ids;
+
+    if (!priceRange && query.order == BookQuery::Order::None) {
+        if (filtered) {
+            ids = filter.toIds();
+        }
+        else {
+            ids.resize(books_.size());
+            iota(ids.begin(), ids.end(), 0);
+        }
+        if (ids.size() > limit) {
+            ids.resize(limit);
+        }
+        return ids;
+    }
+
+    // Walk the price index in the requested direction, stop after limit hits
+    pair<size_t, size_t> range = matchPriceRange(query);
+    bool descending = query.order == BookQuery::Order::PriceDescending;
+
+    for (size_t n = range.first; n < range.second && ids.size() < limit; ++n) {
+        uint32_t id = descending ? byPrice_[range.second - 1 - (n - range.first)] : byPrice_[n];
+        if (!filtered || filter.test(id)) {
+            ids.push_back(id);
+        }
+    }
+
+    return ids;
+}
+
+size_t BookIndex::count(const BookQuery& query) const {
+    Bitmap filter;
+    bool filtered = matchFilters(query, filter);
+
+    if (!query.hasMinPrice && !query.hasMaxPrice) {
+        return filtered ? filter.count() : books_.size();
+    }
+
+    pair<size_t, size_t> range = matchPriceRange(query);
+    if (!filtered) {
+        return range.second - range.first;
+    }
+
+    return parallel_reduce(blocked_range<size_t>(range.first, range.second), size_t(0),
+        [&](const blocked_range<size_t>& r, size_t total) {
+            for (size_t n = r.begin(); n != r.end(); ++n) {
+                if (filter.test(byPrice_[n])) {
+                    total++;
+                }
+            }
+            return total;
+        },
+        plus<size_t>()
+    );
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "BookData.h"
+
+using namespace std;
+
+// Fixed-size bitset over book ids, one bit per book
+class Bitmap {
+public:
+    Bitmap() = default;
+    explicit Bitmap(size_t size, bool value = false);
+
+    void set(size_t index);
+    bool test(size_t index) const;
+    size_t size() const { return size_; }
+    size_t count() const;
+
+    void intersect(const Bitmap& other);
+    void setWord(size_t index, uint64_t bits) { words_[index] = bits; }
+    size_t wordCount() const { return words_.size(); }
+    vector<uint32_t> toIds() const;
+
+private:
+    size_t size_ = 0;
+    vector<uint64_t> words_;
+};
+
+// Filters of a query, unset filters match everything
+struct BookQuery {
+    bool hasMinPrice = false;
+    int64_t minPrice = 0;       // minor units
+    bool hasMaxPrice = false;
+    int64_t maxPrice = 0;
+    int starRating = 0;
+    bool inStockOnly = false;
+    string availability;
+    string titleContains;
+
+    enum class Order { None, PriceAscending, PriceDescending };
+    Order order = Order::None;
+    size_t limit = 0;
+};
+
+// Read-only indexes over a scraped dataset:
+// - ids sorted by price for range queries and top-k
+// - bitmaps per star rating and availability class
+// - title trigram postings for substring search
+class BookIndex {
+public:
+    explicit BookIndex(vector<BookData> books);
+
+    vector<uint32_t> query(const BookQuery& query) const;
+    size_t count(const BookQuery& query) const;
+
+    const BookData& book(uint32_t id) const { return books_[id]; }
+    size_t size() const { return books_.size(); }
+
+private:
+    vector<BookData> books_;
+    vector<uint32_t> byPrice_;
+    vector<Bitmap> ratingBitmaps_;
+    map<string, Bitmap> availabilityBitmaps_;
+    Bitmap inStockBitmap_;
+
+    // Trigram postings in CSR form: ids of trigramKeys_[i] are
+    // postingIds_[postingOffsets_[i] .. postingOffsets_[i + 1])
+    vector<uint32_t> trigramKeys_;
+    vector<uint32_t> postingOffsets_;
+    vector<uint32_t> postingIds_;
+
+    void buildPriceIndex();
+    void buildBitmaps();
+    void buildTrigramIndex();
+
+    bool matchFilters(const BookQuery& query, Bitmap& filter) const;
+    pair<size_t, size_t> matchPriceRange(const BookQuery& query) const;
+    Bitmap matchTitle(const string& text) const;
+
+    static string toLower(const string& text);
+    static uint32_t trigramKey(const string& text, size_t pos);
+};
@@ -0,0 +1,114 @@
+#include "BookSerializer.h"
+#include "TextKernels.h"
+#include <sstream>
+#include <vector>
+
+using namespace std;
+
+string BookSerializer::escapeField(const string& value) {
+    string escaped;
+    escaped.reserve(value.size());
+
+    for (char ch : value) {
+        switch (ch) {
+        case '\\': escaped += "\\\\"; break;
+        case '\t': escaped += "\\t"; break;
+        case '\n': escaped += "\\n"; break;
+        case '\r': escaped += "\\r"; break;
+        default: escaped += ch; break;
+        }
+    }
+    return escaped;
+}
+
+string BookSerializer::unescapeField(const string& value) {
+    string result;
+    result.reserve(value.size());
+
+    for (size_t i = 0; i < value.size(); ++i) {
+        if (value[i] != '\\' || i + 1 == value.size()) {
+            result += value[i];
+            continue;
+        }
+
+        char next = value[++i];
+        switch (next) {
+        case 't': result += '\t'; break;
+        case 'n': result += '\n'; break;
+        case 'r': result += '\r'; break;
+        default: result += next; break;
+        }
+    }
+    return result;
+}
+
+void BookSerializer::writeBook(ostream& out, const BookData& book) {
+    out << formatBook(book) << '\n';
+}
+
+bool BookSerializer::readBook(istream& in, BookData& book) {
+    string line;
+    if (!getline(in, line)) {
+        return false;
+    }
+    return parseBook(line, book);
+}
+
+string BookSerializer::formatBook(const BookData& book) {
+    ostringstream oss;
+    oss << escapeField(book.title) << '\t'
+        << book.priceMinor << '\t'
+        << book.starRating << '\t'
+        << escapeField(book.availability) << '\t'
+        << escapeField(book.imageUrl) << '\t'
+        << escapeField(book.imageHash) << '\t'
+        << escapeField(book.detailUrl) << '\t'
+        << escapeField(book.upc) << '\t'
+        << book.stockCount << '\t'
+        << escapeField(book.category) << '\t'
+        << escapeField(book.description);
+    return oss.str();
+}
+
+bool BookSerializer::parseBook(const string& line, BookData& book) {
+    vector<string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t tab = line.find('\t', start);
+        fields.push_back(line.substr(start, tab - start));
+        if (tab == string::npos) {
+            break;
+        }
+        start = tab + 1;
+    }
+
+    if (fields.size() < 5) {
+        return false;
+    }
+
+    if (!TextKernels::parseInt64(fields[1], book.priceMinor) || !TextKernels::parseInt(fields[2], book.starRating)) {
+        return false;
+    }
+
+    book.title = unescapeField(fields[0]);
+    book.availability = unescapeField(fields[3]);
+    book.imageUrl = unescapeField(fields[4]);
+
+    // Caches written before covers were stored have no hash column
+    if (fields.size() > 5) {
+        book.imageHash = unescapeField(fields[5]);
+    }
+
+    // Nor product page details
+    if (fields.size() > 10) {
+        if (!TextKernels::parseInt(fields[8], book.stockCount)) {
+            return false;
+        }
+        book.detailUrl = unescapeField(fields[6]);
+        book.upc = unescapeField(fields[7]);
+        book.category = unescapeField(fields[9]);
+        book.description = unescapeField(fields[10]);
+    }
+
+    return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <istream>
+#include <ostream>
+#include <string>
+#include "BookData.h"
+
+using namespace std;
+
+// Line-based text encoding for BookData records (one book per line,
+// tab separated, with tabs/newlines/backslashes escaped).
+// Used by the page cache and the shard protocol.
+class BookSerializer {
+public:
+    static void writeBook(ostream& out, const BookData& book);
+    static bool readBook(istream& in, BookData& book);
+
+    static string formatBook(const BookData& book);
+    static bool parseBook(const string& line, BookData& book);
+
+    static string escapeField(const string& value);
+    static string unescapeField(const string& value);
+};
@@ -0,0 +1,348 @@
+#include "BookSorter.h"
+#include "BookSerializer.h"
+#include <cctype>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+
+using namespace std;
+using namespace tbb;
+namespace fs = std::filesystem;
+
+// Books handed to the output store at a time, unless the page changes first
+const size_t OUTPUT_BATCH = BookStore::SEGMENT_BOOKS;
+
+BookSorter::BookSorter(MemoryBudget& budget, SortKey key) : budget_(budget), key_(key) {
+}
+
+BookSorter::~BookSorter() {
+    releaseRecords();
+    if (!runDirectory_.empty()) {
+        error_code error;
+        fs::remove_all(runDirectory_, error);
+    }
+}
+
+SortKey BookSorter::parseKey(const string& name) {
+    if (name == "page") {
+        return SortKey::Page;
+    }
+    if (name == "price") {
+        return SortKey::Price;
+    }
+    if (name == "title") {
+        return SortKey::Title;
+    }
+    throw runtime_error("Unknown sort key: " + name + " (use page, price or title)");
+}
+
+string BookSorter::keyName(SortKey key) {
+    switch (key) {
+    case SortKey::Page: return "page";
+    case SortKey::Price: return "price";
+    case SortKey::Title: return "title";
+    default: return "crawl order";
+    }
+}
+
+int BookSorter::compareNatural(const string& a, const string& b) {
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size()) {
+        if (isdigit(static_cast<unsigned char>(a[i])) && isdigit(static_cast<unsigned char>(b[j]))) {
+            // Leading zeros don't count, then the longer number is the larger one
+            size_t startA = i, startB = j;
+            while (startA < a.size() && a[startA] == '0') {
+                startA++;
+            }
+            while (startB < b.size() && b[startB] == '0') {
+                startB++;
+            }
+            size_t endA = startA, endB = startB;
+            while (endA < a.size() && isdigit(static_cast<unsigned char>(a[endA]))) {
+                endA++;
+            }
+            while (endB < b.size() && isdigit(static_cast<unsigned char>(b[endB]))) {
+                endB++;
+            }
+
+            if (endA - startA != endB - startB) {
+                return endA - startA < endB - startB ? -1 : 1;
+            }
+            int digits = a.compare(startA, endA - startA, b, startB, endB - startB);
+            if (digits != 0) {
+                return digits;
+            }
+            i = endA;
+            j = endB;
+            continue;
+        }
+
+        if (a[i] != b[j]) {
+            return static_cast<unsigned char>(a[i]) < static_cast<unsigned char>(b[j]) ? -1 : 1;
+        }
+        i++;
+        j++;
+    }
+
+    if (i < a.size()) {
+        return 1;
+    }
+    return j < b.size() ? -1 : 0;
+}
+
+bool BookSorter::less(const Record& a, const Record& b) const {
+    const BookData& x = a.book;
+    const BookData& y = b.book;
+
+    if (key_ == SortKey::Price) {
+        if (x.priceMinor != y.priceMinor) {
+            return x.priceMinor < y.priceMinor;
+        }
+        int titles = x.title.compare(y.title);
+        if (titles != 0) {
+            return titles < 0;
+        }
+    }
+    else if (key_ == SortKey::Title) {
+        int titles = x.title.compare(y.title);
+        if (titles != 0) {
+            return titles < 0;
+        }
+        if (x.priceMinor != y.priceMinor) {
+            return x.priceMinor < y.priceMinor;
+        }
+    }
+
+    if (a.page != b.page) {
+        int pages = compareNatural(pages_[a.page], pages_[b.page]);
+        if (pages != 0) {
+            return pages < 0;
+        }
+    }
+    return a.position < b.position;
+}
+
+size_t BookSorter::bytesOf(const Record& record) {
+    return sizeof(Record) + BookStore::bytesOf(record.book);
+}
+
+void BookSorter::releaseRecords() {
+    budget_.release(MemoryUse::Sort, recordBytes_);
+    recordBytes_ = 0;
+    records_.clear();
+    records_.shrink_to_fit();
+}
+
+void BookSorter::sortRecords() {
+    parallel_sort(records_.begin(), records_.end(),
+        [this](const Record& a, const Record& b) { return less(a, b); });
+}
+
+string BookSorter::formatRecord(const Record& record) {
+    return to_string(record.page) + '\t' + to_string(record.position) + '\t' +
+        BookSerializer::formatBook(record.book) + '\n';
+}
+
+bool BookSorter::parseRecord(const string& line, Record& record) {
+    size_t first = line.find('\t');
+    size_t second = first == string::npos ? string::npos : line.find('\t', first + 1);
+    record.book = BookData();
+    if (second == string::npos || !BookSerializer::parseBook(line.substr(second + 1), record.book)) {
+        return false;
+    }
+    record.page = static_cast<uint32_t>(strtoul(line.c_str(), nullptr, 10));
+    record.position = static_cast<uint32_t>(strtoul(line.c_str() + first + 1, nullptr, 10));
+    return true;
+}
+
+string BookSorter::newRunPath() {
+    lock_guard<mutex> lock(runMutex_);
+    if (runDirectory_.empty()) {
+        runDirectory_ = (fs::temp_directory_path() /
+            ("shelfscan-sort-" + to_string(random_device()()))).string();
+        fs::create_directories(runDirectory_);
+    }
+    return (fs::path(runDirectory_) / ("run-" + to_string(runCount_++) + ".books")).string();
+}
+
+// Lines are formatted in parallel, then written with one call each
+void BookSorter::writeRun() {
+    sortRecords();
+
+    vector<string> lines(records_.size());
+    parallel_for(blocked_range<size_t>(0, records_.size()),
+        [&](const blocked_range<size_t>& r) {
+            for (size_t i = r.begin(); i != r.end(); ++i) {
+                lines[i] = formatRecord(records_[i]);
+            }
+        }
+    );
+
+    string path = newRunPath();
+    ofstream file(path, ios::binary);
+    if (!file.is_open()) {
+        throw runtime_error("Cannot open run file: " + path);
+    }
+    for (const auto& line : lines) {
+        file.write(line.data(), static_cast<streamsize>(line.size()));
+    }
+    if (!file) {
+        throw runtime_error("Cannot write run file: " + path);
+    }
+
+    cout << "Sorted run of " << records_.size() << " books written to " << path << endl;
+    runFiles_.push_back(path);
+    releaseRecords();
+}
+
+void BookSorter::sort(const BookStore& from, BookStore& to) {
+    from.forEachPage([&](const string& url, const vector<BookData>& books) {
+        uint32_t page = static_cast<uint32_t>(pages_.size());
+        pages_.push_back(url);
+
+        size_t bytes = 0;
+        for (size_t i = 0; i < books.size(); ++i) {
+            records_.push_back(Record{ page, static_cast<uint32_t>(i), books[i] });
+            bytes += bytesOf(records_.back());
+        }
+        recordBytes_ += bytes;
+        budget_.reserve(MemoryUse::Sort, bytes);
+
+        if (budget_.exceeded() && records_.size() >= MIN_RUN_BOOKS) {
+            writeRun();
+        }
+    });
+
+    if (!runFiles_.empty()) {
+        if (!records_.empty()) {
+            writeRun();
+        }
+        mergeRuns(to);
+        return;
+    }
+
+    // Everything fit, books move out batch by batch and leave the budget as they go
+    sortRecords();
+
+    vector<BookData> batch;
+    size_t batchBytes = 0;
+    for (size_t i = 0; i < records_.size(); ++i) {
+        batchBytes += bytesOf(records_[i]);
+        batch.push_back(move(records_[i].book));
+
+        if (i + 1 == records_.size() || batch.size() >= OUTPUT_BATCH || records_[i + 1].page != records_[i].page) {
+            to.append(pages_[records_[i].page], batch);
+            batch.clear();
+            budget_.release(MemoryUse::Sort, batchBytes);
+            recordBytes_ -= batchBytes;
+            batchBytes = 0;
+        }
+    }
+    releaseRecords();
+}
+
+// Streams the records of sorted run files in order, the smallest head first
+void BookSorter::merge(const vector<string>& files, const function<void(Record& record)>& emit) const {
+    struct RunReader {
+        ifstream file;
+        Record record;
+    };
+
+    vector<unique_ptr<RunReader>> readers;
+    auto next = [](RunReader& reader) {
+        string line;
+        if (!getline(reader.file, line)) {
+            return false;
+        }
+        if (!parseRecord(line, reader.record)) {
+            throw runtime_error("Corrupt run file line: " + line.substr(0, 80));
+        }
+        return true;
+    };
+
+    auto after = [this, &readers](size_t a, size_t b) {
+        return less(readers[b]->record, readers[a]->record);
+    };
+    priority_queue<size_t, vector<size_t>, decltype(after)> heads(after);
+
+    for (const auto& path : files) {
+        readers.push_back(make_unique<RunReader>());
+        readers.back()->file.open(path, ios::binary);
+        if (!readers.back()->file.is_open()) {
+            throw runtime_error("Cannot open run file: " + path);
+        }
+        if (next(*readers.back())) {
+            heads.push(readers.size() - 1);
+        }
+    }
+
+    while (!heads.empty()) {
+        size_t run = heads.top();
+        heads.pop();
+
+        emit(readers[run]->record);
+        if (next(*readers[run])) {
+            heads.push(run);
+        }
+    }
+}
+
+// At most MERGE_FAN_IN files are open at a time; with more runs, groups of
+// them are merged into longer runs first, the groups in parallel
+void BookSorter::mergeRuns(BookStore& to) {
+    while (runFiles_.size() > MERGE_FAN_IN) {
+        size_t groups = (runFiles_.size() + MERGE_FAN_IN - 1) / MERGE_FAN_IN;
+        vector<string> merged(groups);
+
+        parallel_for(blocked_range<size_t>(0, groups, 1),
+            [&](const blocked_range<size_t>& r) {
+                for (size_t group = r.begin(); group != r.end(); ++group) {
+                    auto first = runFiles_.begin() + group * MERGE_FAN_IN;
+                    vector<string> files(first, first + min(static_cast<size_t>(MERGE_FAN_IN), static_cast<size_t>(runFiles_.end() - first)));
+
+                    merged[group] = newRunPath();
+                    ofstream file(merged[group], ios::binary);
+                    merge(files, [&](Record& record) {
+                        file << formatRecord(record);
+                    });
+                    if (!file) {
+                        throw runtime_error("Cannot write run file: " + merged[group]);
+                    }
+
+                    for (const auto& path : files) {
+                        error_code error;
+                        fs::remove(path, error);
+                    }
+                }
+            }
+        );
+
+        cout << "Merged " << runFiles_.size() << " sorted runs into " << groups << endl;
+        runFiles_ = move(merged);
+    }
+
+    vector<BookData> batch;
+    uint32_t batchPage = 0;
+    merge(runFiles_, [&](Record& record) {
+        if (!batch.empty() && (record.page != batchPage || batch.size() >= OUTPUT_BATCH)) {
+            to.append(pages_[batchPage], batch);
+            batch.clear();
+        }
+        batchPage = record.page;
+        batch.push_back(move(record.book));
+    });
+    if (!batch.empty()) {
+        to.append(pages_[batchPage], batch);
+    }
+
+    cout << "Merged " << runFiles_.size() << " sorted runs" << endl;
+}
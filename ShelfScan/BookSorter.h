@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "BookData.h"
+#include "BookStore.h"
+#include "MemoryBudget.h"
+
+using namespace std;
+
+enum class SortKey { None, Page, Price, Title };
+
+// Orders the books of a store by a key, ties broken by source page and the
+// position on it, so the order never depends on crawl timing. Books are
+// gathered and sorted in memory with a parallel sort. Once the memory budget
+// is exceeded, each gathered run is sorted and written to a run file, and
+// the runs are merged k ways at the end.
+class BookSorter {
+public:
+    // Runs are never smaller than this, however tight the budget
+    static const size_t MIN_RUN_BOOKS = 4096;
+    // Run files open at once while merging
+    static const size_t MERGE_FAN_IN = 64;
+
+    BookSorter(MemoryBudget& budget, SortKey key);
+    ~BookSorter();
+
+    // Appends the books of from to to in order
+    void sort(const BookStore& from, BookStore& to);
+    size_t runCount() const { return runCount_; }
+
+    // "page", "price" or "title", throws on anything else
+    static SortKey parseKey(const string& name);
+    static string keyName(SortKey key);
+    // Digit runs compare as numbers: page-2 before page-10
+    static int compareNatural(const string& a, const string& b);
+
+private:
+    struct Record {
+        uint32_t page;          // into pages_
+        uint32_t position;      // on the page
+        BookData book;
+    };
+
+    MemoryBudget& budget_;
+    SortKey key_;
+    vector<string> pages_;
+    vector<Record> records_;
+    size_t recordBytes_ = 0;
+    mutex runMutex_;
+    string runDirectory_;
+    vector<string> runFiles_;
+    size_t runCount_ = 0;       // run files written, merged ones included
+
+    bool less(const Record& a, const Record& b) const;
+    void sortRecords();
+    void releaseRecords();
+    string newRunPath();
+    void writeRun();
+    void merge(const vector<string>& files, const function<void(Record& record)>& emit) const;
+    void mergeRuns(BookStore& to);
+
+    static size_t bytesOf(const Record& record);
+    static string formatRecord(const Record& record);
+    static bool parseRecord(const string& line, Record& record);
+};
@@ -0,0 +1,286 @@
+#include "BookStore.h"
+#include "BookSerializer.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+BookStore::BookStore(MemoryBudget& budget) : budget_(budget) {
+    segments_.push_back(make_shared<Segment>());
+    segments_.back()->books = make_shared<BookSegment>();
+}
+
+// The budget may outlive the store, books still in memory are given back
+BookStore::~BookStore() {
+    clear();
+}
+
+size_t BookStore::bytesOf(const BookData& book) {
+    return sizeof(BookData) + book.title.size() + book.availability.size() +
+        book.imageUrl.size() + book.imageHash.size() + book.detailUrl.size() +
+        book.upc.size() + book.category.size() + book.description.size();
+}
+
+void BookStore::append(const string& pageUrl, const vector<BookData>& books) {
+    size_t bytes = 0;
+    for (const auto& book : books) {
+        bytes += bytesOf(book);
+    }
+
+    {
+        lock_guard<mutex> lock(mutex_);
+        Segment& open = *segments_.back();
+
+        for (const auto& book : books) {
+            open.books->push_back(book);
+        }
+        open.pages.push_back(PageRun{ pageUrl, books.size() });
+        open.count += books.size();
+        open.bytes += bytes;
+        size_ += books.size();
+
+        // Seal it, a sealed segment never changes again
+        if (open.count >= SEGMENT_BOOKS) {
+            segments_.push_back(make_shared<Segment>());
+            segments_.back()->books = make_shared<BookSegment>();
+        }
+    }
+
+    budget_.reserve(MemoryUse::Books, bytes);
+
+    if (budget_.exceeded()) {
+        spillWhileOverBudget();
+    }
+}
+
+void BookStore::clear() {
+    lock_guard<mutex> spillLock(spillMutex_);
+
+    size_t bytes = 0;
+    {
+        lock_guard<mutex> lock(mutex_);
+        for (const auto& segment : segments_) {
+            if (segment->books) {
+                bytes += segment->bytes;
+            }
+        }
+
+        segments_.clear();
+        segments_.push_back(make_shared<Segment>());
+        segments_.back()->books = make_shared<BookSegment>();
+        size_ = 0;
+    }
+    budget_.release(MemoryUse::Books, bytes);
+
+    if (!spillDirectory_.empty()) {
+        error_code error;
+        fs::remove_all(spillDirectory_, error);
+        spillDirectory_.clear();
+    }
+}
+
+void BookStore::erase(const vector<size_t>& positions) {
+    lock_guard<mutex> spillLock(spillMutex_);
+
+    size_t next = 0;
+    size_t base = 0;
+    for (const auto& segment : segments()) {
+        size_t end = base + segment->count;
+        if (next == positions.size() || positions[next] >= end) {
+            base = end;
+            continue;
+        }
+
+        bool spilled = !segment->books;
+        shared_ptr<BookSegment> books = spilled ? load(*segment) : segment->books;
+
+        // Page runs shrink by the books dropped from them
+        auto kept = make_shared<BookSegment>();
+        kept->reserve(segment->count);
+        vector<PageRun> pages = segment->pages;
+        size_t offset = 0;
+        size_t bytes = 0;
+        for (auto& page : pages) {
+            size_t pageEnd = offset + page.count;
+            for (; offset < pageEnd; ++offset) {
+                if (next < positions.size() && positions[next] == base + offset) {
+                    next++;
+                    page.count--;
+                    continue;
+                }
+                kept->push_back((*books)[offset]);
+                bytes += bytesOf((*books)[offset]);
+            }
+        }
+
+        if (spilled) {
+            Segment rewritten;
+            rewritten.books = kept;
+            writeSpillFile(rewritten, segment->spillFile);
+        }
+
+        size_t released = segment->bytes - bytes;
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (!spilled) {
+                segment->books = kept;
+            }
+            segment->pages = move(pages);
+            size_ -= segment->count - kept->size();
+            segment->count = kept->size();
+            segment->bytes = bytes;
+        }
+        if (!spilled) {
+            budget_.release(MemoryUse::Books, released);
+        }
+
+        base = end;
+    }
+}
+
+// Oldest sealed segments go first, the file is written without holding the
+// store lock since sealed segments are read-only
+void BookStore::spillWhileOverBudget() {
+    lock_guard<mutex> spillLock(spillMutex_);
+
+    if (spillDirectory_.empty()) {
+        spillDirectory_ = (fs::temp_directory_path() /
+            ("shelfscan-spill-" + to_string(random_device()()))).string();
+        fs::create_directories(spillDirectory_);
+    }
+
+    for (size_t i = 0; budget_.exceeded(); ++i) {
+        shared_ptr<Segment> segment;
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (i + 1 >= segments_.size()) {
+                return;     // only the open segment is left
+            }
+            segment = segments_[i];
+        }
+
+        if (!segment->books) {
+            continue;
+        }
+
+        string path = (fs::path(spillDirectory_) / ("segment-" + to_string(i) + ".books")).string();
+        writeSpillFile(*segment, path);
+
+        {
+            lock_guard<mutex> lock(mutex_);
+            segment->spillFile = path;
+            segment->books.reset();
+        }
+        budget_.release(MemoryUse::Books, segment->bytes);
+
+        cout << "Spilled " << segment->count << " books to " << path << endl;
+    }
+}
+
+void BookStore::writeSpillFile(const Segment& segment, const string& path) const {
+    ofstream file(path);
+    if (!file.is_open()) {
+        throw runtime_error("Cannot open spill file: " + path);
+    }
+
+    for (const auto& book : *segment.books) {
+        BookSerializer::writeBook(file, book);
+    }
+
+    if (!file) {
+        throw runtime_error("Cannot write spill file: " + path);
+    }
+}
+
+shared_ptr<BookSegment> BookStore::load(const Segment& segment) const {
+    auto books = make_shared<BookSegment>();
+    books->reserve(segment.count);
+
+    ifstream file(segment.spillFile);
+    BookData book;
+    while (books->size() < segment.count && BookSerializer::readBook(file, book)) {
+        books->push_back(book);
+    }
+
+    if (books->size() != segment.count) {
+        throw runtime_error("Truncated spill file: " + segment.spillFile);
+    }
+    return books;
+}
+
+vector<shared_ptr<BookStore::Segment>> BookStore::segments() const {
+    lock_guard<mutex> lock(mutex_);
+    return segments_;
+}
+
+void BookStore::forEachSegment(const function<void(const BookSegment& books)>& visit) const {
+    for (const auto& segment : segments()) {
+        shared_ptr<BookSegment> books;
+        {
+            lock_guard<mutex> lock(mutex_);
+            books = segment->books;
+        }
+
+        if (!books) {
+            books = load(*segment);
+        }
+        if (!books->empty()) {
+            visit(*books);
+        }
+    }
+}
+
+void BookStore::forEachPage(const function<void(const string& url, const vector<BookData>& books)>& visit) const {
+    for (const auto& segment : segments()) {
+        shared_ptr<BookSegment> books;
+        vector<PageRun> pages;
+        {
+            lock_guard<mutex> lock(mutex_);
+            books = segment->books;
+            pages = segment->pages;
+        }
+
+        if (!books) {
+            books = load(*segment);
+        }
+
+        // concurrent_vector isn't contiguous, copy each page's run out
+        size_t offset = 0;
+        vector<BookData> run;
+        for (const auto& page : pages) {
+            run.assign(books->begin() + offset, books->begin() + offset + page.count);
+            visit(page.url, run);
+            offset += page.count;
+        }
+    }
+}
+
+vector<BookData> BookStore::snapshot() const {
+    vector<BookData> all;
+    all.reserve(size());
+
+    forEachSegment([&](const BookSegment& books) {
+        all.insert(all.end(), books.begin(), books.end());
+    });
+    return all;
+}
+
+size_t BookStore::size() const {
+    lock_guard<mutex> lock(mutex_);
+    return size_;
+}
+
+size_t BookStore::spilledSegments() const {
+    lock_guard<mutex> lock(mutex_);
+
+    size_t spilled = 0;
+    for (const auto& segment : segments_) {
+        if (!segment->books) {
+            spilled++;
+        }
+    }
+    return spilled;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <tbb/concurrent_vector.h>
+#include "BookData.h"
+#include "MemoryBudget.h"
+
+using namespace std;
+
+typedef tbb::concurrent_vector<BookData> BookSegment;
+
+// Scraped books, kept in segments of about SEGMENT_BOOKS books with the books
+// of one page always in the same segment. Full segments are sealed; while the
+// memory budget is exceeded sealed segments are written to spill files and
+// dropped from memory. Readers get every segment back one at a time.
+class BookStore {
+public:
+    static const size_t SEGMENT_BOOKS = 4096;
+
+    explicit BookStore(MemoryBudget& budget);
+    ~BookStore();
+
+    void append(const string& pageUrl, const vector<BookData>& books);
+
+    // Drops all books and spill files, not safe while appending
+    void clear();
+
+    // Drops the books at the given positions (ascending, counted in
+    // forEachSegment order), spilled segments are rewritten. Not safe while
+    // appending.
+    void erase(const vector<size_t>& positions);
+
+    size_t size() const;
+    size_t spilledSegments() const;
+
+    void forEachSegment(const function<void(const BookSegment& books)>& visit) const;
+    void forEachPage(const function<void(const string& url, const vector<BookData>& books)>& visit) const;
+    vector<BookData> snapshot() const;
+
+    static size_t bytesOf(const BookData& book);
+
+private:
+    struct PageRun {
+        string url;
+        size_t count;
+    };
+
+    struct Segment {
+        shared_ptr<BookSegment> books;  // null once spilled
+        vector<PageRun> pages;
+        string spillFile;
+        size_t count = 0;
+        size_t bytes = 0;
+    };
+
+    MemoryBudget& budget_;
+    mutable mutex mutex_;
+    mutex spillMutex_;
+    vector<shared_ptr<Segment>> segments_;     // last one is open for appends
+    size_t size_ = 0;
+    string spillDirectory_;
+
+    void spillWhileOverBudget();
+    void writeSpillFile(const Segment& segment, const string& path) const;
+    shared_ptr<BookSegment> load(const Segment& segment) const;
+    vector<shared_ptr<Segment>> segments() const;
+};
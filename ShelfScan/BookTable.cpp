@@ -0,0 +1,530 @@
+#include "BookTable.h"
+#include "Varint.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+using namespace std;
+using namespace tbb;
+namespace fs = std::filesystem;
+
+static const char MAGIC[4] = { 'S', 'S', 'B', 'T' };
+
+enum Encoding : uint8_t {
+    STRING_PLAIN,           // uint32 offsets (rows + 1), bytes
+    STRING_DICTIONARY,      // uint32 count, uint32 offsets (count + 1), bytes, indexes
+    INT_PLAIN,              // int64 values
+    INT_FRAME,              // int64 base, unsigned offsets from it of 1, 2 or 4 bytes
+    INT_DELTA               // zigzag varint deltas from the previous value
+};
+
+// The mapping gives no alignment guarantee, values are read with memcpy
+static uint32_t load32(const char* data) {
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static int64_t load64(const char* data) {
+    int64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static uint64_t loadUnsigned(const char* data, int width) {
+    switch (width) {
+    case 1:
+        return static_cast<uint8_t>(*data);
+    case 2: {
+        uint16_t value;
+        memcpy(&value, data, sizeof(value));
+        return value;
+    }
+    case 4:
+        return load32(data);
+    default:
+        return static_cast<uint64_t>(load64(data));
+    }
+}
+
+static void put32(string& out, uint32_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void put64(string& out, int64_t value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void putUnsigned(string& out, uint64_t value, int width) {
+    out.append(reinterpret_cast<const char*>(&value), static_cast<size_t>(width));
+}
+
+static int widthFor(uint64_t maxValue) {
+    return maxValue <= 0xFF ? 1 : maxValue <= 0xFFFF ? 2 : maxValue <= 0xFFFFFFFF ? 4 : 8;
+}
+
+static const string& stringField(const BookData& book, BookColumn column) {
+    switch (column) {
+    case BookColumn::Title: return book.title;
+    case BookColumn::Availability: return book.availability;
+    case BookColumn::ImageUrl: return book.imageUrl;
+    case BookColumn::ImageHash: return book.imageHash;
+    case BookColumn::DetailUrl: return book.detailUrl;
+    case BookColumn::Upc: return book.upc;
+    case BookColumn::Category: return book.category;
+    default: return book.description;
+    }
+}
+
+static string& stringField(BookData& book, BookColumn column) {
+    return const_cast<string&>(stringField(static_cast<const BookData&>(book), column));
+}
+
+static int64_t intField(const BookData& book, BookColumn column) {
+    switch (column) {
+    case BookColumn::Price: return book.priceMinor;
+    case BookColumn::StarRating: return book.starRating;
+    default: return book.stockCount;
+    }
+}
+
+static void setIntField(BookData& book, BookColumn column, int64_t value) {
+    switch (column) {
+    case BookColumn::Price: book.priceMinor = value; break;
+    case BookColumn::StarRating: book.starRating = static_cast<int>(value); break;
+    default: book.stockCount = static_cast<int>(value); break;
+    }
+}
+
+// Dictionary when the distinct values plus their indexes beat the plain layout
+static void encodeStrings(const vector<BookData>& rows, BookColumn column, string& chunk, BookTable::ChunkInfo& info) {
+    size_t plainSize = (rows.size() + 1) * sizeof(uint32_t);
+    unordered_map<string_view, uint32_t> ids;
+    vector<string_view> dictionary;
+    vector<uint32_t> indexes(rows.size());
+    size_t dictionaryBytes = 0;
+
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const string& value = stringField(rows[i], column);
+        plainSize += value.size();
+
+        auto found = ids.emplace(value, static_cast<uint32_t>(dictionary.size()));
+        if (found.second) {
+            dictionary.push_back(value);
+            dictionaryBytes += value.size();
+        }
+        indexes[i] = found.first->second;
+    }
+
+    if (plainSize > numeric_limits<uint32_t>::max()) {
+        throw runtime_error("Column chunk too large for a book table");
+    }
+
+    int width = widthFor(dictionary.empty() ? 0 : dictionary.size() - 1);
+    size_t dictionarySize = sizeof(uint32_t) + (dictionary.size() + 1) * sizeof(uint32_t) +
+        dictionaryBytes + rows.size() * width;
+
+    uint32_t offset = 0;
+    if (dictionarySize < plainSize) {
+        info.encoding = STRING_DICTIONARY;
+        info.width = static_cast<uint8_t>(width);
+        chunk.reserve(dictionarySize);
+
+        put32(chunk, static_cast<uint32_t>(dictionary.size()));
+        for (const auto& value : dictionary) {
+            put32(chunk, offset);
+            offset += static_cast<uint32_t>(value.size());
+        }
+        put32(chunk, offset);
+        for (const auto& value : dictionary) {
+            chunk.append(value.data(), value.size());
+        }
+        for (uint32_t index : indexes) {
+            putUnsigned(chunk, index, width);
+        }
+    }
+    else {
+        info.encoding = STRING_PLAIN;
+        info.width = 0;
+        chunk.reserve(plainSize);
+
+        for (const auto& row : rows) {
+            put32(chunk, offset);
+            offset += static_cast<uint32_t>(stringField(row, column).size());
+        }
+        put32(chunk, offset);
+        for (const auto& row : rows) {
+            chunk += stringField(row, column);
+        }
+    }
+}
+
+// Smallest of plain, frame of reference and delta varints. Delta varints have
+// to save a quarter, the other two keep random access.
+static void encodeInts(const vector<BookData>& rows, BookColumn column, string& chunk, BookTable::ChunkInfo& info) {
+    int64_t minValue = numeric_limits<int64_t>::max();
+    int64_t maxValue = numeric_limits<int64_t>::min();
+    string deltas;
+    int64_t previous = 0;
+
+    for (const auto& row : rows) {
+        int64_t value = intField(row, column);
+        minValue = min(minValue, value);
+        maxValue = max(maxValue, value);
+        putVarint(deltas, zigzag(value - previous));
+        previous = value;
+    }
+    info.min = rows.empty() ? 0 : minValue;
+    info.max = rows.empty() ? 0 : maxValue;
+
+    uint64_t range = static_cast<uint64_t>(info.max) - static_cast<uint64_t>(info.min);
+    int width = widthFor(range);
+    size_t plainSize = rows.size() * sizeof(int64_t);
+    size_t frameSize = width < 8 ? sizeof(int64_t) + rows.size() * width : plainSize + 1;
+
+    if (deltas.size() * 4 < min(plainSize, frameSize) * 3) {
+        info.encoding = INT_DELTA;
+        info.width = 0;
+        chunk = move(deltas);
+    }
+    else if (frameSize <= plainSize) {
+        info.encoding = INT_FRAME;
+        info.width = static_cast<uint8_t>(width);
+        chunk.reserve(frameSize);
+        put64(chunk, info.min);
+        for (const auto& row : rows) {
+            putUnsigned(chunk, static_cast<uint64_t>(intField(row, column)) - static_cast<uint64_t>(info.min), width);
+        }
+    }
+    else {
+        info.encoding = INT_PLAIN;
+        info.width = 8;
+        chunk.reserve(plainSize);
+        for (const auto& row : rows) {
+            put64(chunk, intField(row, column));
+        }
+    }
+}
+
+string_view StringColumn::operator[](size_t row) const {
+    size_t index = indexes_ ? static_cast<size_t>(loadUnsigned(indexes_ + row * indexWidth_, indexWidth_)) : row;
+    uint32_t begin = load32(offsets_ + index * sizeof(uint32_t));
+    uint32_t end = load32(offsets_ + (index + 1) * sizeof(uint32_t));
+    return string_view(bytes_ + begin, end - begin);
+}
+
+int64_t IntColumn::operator[](size_t row) const {
+    if (!values_) {
+        return decoded_[row];
+    }
+    if (width_ == 8) {
+        return load64(values_ + row * 8);
+    }
+    return static_cast<int64_t>(static_cast<uint64_t>(base_) + loadUnsigned(values_ + row * width_, width_));
+}
+
+bool BookTable::isIntColumn(BookColumn column) {
+    return column == BookColumn::Price || column == BookColumn::StarRating || column == BookColumn::StockCount;
+}
+
+void BookTable::write(const string& path, const BookStore& books) {
+    string temp = path + ".tmp";
+    ofstream file(temp, ios::binary | ios::trunc);
+    if (!file.is_open()) {
+        throw runtime_error("Cannot create book table: " + temp);
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.columnCount = COLUMN_COUNT;
+    header.rowGroupSize = ROW_GROUP_ROWS;
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    uint64_t offset = sizeof(header);
+    uint64_t rowCount = 0;
+    vector<RowGroupInfo> groups;
+
+    // Chunks start 8-byte aligned
+    auto pad = [&]() {
+        static const char zeros[8] = {};
+        size_t padding = (8 - offset % 8) % 8;
+        file.write(zeros, static_cast<streamsize>(padding));
+        offset += padding;
+    };
+
+    // Up to one row group per core is held and encoded at the same time
+    size_t batch = max<size_t>(1, thread::hardware_concurrency());
+    vector<vector<BookData>> pending(1);
+
+    auto flush = [&]() {
+        if (pending.back().empty()) {
+            pending.pop_back();
+        }
+
+        vector<string> chunks(pending.size() * COLUMN_COUNT);
+        vector<RowGroupInfo> infos(pending.size());
+        memset(infos.data(), 0, infos.size() * sizeof(RowGroupInfo));
+
+        parallel_for(blocked_range<size_t>(0, chunks.size(), 1),
+            [&](const blocked_range<size_t>& r) {
+                for (size_t i = r.begin(); i != r.end(); ++i) {
+                    size_t group = i / COLUMN_COUNT;
+                    BookColumn column = static_cast<BookColumn>(i % COLUMN_COUNT);
+                    ChunkInfo& info = infos[group].chunks[i % COLUMN_COUNT];
+                    if (isIntColumn(column)) {
+                        encodeInts(pending[group], column, chunks[i], info);
+                    }
+                    else {
+                        encodeStrings(pending[group], column, chunks[i], info);
+                    }
+                }
+            }
+        );
+
+        for (size_t group = 0; group < pending.size(); ++group) {
+            infos[group].firstRow = rowCount;
+            infos[group].rows = pending[group].size();
+            rowCount += pending[group].size();
+
+            for (int c = 0; c < COLUMN_COUNT; ++c) {
+                pad();
+                const string& chunk = chunks[group * COLUMN_COUNT + c];
+                infos[group].chunks[c].offset = offset;
+                infos[group].chunks[c].size = chunk.size();
+                file.write(chunk.data(), static_cast<streamsize>(chunk.size()));
+                offset += chunk.size();
+            }
+            groups.push_back(infos[group]);
+        }
+
+        pending.assign(1, vector<BookData>());
+    };
+
+    books.forEachSegment([&](const BookSegment& segment) {
+        for (const auto& book : segment) {
+            pending.back().push_back(book);
+            if (pending.back().size() == ROW_GROUP_ROWS) {
+                if (pending.size() == batch) {
+                    flush();
+                }
+                else {
+                    pending.emplace_back();
+                }
+            }
+        }
+    });
+    flush();
+
+    pad();
+    Trailer trailer;
+    memset(&trailer, 0, sizeof(trailer));
+    trailer.footerOffset = offset;
+    trailer.rowGroupCount = groups.size();
+    memcpy(trailer.magic, MAGIC, sizeof(MAGIC));
+
+    file.write(reinterpret_cast<const char*>(groups.data()), static_cast<streamsize>(groups.size() * sizeof(RowGroupInfo)));
+    file.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+    file.close();
+    if (!file) {
+        throw runtime_error("Cannot write book table: " + temp);
+    }
+    fs::rename(temp, path);
+}
+
+BookTable::BookTable(const string& path) : file_(path) {
+    Header header;
+    Trailer trailer;
+    if (file_.size() < sizeof(Header) + sizeof(Trailer)) {
+        throw runtime_error("Not a valid book table: " + path);
+    }
+    memcpy(&header, file_.data(), sizeof(header));
+    memcpy(&trailer, file_.data() + file_.size() - sizeof(trailer), sizeof(trailer));
+
+    uint64_t footerEnd = file_.size() - sizeof(Trailer);
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || memcmp(trailer.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != VERSION || header.columnCount != COLUMN_COUNT ||
+        trailer.footerOffset > footerEnd ||
+        (footerEnd - trailer.footerOffset) / sizeof(RowGroupInfo) != trailer.rowGroupCount) {
+        throw runtime_error("Not a valid book table: " + path);
+    }
+
+    rowGroups_.resize(trailer.rowGroupCount);
+    memcpy(rowGroups_.data(), file_.data() + trailer.footerOffset, rowGroups_.size() * sizeof(RowGroupInfo));
+
+    // Row counts bound every rows * width product later on, chunks have to
+    // lie between the header and the footer
+    for (const auto& group : rowGroups_) {
+        if (group.firstRow != rowCount_ || group.rows > ROW_GROUP_ROWS) {
+            throw runtime_error("Corrupt row group in book table: " + path);
+        }
+        for (const auto& chunk : group.chunks) {
+            if (chunk.offset < sizeof(Header) || chunk.offset > trailer.footerOffset ||
+                chunk.size > trailer.footerOffset - chunk.offset) {
+                throw runtime_error("Corrupt row group in book table: " + path);
+            }
+        }
+        rowCount_ += group.rows;
+    }
+}
+
+const char* BookTable::chunkData(size_t group, BookColumn column) const {
+    return file_.data() + rowGroups_[group].chunks[static_cast<int>(column)].offset;
+}
+
+StringColumn BookTable::strings(size_t group, BookColumn column) const {
+    const ChunkInfo& info = rowGroups_[group].chunks[static_cast<int>(column)];
+    const char* data = chunkData(group, column);
+    StringColumn values;
+    values.rows_ = rowGroups_[group].rows;
+
+    size_t count = values.rows_;
+    size_t header = 0;
+    if (info.encoding == STRING_DICTIONARY) {
+        bool validWidth = info.width == 1 || info.width == 2 || info.width == 4 || info.width == 8;
+        if (info.size < sizeof(uint32_t) || !validWidth) {
+            throw runtime_error("Corrupt column chunk in book table: " + path());
+        }
+        count = load32(data);
+        header = sizeof(uint32_t);
+    }
+    else if (info.encoding != STRING_PLAIN) {
+        throw runtime_error("Not a string column in book table: " + path());
+    }
+
+    size_t offsetsSize = (count + 1) * sizeof(uint32_t);
+    if (header + offsetsSize > info.size) {
+        throw runtime_error("Corrupt column chunk in book table: " + path());
+    }
+    values.offsets_ = data + header;
+    values.bytes_ = values.offsets_ + offsetsSize;
+
+    size_t bytes = load32(values.offsets_ + count * sizeof(uint32_t));
+    size_t used = header + offsetsSize + bytes;
+    if (info.encoding == STRING_DICTIONARY) {
+        values.indexes_ = values.bytes_ + bytes;
+        values.indexWidth_ = info.width;
+        used += values.rows_ * info.width;
+    }
+    if (used > info.size) {
+        throw runtime_error("Corrupt column chunk in book table: " + path());
+    }
+
+    // operator[] doesn't check, so every value has to lie inside the chunk:
+    // offsets never go down (the last one is bytes), indexes stay below count
+    uint32_t previous = 0;
+    for (size_t i = 0; i <= count; ++i) {
+        uint32_t offset = load32(values.offsets_ + i * sizeof(uint32_t));
+        if (offset < previous) {
+            throw runtime_error("Corrupt column chunk in book table: " + path());
+        }
+        previous = offset;
+    }
+    if (values.indexes_) {
+        uint64_t maxIndex = 0;
+        for (size_t row = 0; row < values.rows_; ++row) {
+            maxIndex = max(maxIndex, loadUnsigned(values.indexes_ + row * values.indexWidth_, values.indexWidth_));
+        }
+        if (values.rows_ > 0 && maxIndex >= count) {
+            throw runtime_error("Corrupt column chunk in book table: " + path());
+        }
+    }
+    return values;
+}
+
+IntColumn BookTable::ints(size_t group, BookColumn column) const {
+    const ChunkInfo& info = rowGroups_[group].chunks[static_cast<int>(column)];
+    const char* data = chunkData(group, column);
+    IntColumn values;
+    values.rows_ = rowGroups_[group].rows;
+
+    if (info.encoding == INT_DELTA) {
+        values.decoded_.reserve(values.rows_);
+        const char* end = data + info.size;
+        int64_t value = 0;
+        for (size_t i = 0; i < values.rows_; ++i) {
+            value += unzigzag(getVarint(data, end));
+            values.decoded_.push_back(value);
+        }
+        return values;
+    }
+
+    if (info.encoding == INT_FRAME) {
+        if (info.size < sizeof(int64_t) || (info.width != 1 && info.width != 2 && info.width != 4)) {
+            throw runtime_error("Corrupt column chunk in book table: " + path());
+        }
+        values.base_ = load64(data);
+        values.values_ = data + sizeof(int64_t);
+        values.width_ = info.width;
+    }
+    else if (info.encoding == INT_PLAIN) {
+        values.values_ = data;
+        values.width_ = 8;
+    }
+    else {
+        throw runtime_error("Not an integer column in book table: " + path());
+    }
+
+    if (values.values_ - data + values.rows_ * values.width_ > info.size) {
+        throw runtime_error("Corrupt column chunk in book table: " + path());
+    }
+    return values;
+}
+
+vector<size_t> BookTable::rowGroupsInRange(BookColumn column, int64_t low, int64_t high) const {
+    vector<size_t> groups;
+    for (size_t i = 0; i < rowGroups_.size(); ++i) {
+        const ChunkInfo& info = rowGroups_[i].chunks[static_cast<int>(column)];
+        if (info.max >= low && info.min <= high) {
+            groups.push_back(i);
+        }
+    }
+    return groups;
+}
+
+void BookTable::decodeRowGroup(size_t group, BookData* books) const {
+    size_t rows = rowGroups_[group].rows;
+
+    for (int c = 0; c < COLUMN_COUNT; ++c) {
+        BookColumn column = static_cast<BookColumn>(c);
+        if (isIntColumn(column)) {
+            IntColumn values = ints(group, column);
+            for (size_t i = 0; i < rows; ++i) {
+                setIntField(books[i], column, values[i]);
+            }
+        }
+        else {
+            StringColumn values = strings(group, column);
+            for (size_t i = 0; i < rows; ++i) {
+                stringField(books[i], column).assign(values[i]);
+            }
+        }
+    }
+}
+
+void BookTable::readRowGroup(size_t group, vector<BookData>& books) const {
+    size_t first = books.size();
+    books.resize(first + rowGroups_[group].rows);
+    decodeRowGroup(group, books.data() + first);
+}
+
+vector<BookData> BookTable::readAll() const {
+    vector<BookData> books(rowCount_);
+
+    parallel_for(blocked_range<size_t>(0, rowGroups_.size(), 1),
+        [&](const blocked_range<size_t>& r) {
+            for (size_t group = r.begin(); group != r.end(); ++group) {
+                decodeRowGroup(group, books.data() + rowGroups_[group].firstRow);
+            }
+        }
+    );
+    return books;
+}
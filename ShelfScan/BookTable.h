@@ -0,0 +1,121 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "BookData.h"
+#include "BookStore.h"
+#include "MappedFile.h"
+
+using namespace std;
+
+enum class BookColumn { Title, Price, StarRating, Availability, ImageUrl, ImageHash,
+    DetailUrl, Upc, StockCount, Category, Description };
+
+// Values of one string column in one row group, pointing into the mapping
+class StringColumn {
+public:
+    size_t size() const { return rows_; }
+    string_view operator[](size_t row) const;
+
+private:
+    friend class BookTable;
+
+    size_t rows_ = 0;
+    const char* offsets_ = nullptr;     // uint32 per value plus one, plain or of the dictionary
+    const char* bytes_ = nullptr;
+    const char* indexes_ = nullptr;     // dictionary encoded only
+    int indexWidth_ = 0;
+};
+
+// Values of one integer column in one row group. Plain and frame of reference
+// chunks are read from the mapping, delta chunks are decoded once.
+class IntColumn {
+public:
+    size_t size() const { return rows_; }
+    int64_t operator[](size_t row) const;
+
+private:
+    friend class BookTable;
+
+    size_t rows_ = 0;
+    const char* values_ = nullptr;
+    int width_ = 8;
+    int64_t base_ = 0;
+    vector<int64_t> decoded_;
+};
+
+// Books stored column by column in row groups of ROW_GROUP_ROWS. Every column
+// chunk picks the smallest of its encodings: strings are plain or dictionary
+// encoded, integers plain, frame of reference (base plus 1, 2 or 4 byte
+// offsets) or zigzag delta varints. The footer has each chunk's place and
+// encoding and, for integer columns, its min and max, so readers can skip row
+// groups. Reading memory-maps the file; string values are views into it.
+class BookTable {
+public:
+    static const size_t ROW_GROUP_ROWS = 16384;
+    static const int COLUMN_COUNT = 11;
+
+    struct ChunkInfo {
+        uint64_t offset;
+        uint64_t size;
+        int64_t min;            // integer columns only
+        int64_t max;
+        uint8_t encoding;
+        uint8_t width;
+        uint8_t padding[6];
+    };
+
+    struct RowGroupInfo {
+        uint64_t firstRow;
+        uint64_t rows;
+        ChunkInfo chunks[COLUMN_COUNT];
+    };
+
+    // Row groups are encoded in parallel, a few at a time, and written in order
+    // (through a temp file and a rename)
+    static void write(const string& path, const BookStore& books);
+
+    explicit BookTable(const string& path);
+
+    const string& path() const { return file_.path(); }
+    uint64_t rowCount() const { return rowCount_; }
+    size_t rowGroupCount() const { return rowGroups_.size(); }
+    const RowGroupInfo& rowGroup(size_t group) const { return rowGroups_[group]; }
+
+    StringColumn strings(size_t group, BookColumn column) const;
+    IntColumn ints(size_t group, BookColumn column) const;
+
+    // Row groups that may hold values in [low, high] of an integer column
+    vector<size_t> rowGroupsInRange(BookColumn column, int64_t low, int64_t high) const;
+
+    void readRowGroup(size_t group, vector<BookData>& books) const;
+    // All row groups, decoded in parallel
+    vector<BookData> readAll() const;
+
+    static bool isIntColumn(BookColumn column);
+
+private:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t columnCount;
+        uint32_t rowGroupSize;
+    };
+
+    struct Trailer {
+        uint64_t footerOffset;
+        uint64_t rowGroupCount;
+        char magic[4];
+        uint32_t reserved;
+    };
+
+    static const uint32_t VERSION = 1;
+
+    MappedFile file_;
+    uint64_t rowCount_ = 0;
+    vector<RowGroupInfo> rowGroups_;
+
+    const char* chunkData(size_t group, BookColumn column) const;
+    void decodeRowGroup(size_t group, BookData* books) const;
+};
@@ -0,0 +1,78 @@
+#include "CircuitBreaker.h"
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+using namespace std::chrono;
+
+bool CircuitBreaker::allow(const string& host) {
+    lock_guard<mutex> lock(mutex_);
+    Host& state = hosts_[host];
+
+    if (state.state == State::Closed) {
+        return true;
+    }
+    if (state.state == State::Open && steady_clock::now() >= state.reopenAt) {
+        state.state = State::HalfOpen;
+        cout << "Circuit breaker for " << host << " half-open, sending a probe" << endl;
+        return true;
+    }
+
+    rejected_++;
+    return false;
+}
+
+void CircuitBreaker::recordSuccess(const string& host) {
+    lock_guard<mutex> lock(mutex_);
+    Host& state = hosts_[host];
+
+    if (state.state != State::Closed) {
+        cout << "Circuit breaker for " << host << " closed" << endl;
+    }
+    state = Host();
+}
+
+void CircuitBreaker::recordFailure(const string& host) {
+    lock_guard<mutex> lock(mutex_);
+    Host& state = hosts_[host];
+
+    if (state.state == State::HalfOpen) {
+        state.openMs = min(state.openMs * 2, static_cast<int>(MAX_OPEN_MS));
+    }
+    else if (state.state == State::Closed && ++state.failures < FAILURE_THRESHOLD) {
+        return;
+    }
+    else if (state.state == State::Open) {
+        // Requests sent before the breaker opened, it's open already
+        return;
+    }
+
+    state.state = State::Open;
+    state.reopenAt = steady_clock::now() + milliseconds(state.openMs);
+    trips_++;
+    cout << "Circuit breaker for " << host << " open for " << state.openMs << " ms" << endl;
+}
+
+void CircuitBreaker::recordAborted(const string& host) {
+    lock_guard<mutex> lock(mutex_);
+    Host& state = hosts_[host];
+
+    if (state.state == State::HalfOpen) {
+        state.state = State::Open;
+    }
+}
+
+void CircuitBreaker::clear() {
+    lock_guard<mutex> lock(mutex_);
+    hosts_.clear();
+    trips_ = 0;
+    rejected_ = 0;
+}
+
+string CircuitBreaker::hostOf(const string& url) {
+    size_t start = url.find("://");
+    start = start == string::npos ? 0 : start + 3;
+
+    size_t end = url.find_first_of("/?#", start);
+    return url.substr(start, end == string::npos ? string::npos : end - start);
+}
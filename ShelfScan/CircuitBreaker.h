@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using namespace std;
+
+// One breaker per host. FAILURE_THRESHOLD failures in a row open it, and
+// requests to the host are refused without being sent. After the open time
+// one probe request is let through (half-open): success closes the breaker,
+// failure opens it again for twice as long, up to MAX_OPEN_MS.
+// 4xx answers count as success, the host is up.
+class CircuitBreaker {
+public:
+    static const int FAILURE_THRESHOLD = 5;
+    static const int OPEN_MS = 2000;
+    static const int MAX_OPEN_MS = 60000;
+
+    // False while the breaker is open, or half-open with the probe still out.
+    // A true result must be followed by one of the record calls.
+    bool allow(const string& host);
+    void recordSuccess(const string& host);
+    void recordFailure(const string& host);
+    // The request neither succeeded nor failed (cancelled), a probe may go again
+    void recordAborted(const string& host);
+
+    int trips() const { return trips_; }
+    int rejected() const { return rejected_; }
+    void clear();
+
+    // "http://host:port/path" -> "host:port"
+    static string hostOf(const string& url);
+
+private:
+    enum class State { Closed, Open, HalfOpen };
+
+    struct Host {
+        State state = State::Closed;
+        int failures = 0;
+        int openMs = OPEN_MS;
+        chrono::steady_clock::time_point reopenAt;
+    };
+
+    mutex mutex_;
+    unordered_map<string, Host> hosts_;
+    atomic<int> trips_{ 0 };
+    atomic<int> rejected_{ 0 };
+};
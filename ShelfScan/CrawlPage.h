@@ -0,0 +1,27 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "BookData.h"
+#include "PageCache.h"
+
+using namespace std;
+
+// Page moving through the crawl graph, every node fills in its part and
+// passes the same object on
+struct CrawlPage {
+    string url;
+    bool linksOnly = false;     // used for discovery only (index.html duplicates page 1)
+
+    // Filled by fetch
+    string html;
+    size_t bufferBytes = 0;     // reserved in the memory budget until parsed
+    bool unchanged = false;
+    PageCacheEntry cached;
+
+    // Filled by parse
+    bool parsed = false;        // false if the page was skipped or failed
+    vector<BookData> books;
+};
+
+typedef shared_ptr<CrawlPage> CrawlPageRef;
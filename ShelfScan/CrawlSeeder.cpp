@@ -0,0 +1,116 @@
+#include "CrawlSeeder.h"
+#include "SitemapReader.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <unordered_set>
+
+using namespace std;
+using namespace chrono;
+
+CrawlSeeder::CrawlSeeder(HttpDownloader& downloader, HtmlParser& parser)
+    : downloader_(downloader), parser_(parser) {
+}
+
+void CrawlSeeder::setSitemap(const string& url) {
+    sitemapUrl_ = url;
+}
+
+vector<string> CrawlSeeder::seed(const string& startUrl) {
+    auto start = steady_clock::now();
+
+    vector<string> urls = fromSitemap(startUrl);
+    const char* source = "sitemap";
+    if (urls.empty()) {
+        urls = fromPageCount(startUrl);
+        source = "page count";
+    }
+
+    if (!urls.empty()) {
+        auto duration = duration_cast<milliseconds>(steady_clock::now() - start);
+        cout << "Seeded " << urls.size() << " listing pages from the " << source
+            << " in " << duration.count() << " ms" << endl;
+    }
+    return urls;
+}
+
+// Listing pages are the paginated ones (".../page-<N>.html"), product pages
+// are reached from them and may have "page-" anywhere in their slug
+bool CrawlSeeder::isListingUrl(const string& url) {
+    string path = url.substr(0, url.find_first_of("?#"));
+    size_t name = path.rfind('/') + 1;    // 0 without a slash
+
+    const string prefix = "page-";
+    const string suffix = ".html";
+    if (path.size() < name + prefix.size() + suffix.size() + 1 ||
+        path.compare(name, prefix.size(), prefix) != 0 ||
+        path.compare(path.size() - suffix.size(), suffix.size(), suffix) != 0) {
+        return false;
+    }
+
+    size_t digits = name + prefix.size();
+    size_t digitsEnd = path.size() - suffix.size();
+    return path.find_first_not_of("0123456789", digits) == digitsEnd;
+}
+
+vector<string> CrawlSeeder::fromSitemap(const string& startUrl) {
+    string url = sitemapUrl_.empty() ? HtmlParser::resolveUrl(startUrl, "/sitemap.xml") : sitemapUrl_;
+
+    vector<string> urls;
+    try {
+        SitemapReader reader(downloader_);
+        urls = reader.read(url);
+    }
+    catch (const exception& e) {
+        cout << "No sitemap at " << url << " (" << e.what() << ")" << endl;
+        return urls;
+    }
+
+    // Keeps the sitemap's order, the crawl caps pages in arrival order
+    unordered_set<string> seen;
+    urls.erase(remove_if(urls.begin(), urls.end(), [&seen](const string& u) {
+        return !isListingUrl(u) || !seen.insert(u).second;
+    }), urls.end());
+
+    if (urls.empty()) {
+        cout << "Sitemap " << url << " lists no listing pages" << endl;
+    }
+    return urls;
+}
+
+// On page 1 of N with a next link ".../page-2.html", pages 1..N are the same
+// link with the number replaced
+vector<string> CrawlSeeder::fromPageCount(const string& startUrl) {
+    vector<string> urls;
+
+    PaginationInfo info;
+    try {
+        info = parser_.parsePagination(downloader_.downloadWithRetry(startUrl));
+    }
+    catch (const exception& e) {
+        cerr << "Seeding failed for " << startUrl << ": " << e.what() << endl;
+        return urls;
+    }
+
+    if (info.total < 2 || info.nextLink.empty()) {
+        return urls;
+    }
+
+    string next = HtmlParser::resolveUrl(startUrl, info.nextLink);
+    size_t number = next.rfind("page-");
+    if (number == string::npos) {
+        return urls;
+    }
+    number += 5;
+    size_t numberEnd = next.find_first_not_of("0123456789", number);
+    if (numberEnd == number || next.substr(number, numberEnd - number) != to_string(info.current + 1)) {
+        return urls;
+    }
+
+    string prefix = next.substr(0, number);
+    string suffix = numberEnd == string::npos ? "" : next.substr(numberEnd);
+    for (int page = 1; page <= info.total; ++page) {
+        urls.push_back(prefix + to_string(page) + suffix);
+    }
+    return urls;
+}
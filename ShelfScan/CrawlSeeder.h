@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "HttpDownloader.h"
+#include "HtmlParser.h"
+
+using namespace std;
+
+// Finds all listing pages before the crawl starts, so they can be fetched at
+// full concurrency instead of being discovered one pagination link at a time:
+//   1. the site's sitemap (<origin>/sitemap.xml unless set), listing pages only
+//   2. "Page 1 of N" on the start page, expanded along its next-page link
+// Returns no URLs when neither works, the crawl then follows links as before.
+class CrawlSeeder {
+public:
+    CrawlSeeder(HttpDownloader& downloader, HtmlParser& parser);
+
+    void setSitemap(const string& url);
+    vector<string> seed(const string& startUrl);
+
+    static bool isListingUrl(const string& url);
+
+private:
+    HttpDownloader& downloader_;
+    HtmlParser& parser_;
+    string sitemapUrl_;
+
+    vector<string> fromSitemap(const string& startUrl);
+    vector<string> fromPageCount(const string& startUrl);
+};
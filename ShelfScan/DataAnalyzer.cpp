@@ -1,9 +1,17 @@
 #include "DataAnalyzer.h"
+#include "PriceKernels.h"
+#include "TextKernels.h"
 #include <tbb/parallel_reduce.h>
 #include <tbb/blocked_range.h>
 #include <tbb/parallel_for_each.h>
 #include <tbb/concurrent_unordered_map.h>
 #include <tbb/concurrent_vector.h>
+#include <tbb/parallel_for.h>
+#include <tbb/combinable.h>
+#include <unordered_map>
+#include <atomic>
+#include <climits>
+#include <cstdint>
 #include <algorithm>
 #include <numeric>
 
@@ -13,19 +21,76 @@ using namespace tbb;
 AnalysisResults DataAnalyzer::analyzeData(const concurrent_vector<BookData>& books) {
     AnalysisResults results;
 
+    // Price aggregates run on a flat column of minor units
+    vector<int64_t> prices = extractPriceColumn(books);
+
+    results.bookCount = static_cast<int>(books.size());
     results.fiveStarBooks = countFiveStarBooks(books);
-    results.averagePrice = calculateAveragePrice(books);
-    results.mostExpensiveBook = findMostExpensiveBook(books);
-    results.cheapestBook = findCheapestBook(books);
+    results.mostExpensiveBook = findMostExpensiveBook(books, prices);
+    results.cheapestBook = findCheapestBook(books, prices);
     results.availabilityStats = analyzeAvailability(books);
-    results.totalValue = calculateTotalValue(books);
+    results.totalValueMinor = calculateTotalValue(prices);
     results.booksInStock = countBooksInStock(books);
-    results.averageRating = calculateAverageRating(books);
+    results.ratingSum = sumRatings(books);
     results.ratingDistribution = analyzeRatingDistribution(books);
+    results.priceDistributions = analyzePriceDistributions(books);
+
+    finalizeAverages(results);
 
     return results;
 }
 
+// Combines analysis of two disjoint sets of books
+AnalysisResults DataAnalyzer::mergeResults(const AnalysisResults& a, const AnalysisResults& b) {
+    AnalysisResults merged;
+
+    merged.bookCount = a.bookCount + b.bookCount;
+    merged.fiveStarBooks = a.fiveStarBooks + b.fiveStarBooks;
+    merged.totalValueMinor = a.totalValueMinor + b.totalValueMinor;
+    merged.booksInStock = a.booksInStock + b.booksInStock;
+    merged.ratingSum = a.ratingSum + b.ratingSum;
+
+    merged.mostExpensiveBook = a.mostExpensiveBook.priceMinor >= b.mostExpensiveBook.priceMinor
+        ? a.mostExpensiveBook : b.mostExpensiveBook;
+
+    // Price 0 means "no book" (or unparsable price), same rule as findCheapestBook
+    if (b.cheapestBook.priceMinor <= 0 ||
+        (a.cheapestBook.priceMinor > 0 && a.cheapestBook.priceMinor <= b.cheapestBook.priceMinor)) {
+        merged.cheapestBook = a.cheapestBook;
+    }
+    else {
+        merged.cheapestBook = b.cheapestBook;
+    }
+
+    merged.availabilityStats = a.availabilityStats;
+    for (const auto& pair : b.availabilityStats) {
+        merged.availabilityStats[pair.first] += pair.second;
+    }
+
+    merged.ratingDistribution = a.ratingDistribution;
+    for (const auto& pair : b.ratingDistribution) {
+        merged.ratingDistribution[pair.first] += pair.second;
+    }
+
+    merged.priceDistributions = a.priceDistributions;
+    merged.priceDistributions.merge(b.priceDistributions);
+
+    finalizeAverages(merged);
+
+    return merged;
+}
+
+void DataAnalyzer::finalizeAverages(AnalysisResults& results) {
+    if (results.bookCount == 0) {
+        results.averagePrice = 0;
+        results.averageRating = 0;
+        return;
+    }
+
+    results.averagePrice = static_cast<double>(results.totalValueMinor) / results.bookCount / 100.0;
+    results.averageRating = static_cast<float>(results.ratingSum) / results.bookCount;
+}
+
 int DataAnalyzer::countFiveStarBooks(const concurrent_vector<BookData>& books) {
     return parallel_reduce(blocked_range<size_t>(0, books.size()), 0,
         [&](const blocked_range<size_t>& r, int count) {
@@ -40,67 +105,61 @@ int DataAnalyzer::countFiveStarBooks(const concurrent_vector<BookData>& books) {
     );
 }
 
-float DataAnalyzer::calculateAveragePrice(const concurrent_vector<BookData>& books) {
-    if (books.empty()) {
-        return 0;
-    }
+vector<int64_t> DataAnalyzer::extractPriceColumn(const concurrent_vector<BookData>& books) {
+    vector<int64_t> prices(books.size());
 
-    float total_price = parallel_reduce(blocked_range<size_t>(0, books.size()), 0,
-        [&](const blocked_range<size_t>& r, float sum) {
+    parallel_for(blocked_range<size_t>(0, books.size()),
+        [&](const blocked_range<size_t>& r) {
             for (size_t i = r.begin(); i != r.end(); ++i) {
-                sum += books[i].price;
+                prices[i] = books[i].priceMinor;
             }
-            return sum;
-        },
-        plus<float>()
+        }
     );
-
-    return total_price / books.size();
+    return prices;
 }
 
-BookData DataAnalyzer::findMostExpensiveBook(const concurrent_vector<BookData>& books) {
+// The first book with the highest price, so ties resolve the same way every run
+BookData DataAnalyzer::findMostExpensiveBook(const concurrent_vector<BookData>& books, const vector<int64_t>& prices) {
     if (books.empty()) {
         return BookData{};
     }
 
-    return parallel_reduce(blocked_range<size_t>(0, books.size()), books[0],
-        [&](const blocked_range<size_t>& r, BookData maxBook) {
-            for (size_t i = r.begin(); i != r.end(); ++i) {
-                if (books[i].price > maxBook.price) {
-                    maxBook = books[i];
-                }
-            }
-            return maxBook;
+    int64_t highest = parallel_reduce(blocked_range<size_t>(0, prices.size()), LLONG_MIN,
+        [&](const blocked_range<size_t>& r, int64_t best) {
+            return max(best, PriceKernels::maxPrice(prices.data() + r.begin(), r.size()));
         },
-        [](const BookData& a, const BookData& b) {
-            if (a.price >= b.price) {
-                return a;
-            }
-            return b;
-        }
+        [](int64_t a, int64_t b) { return max(a, b); }
     );
+
+    return books[findFirstPrice(prices, highest)];
 }
 
-BookData DataAnalyzer::findCheapestBook(const concurrent_vector<BookData>& books) {
+// Books without a price (0) are skipped, if none has a price the first book is returned
+BookData DataAnalyzer::findCheapestBook(const concurrent_vector<BookData>& books, const vector<int64_t>& prices) {
     if (books.empty()) {
         return BookData{};
     }
 
-    return parallel_reduce(blocked_range<size_t>(0, books.size()), books[0],
-        [&](const blocked_range<size_t>& r, BookData minBook) {
-            for (size_t i = r.begin(); i != r.end(); ++i) {
-                if (books[i].price < minBook.price && books[i].price > 0) {
-                    minBook = books[i];
-                }
-            }
-            return minBook;
+    int64_t lowest = parallel_reduce(blocked_range<size_t>(0, prices.size()), LLONG_MAX,
+        [&](const blocked_range<size_t>& r, int64_t best) {
+            return min(best, PriceKernels::minPositivePrice(prices.data() + r.begin(), r.size()));
         },
-        [](const BookData& a, const BookData& b) {
-            if (a.price <= b.price && a.price > 0) {
-                return a;
-            }
-            return b;
-        }
+        [](int64_t a, int64_t b) { return min(a, b); }
+    );
+
+    if (lowest == LLONG_MAX) {
+        return books[0];
+    }
+    return books[findFirstPrice(prices, lowest)];
+}
+
+size_t DataAnalyzer::findFirstPrice(const vector<int64_t>& prices, int64_t price) {
+    return parallel_reduce(blocked_range<size_t>(0, prices.size()), prices.size(),
+        [&](const blocked_range<size_t>& r, size_t first) {
+            size_t found = r.begin() + PriceKernels::findPrice(prices.data() + r.begin(), r.size(), price);
+            return found < r.end() ? min(first, found) : first;
+        },
+        [](size_t a, size_t b) { return min(a, b); }
     );
 }
 
@@ -108,13 +167,7 @@ int DataAnalyzer::countBooksInStock(const concurrent_vector<BookData>& books) {
     return parallel_reduce(blocked_range<size_t>(0, books.size()), 0,
         [&](const blocked_range<size_t>& r, int count) {
             for (size_t i = r.begin(); i != r.end(); ++i) {
-                string avail = books[i].availability;
-
-                for (char& ch : avail) {
-                    ch = static_cast<char>(tolower(static_cast<unsigned char>(ch)));
-                }
-
-                if (avail.find("in stock") != string::npos) {
+                if (TextKernels::containsIgnoreCase(books[i].availability, "in stock")) {
                     count++;
                 }
             }
@@ -143,34 +196,26 @@ map<string, int> DataAnalyzer::analyzeAvailability(const concurrent_vector<BookD
     return result;
 }
 
-float DataAnalyzer::calculateTotalValue(const concurrent_vector<BookData>& books) {
-    return parallel_reduce(blocked_range<size_t>(0, books.size()), 0,
-        [&](const blocked_range<size_t>& r, float sum) {
-            for (size_t i = r.begin(); i != r.end(); ++i) {
-                sum += books[i].price;
-            }
-            return sum;
+// Integer sum, the result is exact and independent of thread scheduling
+int64_t DataAnalyzer::calculateTotalValue(const vector<int64_t>& prices) {
+    return parallel_reduce(blocked_range<size_t>(0, prices.size()), int64_t(0),
+        [&](const blocked_range<size_t>& r, int64_t sum) {
+            return sum + PriceKernels::sumPrices(prices.data() + r.begin(), r.size());
         },
-        plus<float>()
+        plus<int64_t>()
     );
 }
 
-float DataAnalyzer::calculateAverageRating(const concurrent_vector<BookData>& books) {
-    if (books.empty()) {
-        return 0;
-    }
-
-    float total_rating = parallel_reduce(blocked_range<size_t>(0, books.size()), 0,
-        [&](const blocked_range<size_t>& r, float sum) {
+long long DataAnalyzer::sumRatings(const concurrent_vector<BookData>& books) {
+    return parallel_reduce(blocked_range<size_t>(0, books.size()), 0LL,
+        [&](const blocked_range<size_t>& r, long long sum) {
             for (size_t i = r.begin(); i != r.end(); ++i) {
                 sum += books[i].starRating;
             }
             return sum;
         },
-        plus<float>()
+        plus<long long>()
     );
-
-    return total_rating / books.size();
 }
 
 map<int, int> DataAnalyzer::analyzeRatingDistribution(const concurrent_vector<BookData>& books) {
@@ -188,4 +233,196 @@ map<int, int> DataAnalyzer::analyzeRatingDistribution(const concurrent_vector<Bo
     }
 
     return result;
+}
+
+void PriceDistributions::merge(const PriceDistributions& other) {
+    overall.merge(other.overall);
+    for (const auto& pair : other.byRating) {
+        byRating[pair.first].merge(pair.second);
+    }
+    for (const auto& pair : other.byAvailability) {
+        byAvailability[pair.first].merge(pair.second);
+    }
+}
+
+// One pass over the books: every thread fills its own sketches and histograms,
+// which are merged at the end, so memory stays bounded however many books there are
+PriceDistributions DataAnalyzer::analyzePriceDistributions(const concurrent_vector<BookData>& books) {
+    combinable<PriceDistributions> local;
+
+    parallel_for(blocked_range<size_t>(0, books.size()),
+        [&](const blocked_range<size_t>& r) {
+            PriceDistributions& distributions = local.local();
+
+            // Neighbouring books usually share availability text, skip the map lookup then
+            const string* lastAvailability = nullptr;
+            PriceDistribution* availabilityDistribution = nullptr;
+
+            for (size_t i = r.begin(); i != r.end(); ++i) {
+                const BookData& book = books[i];
+                float price = book.priceMinor / 100.0f;
+
+                distributions.overall.add(price);
+                distributions.byRating[book.starRating].add(price);
+
+                if (!lastAvailability || *lastAvailability != book.availability) {
+                    lastAvailability = &book.availability;
+                    availabilityDistribution = &distributions.byAvailability[book.availability];
+                }
+                availabilityDistribution->add(price);
+            }
+        }
+    );
+
+    PriceDistributions result;
+    local.combine_each([&](const PriceDistributions& distributions) {
+        result.merge(distributions);
+    });
+    return result;
+}
+
+// Books are joined by UPC when their product page was read, otherwise by
+// what the listing shows
+string DataAnalyzer::bookKey(const BookData& book) {
+    if (!book.upc.empty()) {
+        return book.upc;
+    }
+    return listingKey(book);
+}
+
+// Listing pages have no stable id, title + cover URL is unique enough
+string DataAnalyzer::listingKey(const BookData& book) {
+    return book.title + "\n" + book.imageUrl;
+}
+
+// Stock counts only count when both runs read the product page
+bool DataAnalyzer::sameListing(const BookData& a, const BookData& b) {
+    return a.priceMinor == b.priceMinor &&
+        a.starRating == b.starRating &&
+        a.availability == b.availability &&
+        (a.stockCount < 0 || b.stockCount < 0 || a.stockCount == b.stockCount);
+}
+
+AnalysisResults DataAnalyzer::analyzeStore(const BookStore& store) {
+    AnalysisResults results;
+    bool first = true;
+
+    store.forEachSegment([&](const BookSegment& segment) {
+        AnalysisResults segmentResults = analyzeData(segment);
+        results = first ? segmentResults : mergeResults(results, segmentResults);
+        first = false;
+    });
+
+    return first ? analyzeData(BookSegment()) : results;
+}
+
+// Previous books are found by their key and, when they have a UPC, by their
+// listing too, so a run that read product pages joins with one that didn't
+// either way round. A book listed twice counts once, at its lowest position.
+CatalogDelta DataAnalyzer::computeDelta(const vector<BookData>& previous, const BookStore& store) {
+    const size_t NONE = SIZE_MAX;
+
+    unordered_map<string, size_t> previousByKey;
+    previousByKey.reserve(previous.size() * 2);
+    for (size_t i = 0; i < previous.size(); ++i) {
+        previousByKey.emplace(bookKey(previous[i]), i);
+    }
+    for (size_t i = 0; i < previous.size(); ++i) {
+        if (!previous[i].upc.empty()) {
+            previousByKey.emplace(listingKey(previous[i]), i);
+        }
+    }
+
+    // Match every listing of this run, books new to this run keep their key
+    vector<size_t> matches(store.size(), NONE);
+    vector<string> newKeys(store.size());
+    size_t base = 0;
+
+    store.forEachSegment([&](const BookSegment& current) {
+        parallel_for(blocked_range<size_t>(0, current.size()),
+            [&](const blocked_range<size_t>& r) {
+                for (size_t i = r.begin(); i != r.end(); ++i) {
+                    const BookData& book = current[i];
+                    auto it = previousByKey.find(bookKey(book));
+                    if (it == previousByKey.end() && !book.upc.empty()) {
+                        it = previousByKey.find(listingKey(book));
+                    }
+
+                    if (it != previousByKey.end()) {
+                        matches[base + i] = it->second;
+                    }
+                    else {
+                        newKeys[base + i] = bookKey(book);
+                    }
+                }
+            }
+        );
+        base += current.size();
+    });
+
+    // Lowest position of each book, the later listings are repeats
+    vector<size_t> firstMatch(previous.size(), NONE);
+    unordered_map<string, size_t> firstNew;
+    for (size_t position = 0; position < matches.size(); ++position) {
+        if (matches[position] == NONE) {
+            firstNew.emplace(newKeys[position], position);
+        }
+        else if (firstMatch[matches[position]] == NONE) {
+            firstMatch[matches[position]] = position;
+        }
+    }
+
+    concurrent_vector<BookData> added;
+    concurrent_vector<BookChange> changed;
+    atomic<int> unchanged{ 0 };
+    base = 0;
+
+    store.forEachSegment([&](const BookSegment& current) {
+        parallel_for(blocked_range<size_t>(0, current.size()),
+            [&](const blocked_range<size_t>& r) {
+                for (size_t i = r.begin(); i != r.end(); ++i) {
+                    const BookData& book = current[i];
+                    size_t position = base + i;
+                    size_t match = matches[position];
+
+                    if (match == NONE) {
+                        if (firstNew.at(newKeys[position]) == position) {
+                            added.push_back(book);
+                        }
+                    }
+                    else if (firstMatch[match] != position) {
+                        continue;
+                    }
+                    else if (!sameListing(previous[match], book)) {
+                        changed.push_back(BookChange{ previous[match], book });
+                    }
+                    else {
+                        unchanged++;
+                    }
+                }
+            }
+        );
+        base += current.size();
+    });
+
+    CatalogDelta delta;
+    delta.added.assign(added.begin(), added.end());
+    delta.changed.assign(changed.begin(), changed.end());
+    delta.unchanged = unchanged.load();
+
+    // Repeats in the previous run are never matched, only their first listing counts
+    for (size_t i = 0; i < previous.size(); ++i) {
+        if (firstMatch[i] == NONE && previousByKey.at(bookKey(previous[i])) == i) {
+            delta.removed.push_back(previous[i]);
+        }
+    }
+
+    // Parallel classification leaves the lists in random order
+    auto byTitle = [](const BookData& a, const BookData& b) { return a.title < b.title; };
+    sort(delta.added.begin(), delta.added.end(), byTitle);
+    sort(delta.removed.begin(), delta.removed.end(), byTitle);
+    sort(delta.changed.begin(), delta.changed.end(),
+        [](const BookChange& a, const BookChange& b) { return a.after.title < b.after.title; });
+
+    return delta;
 }
\ No newline at end of file
@@ -1,35 +1,97 @@
 #pragma once
 #include "BookData.h"
+#include "BookStore.h"
+#include "QuantileSketch.h"
+#include "PriceHistogram.h"
 #include <map>
+#include <string>
+#include <vector>
 #include <tbb/concurrent_vector.h>
 
 using namespace std;
 using namespace tbb;
 
+// Price quantiles and histogram of a group of books
+struct PriceDistribution {
+    QuantileSketch quantiles;
+    PriceHistogram histogram;
+
+    void add(float price) {
+        quantiles.add(price);
+        histogram.add(price);
+    }
+
+    void merge(const PriceDistribution& other) {
+        quantiles.merge(other.quantiles);
+        histogram.merge(other.histogram);
+    }
+};
+
+// Distributions overall, per star rating and per availability text
+struct PriceDistributions {
+    PriceDistribution overall;
+    map<int, PriceDistribution> byRating;
+    map<string, PriceDistribution> byAvailability;
+
+    void merge(const PriceDistributions& other);
+};
+
+// Everything except the averages is a count, sum or extreme, so partial
+// results (e.g. from shard workers) can be merged with mergeResults()
 struct AnalysisResults {
-    int fiveStarBooks;
-    float averagePrice;
+    int bookCount = 0;
+    int fiveStarBooks = 0;
+    double averagePrice = 0;
     BookData mostExpensiveBook;
     map<string, int> availabilityStats;
     BookData cheapestBook;
-    float totalValue;
-    int booksInStock;
-    float averageRating;
+    int64_t totalValueMinor = 0;
+    int booksInStock = 0;
+    long long ratingSum = 0;
+    float averageRating = 0;
     map<int, int> ratingDistribution;
+    PriceDistributions priceDistributions;
+};
+
+struct BookChange {
+    BookData before;
+    BookData after;
+};
+
+// Difference between the books of the previous run and the current one
+struct CatalogDelta {
+    vector<BookData> added;
+    vector<BookData> removed;
+    vector<BookChange> changed;
+    int unchanged = 0;
 };
 
 class DataAnalyzer {
 public:
     AnalysisResults analyzeData(const concurrent_vector<BookData>& books);
+    // Segment by segment, spilled segments are read back one at a time
+    AnalysisResults analyzeStore(const BookStore& store);
+    CatalogDelta computeDelta(const vector<BookData>& previous, const BookStore& current);
+
+    static AnalysisResults mergeResults(const AnalysisResults& a, const AnalysisResults& b);
+    static void finalizeAverages(AnalysisResults& results);
+
+    // Identity of a book across runs: its UPC, or what the listing shows
+    static string bookKey(const BookData& book);
 
 private:
     int countFiveStarBooks(const concurrent_vector<BookData>& books);
-    float calculateAveragePrice(const concurrent_vector<BookData>& books);
-    BookData findMostExpensiveBook(const concurrent_vector<BookData>& books);
-    BookData findCheapestBook(const concurrent_vector<BookData>& books);
+    vector<int64_t> extractPriceColumn(const concurrent_vector<BookData>& books);
+    BookData findMostExpensiveBook(const concurrent_vector<BookData>& books, const vector<int64_t>& prices);
+    BookData findCheapestBook(const concurrent_vector<BookData>& books, const vector<int64_t>& prices);
     map<string, int> analyzeAvailability(const concurrent_vector<BookData>& books);
-    float calculateTotalValue(const concurrent_vector<BookData>& books);
+    int64_t calculateTotalValue(const vector<int64_t>& prices);
+    size_t findFirstPrice(const vector<int64_t>& prices, int64_t price);
     int countBooksInStock(const concurrent_vector<BookData>& books);
-    float calculateAverageRating(const concurrent_vector<BookData>& books);
+    long long sumRatings(const concurrent_vector<BookData>& books);
     map<int, int> analyzeRatingDistribution(const concurrent_vector<BookData>& books);
+    PriceDistributions analyzePriceDistributions(const concurrent_vector<BookData>& books);
+
+    static string listingKey(const BookData& book);
+    static bool sameListing(const BookData& a, const BookData& b);
 };
\ No newline at end of file
@@ -0,0 +1,455 @@
+#include "DuplicateDetector.h"
+#include "BookSorter.h"
+#include <algorithm>
+#include <cctype>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <tbb/blocked_range.h>
+#include <tbb/concurrent_vector.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+
+using namespace std;
+using namespace tbb;
+
+static const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+static const uint64_t FNV_PRIME = 1099511628211ULL;
+static const uint32_t NONE = numeric_limits<uint32_t>::max();
+
+static uint64_t fnv1a(const char* data, size_t length, uint64_t hash = FNV_OFFSET) {
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static uint64_t fnv1a(const string& text, uint64_t hash = FNV_OFFSET) {
+    return fnv1a(text.data(), text.size(), hash);
+}
+
+static uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// h(x) = (a * x + b) >> 32 with fixed odd a, the same on every run and platform
+struct HashFamily {
+    uint64_t a[DuplicateDetector::SIGNATURE_SIZE];
+    uint64_t b[DuplicateDetector::SIGNATURE_SIZE];
+
+    HashFamily() {
+        uint64_t state = 0x5368656C66536361ULL;
+        for (int i = 0; i < DuplicateDetector::SIGNATURE_SIZE; ++i) {
+            a[i] = splitmix64(state) | 1;
+            b[i] = splitmix64(state);
+        }
+    }
+};
+
+static const HashFamily& hashFamily() {
+    static const HashFamily family;
+    return family;
+}
+
+// Disjoint sets of positions, the root is always the lowest position
+class PositionSets {
+public:
+    explicit PositionSets(size_t size) : parent_(size) {
+        for (size_t i = 0; i < size; ++i) {
+            parent_[i] = static_cast<uint32_t>(i);
+        }
+    }
+
+    uint32_t find(uint32_t position) {
+        while (parent_[position] != position) {
+            parent_[position] = parent_[parent_[position]];
+            position = parent_[position];
+        }
+        return position;
+    }
+
+    void unite(uint32_t a, uint32_t b) {
+        a = find(a);
+        b = find(b);
+        if (a != b) {
+            parent_[max(a, b)] = min(a, b);
+        }
+    }
+
+private:
+    vector<uint32_t> parent_;
+};
+
+struct MergedPair {
+    uint32_t a;
+    uint32_t b;
+    float similarity;
+    bool exact;
+};
+
+DuplicateDetector::DuplicateDetector(double threshold) : threshold_(threshold) {
+}
+
+string DuplicateDetector::normalize(const string& text) {
+    string normalized;
+    normalized.reserve(text.size());
+
+    for (char c : text) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (isalnum(u)) {
+            normalized += static_cast<char>(tolower(u));
+        }
+        else if (!normalized.empty() && normalized.back() != ' ') {
+            normalized += ' ';
+        }
+    }
+
+    if (!normalized.empty() && normalized.back() == ' ') {
+        normalized.pop_back();
+    }
+    return normalized;
+}
+
+uint64_t DuplicateDetector::fingerprint(const BookData& book) {
+    string key = normalize(book.title);
+    key += '\0';
+    key += to_string(book.priceMinor);
+    key += '\0';
+    key += to_string(book.starRating);
+    key += '\0';
+    key += normalize(book.category);
+    return fnv1a(key);
+}
+
+// The trigrams and the words of the padded title, so "Volume 15" and
+// "Volume 158" differ by more than one trigram, plus tokens for price, rating
+// and category. The price counts PRICE_WEIGHT times; a listing at another
+// price needs a near identical title to still be a duplicate.
+vector<uint64_t> DuplicateDetector::shingles(const BookData& book) {
+    vector<uint64_t> hashes;
+
+    string title = " " + normalize(book.title) + " ";
+    for (size_t i = 0; i + 3 <= title.size(); ++i) {
+        hashes.push_back(fnv1a(title.data() + i, 3));
+    }
+
+    size_t wordStart = 1;
+    for (size_t i = 1; i < title.size(); ++i) {
+        if (title[i] == ' ') {
+            hashes.push_back(fnv1a(title.data() + wordStart, i - wordStart, fnv1a("word:")));
+            wordStart = i + 1;
+        }
+    }
+
+    uint64_t price = fnv1a(to_string(book.priceMinor), fnv1a("price:"));
+    for (int i = 0; i < PRICE_WEIGHT; ++i) {
+        hashes.push_back(splitmix64(price));
+    }
+    hashes.push_back(fnv1a(to_string(book.starRating), fnv1a("rating:")));
+    if (!book.category.empty()) {
+        hashes.push_back(fnv1a(normalize(book.category), fnv1a("category:")));
+    }
+
+    sort(hashes.begin(), hashes.end());
+    hashes.erase(unique(hashes.begin(), hashes.end()), hashes.end());
+    return hashes;
+}
+
+// Minimum of every hash function over the shingles
+void DuplicateDetector::signature(const vector<uint64_t>& shingles, uint32_t* values) {
+    const HashFamily& family = hashFamily();
+    fill(values, values + SIGNATURE_SIZE, NONE);
+
+    for (uint64_t shingle : shingles) {
+        for (int i = 0; i < SIGNATURE_SIZE; ++i) {
+            uint32_t value = static_cast<uint32_t>((family.a[i] * shingle + family.b[i]) >> 32);
+            values[i] = min(values[i], value);
+        }
+    }
+}
+
+// Jaccard similarity of two sorted shingle sets
+double DuplicateDetector::similarity(const vector<uint64_t>& a, const vector<uint64_t>& b) {
+    size_t shared = 0;
+    size_t i = 0;
+    size_t j = 0;
+    while (i < a.size() && j < b.size()) {
+        if (a[i] < b[j]) {
+            i++;
+        }
+        else if (b[j] < a[i]) {
+            j++;
+        }
+        else {
+            shared++;
+            i++;
+            j++;
+        }
+    }
+
+    size_t all = a.size() + b.size() - shared;
+    return all == 0 ? 1.0 : static_cast<double>(shared) / all;
+}
+
+vector<DuplicateCluster> DuplicateDetector::find(const BookStore& store) {
+    // Pass 1: fingerprint and band hashes of every book
+    struct BookKeys {
+        uint64_t fingerprint;
+        uint32_t bands[BANDS];
+    };
+
+    vector<BookKeys> keys;
+    keys.reserve(store.size());
+
+    store.forEachSegment([&](const BookSegment& books) {
+        size_t base = keys.size();
+        keys.resize(base + books.size());
+
+        parallel_for(blocked_range<size_t>(0, books.size()),
+            [&](const blocked_range<size_t>& r) {
+                uint32_t values[SIGNATURE_SIZE];
+                for (size_t i = r.begin(); i != r.end(); ++i) {
+                    BookKeys& key = keys[base + i];
+                    key.fingerprint = fingerprint(books[i]);
+
+                    signature(shingles(books[i]), values);
+                    for (int band = 0; band < BANDS; ++band) {
+                        key.bands[band] = static_cast<uint32_t>(
+                            fnv1a(reinterpret_cast<const char*>(values + band * ROWS), ROWS * sizeof(uint32_t)));
+                    }
+                }
+            }
+        );
+    });
+
+    size_t count = keys.size();
+    if (count >= NONE) {
+        throw runtime_error("Too many books for duplicate detection: " + to_string(count));
+    }
+
+    PositionSets sets(count);
+    vector<MergedPair> merged;
+
+    // Exact fast path: equal fingerprints are merged without comparing, only
+    // the first book of each group goes on to LSH
+    vector<char> folded(count, 0);
+    {
+        vector<pair<uint64_t, uint32_t>> byFingerprint(count);
+        parallel_for(blocked_range<size_t>(0, count),
+            [&](const blocked_range<size_t>& r) {
+                for (size_t i = r.begin(); i != r.end(); ++i) {
+                    byFingerprint[i] = { keys[i].fingerprint, static_cast<uint32_t>(i) };
+                }
+            }
+        );
+        parallel_sort(byFingerprint.begin(), byFingerprint.end());
+
+        for (size_t i = 0; i < count; ++i) {
+            if (i > 0 && byFingerprint[i].first == byFingerprint[i - 1].first) {
+                uint32_t first = sets.find(byFingerprint[i - 1].second);
+                sets.unite(first, byFingerprint[i].second);
+                merged.push_back({ first, byFingerprint[i].second, 1.0f, true });
+                folded[byFingerprint[i].second] = 1;
+            }
+        }
+    }
+
+    // LSH: books with equal band hashes land in one bucket; within a bucket
+    // every book is paired with the first and with its predecessor, which is
+    // enough to connect a cluster and keeps huge buckets linear
+    vector<uint64_t> candidates;
+    {
+        vector<pair<uint32_t, uint32_t>> buckets;
+        buckets.reserve(count);
+
+        for (int band = 0; band < BANDS; ++band) {
+            buckets.clear();
+            for (size_t i = 0; i < count; ++i) {
+                if (!folded[i]) {
+                    buckets.push_back({ keys[i].bands[band], static_cast<uint32_t>(i) });
+                }
+            }
+            parallel_sort(buckets.begin(), buckets.end());
+
+            size_t start = 0;
+            for (size_t i = 1; i <= buckets.size(); ++i) {
+                if (i < buckets.size() && buckets[i].first == buckets[start].first) {
+                    candidates.push_back((static_cast<uint64_t>(buckets[start].second) << 32) | buckets[i].second);
+                    if (i - 1 > start) {
+                        candidates.push_back((static_cast<uint64_t>(buckets[i - 1].second) << 32) | buckets[i].second);
+                    }
+                    continue;
+                }
+                start = i;
+            }
+        }
+    }
+    keys.clear();
+    keys.shrink_to_fit();
+
+    parallel_sort(candidates.begin(), candidates.end());
+    candidates.erase(unique(candidates.begin(), candidates.end()), candidates.end());
+    candidatePairs_ = candidates.size();
+
+    // Pass 2: shingles of books that have a candidate, every candidate pair is
+    // checked by its exact similarity rather than the signature estimate
+    vector<uint32_t> slotOf(count, NONE);
+    size_t slots = 0;
+    for (uint64_t pair : candidates) {
+        for (uint32_t position : { static_cast<uint32_t>(pair >> 32), static_cast<uint32_t>(pair) }) {
+            if (slotOf[position] == NONE) {
+                slotOf[position] = static_cast<uint32_t>(slots++);
+            }
+        }
+    }
+
+    vector<vector<uint64_t>> candidateShingles(slots);
+    size_t base = 0;
+    store.forEachSegment([&](const BookSegment& books) {
+        parallel_for(blocked_range<size_t>(0, books.size()),
+            [&](const blocked_range<size_t>& r) {
+                for (size_t i = r.begin(); i != r.end(); ++i) {
+                    uint32_t slot = base + i < count ? slotOf[base + i] : NONE;
+                    if (slot != NONE) {
+                        candidateShingles[slot] = shingles(books[i]);
+                    }
+                }
+            }
+        );
+        base += books.size();
+    });
+
+    concurrent_vector<MergedPair> similar;
+    parallel_for(blocked_range<size_t>(0, candidates.size()),
+        [&](const blocked_range<size_t>& r) {
+            for (size_t i = r.begin(); i != r.end(); ++i) {
+                uint32_t a = static_cast<uint32_t>(candidates[i] >> 32);
+                uint32_t b = static_cast<uint32_t>(candidates[i]);
+                double jaccard = similarity(candidateShingles[slotOf[a]], candidateShingles[slotOf[b]]);
+                if (jaccard >= threshold_) {
+                    similar.push_back({ a, b, static_cast<float>(jaccard), false });
+                }
+            }
+        }
+    );
+
+    for (const auto& pair : similar) {
+        sets.unite(pair.a, pair.b);
+        merged.push_back(pair);
+    }
+    candidateShingles.clear();
+    candidateShingles.shrink_to_fit();
+
+    // Clusters in order of their kept book, members ascending
+    vector<DuplicateCluster> clusters;
+    unordered_map<uint32_t, size_t> clusterOf;
+    vector<uint32_t> memberCluster(count, NONE);
+
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t root = sets.find(static_cast<uint32_t>(i));
+        if (root == i) {
+            continue;
+        }
+
+        auto found = clusterOf.find(root);
+        if (found == clusterOf.end()) {
+            found = clusterOf.emplace(root, clusters.size()).first;
+            clusters.emplace_back();
+            clusters.back().positions.push_back(root);
+            memberCluster[root] = static_cast<uint32_t>(found->second);
+        }
+        clusters[found->second].positions.push_back(i);
+        memberCluster[i] = static_cast<uint32_t>(found->second);
+    }
+
+    for (const auto& pair : merged) {
+        DuplicateCluster& cluster = clusters[clusterOf[sets.find(pair.a)]];
+        cluster.similarity = min(cluster.similarity, static_cast<double>(pair.similarity));
+        cluster.exact = cluster.exact && pair.exact;
+    }
+
+    // Pass 3: copies of the clustered books for the report
+    for (auto& cluster : clusters) {
+        cluster.books.resize(cluster.positions.size());
+    }
+
+    base = 0;
+    store.forEachSegment([&](const BookSegment& books) {
+        for (size_t i = 0; i < books.size() && base + i < count; ++i) {
+            uint32_t index = memberCluster[base + i];
+            if (index != NONE) {
+                DuplicateCluster& cluster = clusters[index];
+                size_t slot = lower_bound(cluster.positions.begin(), cluster.positions.end(), base + i) -
+                    cluster.positions.begin();
+                cluster.books[slot] = books[i];
+            }
+        }
+        base += books.size();
+    });
+
+    return clusters;
+}
+
+vector<DuplicateCluster> DuplicateDetector::remove(BookStore& store) {
+    vector<DuplicateCluster> clusters = find(store);
+    store.erase(redundant(clusters));
+    return clusters;
+}
+
+vector<size_t> DuplicateDetector::redundant(const vector<DuplicateCluster>& clusters) {
+    vector<size_t> positions;
+    for (const auto& cluster : clusters) {
+        positions.insert(positions.end(), cluster.positions.begin() + 1, cluster.positions.end());
+    }
+    sort(positions.begin(), positions.end());
+    return positions;
+}
+
+vector<size_t> DuplicateDetector::repeatedUpcs(const BookStore& store) {
+    struct Listing {
+        uint32_t page;      // into pages
+        uint32_t offset;    // on the page
+        size_t position;
+    };
+
+    vector<string> pages;
+    unordered_map<string, Listing> first;
+    vector<size_t> positions;
+    size_t base = 0;
+
+    store.forEachPage([&](const string& url, const vector<BookData>& books) {
+        uint32_t page = static_cast<uint32_t>(pages.size());
+        pages.push_back(url);
+
+        for (size_t i = 0; i < books.size(); ++i) {
+            if (books[i].upc.empty()) {
+                continue;
+            }
+
+            Listing listing{ page, static_cast<uint32_t>(i), base + i };
+            auto found = first.emplace(books[i].upc, listing);
+            if (found.second) {
+                continue;
+            }
+
+            // The later listing in page order is the repeat, whichever was stored first
+            Listing& kept = found.first->second;
+            int order = BookSorter::compareNatural(pages[kept.page], url);
+            if (order > 0 || (order == 0 && kept.offset > listing.offset)) {
+                positions.push_back(kept.position);
+                kept = listing;
+            }
+            else {
+                positions.push_back(listing.position);
+            }
+        }
+        base += books.size();
+    });
+
+    sort(positions.begin(), positions.end());
+    return positions;
+}
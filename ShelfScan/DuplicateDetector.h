@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "BookData.h"
+#include "BookStore.h"
+
+using namespace std;
+
+// Listings of one book, the first in the store is the one kept
+struct DuplicateCluster {
+    vector<size_t> positions;   // in the store, ascending
+    vector<BookData> books;
+    double similarity = 1.0;    // lowest similarity of a merged pair
+    bool exact = true;          // all books have the same fingerprint
+};
+
+// Finds the same book listed on several pages or mirrors. Books whose
+// normalised title, price, rating and category are equal are merged by
+// fingerprint first. The remaining ones get MinHash signatures over their
+// shingles, only books sharing an LSH band become candidates, and candidates
+// are merged when the Jaccard similarity of their shingles reaches the
+// threshold. Memory is about 80 bytes per book plus the shingles of books
+// that have candidates, the store is read three times.
+class DuplicateDetector {
+public:
+    static const int BANDS = 16;
+    static const int ROWS = 8;
+    static const int SIGNATURE_SIZE = BANDS * ROWS;
+    static const int PRICE_WEIGHT = 4;
+    // Pairs at 0.8 share a band with a probability of 95 %, pairs at 0.5 with 6 %
+    static constexpr double DEFAULT_THRESHOLD = 0.8;
+
+    explicit DuplicateDetector(double threshold = DEFAULT_THRESHOLD);
+
+    vector<DuplicateCluster> find(const BookStore& store);
+    // find(), then erases every book but the kept one of each cluster
+    vector<DuplicateCluster> remove(BookStore& store);
+
+    // Pairs whose signatures were compared by the last find()
+    size_t candidatePairs() const { return candidatePairs_; }
+
+    // Positions of every book except the kept one of each cluster, ascending
+    static vector<size_t> redundant(const vector<DuplicateCluster>& clusters);
+    // Positions of books whose UPC is also on an earlier page (pages in natural
+    // URL order, then position on the page), ascending. Same for any store order.
+    static vector<size_t> repeatedUpcs(const BookStore& store);
+
+    // Lower case letters and digits, everything else becomes single spaces
+    static string normalize(const string& text);
+    static uint64_t fingerprint(const BookData& book);
+    // Sorted hashes of the title trigrams, title words and metadata tokens
+    static vector<uint64_t> shingles(const BookData& book);
+    static void signature(const vector<uint64_t>& shingles, uint32_t* values);
+    static double similarity(const vector<uint64_t>& a, const vector<uint64_t>& b);
+
+private:
+    double threshold_;
+    size_t candidatePairs_ = 0;
+};
@@ -0,0 +1,203 @@
+#include "ExtractionSchema.h"
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+// Used when no schema file is given, same rules as the old hard-coded parser
+static const char* DEFAULT_LISTING_SCHEMA =
+    "base  http://books.toscrape.com/\n"
+    "item  article.product_pod\n"
+    "field title         \"h3 a\"          @title|text  string\n"
+    "field price         \".price_color\"  text         price\n"
+    "field starRating    \".star-rating\"  @class       rating\n"
+    "field availability  \".availability\" text         string\n"
+    "field imageUrl      \"img\"           @src         url\n"
+    "field detailUrl     \"h3 a\"          @href        string\n";
+
+// Matches whole class tokens only, so "price" doesn't match "price_color"
+bool CompoundSelector::matches(const GumboNode* node) const {
+    if (node->type != GUMBO_NODE_ELEMENT) {
+        return false;
+    }
+    if (tag != GUMBO_TAG_UNKNOWN && node->v.element.tag != tag) {
+        return false;
+    }
+    if (classes.empty()) {
+        return true;
+    }
+
+    GumboAttribute* classAttr = gumbo_get_attribute(&node->v.element.attributes, "class");
+    if (!classAttr) {
+        return false;
+    }
+
+    for (const auto& wanted : classes) {
+        bool found = false;
+        const char* p = classAttr->value;
+
+        while (*p && !found) {
+            while (*p && isspace(static_cast<unsigned char>(*p))) {
+                p++;
+            }
+            const char* start = p;
+            while (*p && !isspace(static_cast<unsigned char>(*p))) {
+                p++;
+            }
+
+            size_t length = static_cast<size_t>(p - start);
+            found = length == wanted.size() && memcmp(start, wanted.data(), length) == 0;
+        }
+
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+Selector ExtractionSchema::parseSelector(const string& text) {
+    Selector selector;
+    istringstream steps(text);
+    string step;
+
+    while (steps >> step) {
+        CompoundSelector compound;
+
+        size_t dot = step.find('.');
+        string tagName = step.substr(0, dot);
+        if (!tagName.empty()) {
+            compound.tag = gumbo_tag_enum(tagName.c_str());
+            if (compound.tag == GUMBO_TAG_UNKNOWN) {
+                throw runtime_error("Unknown tag in selector: " + tagName);
+            }
+        }
+
+        while (dot != string::npos) {
+            size_t next = step.find('.', dot + 1);
+            string className = step.substr(dot + 1, next == string::npos ? string::npos : next - dot - 1);
+            if (className.empty()) {
+                throw runtime_error("Empty class name in selector: " + step);
+            }
+            compound.classes.push_back(className);
+            dot = next;
+        }
+
+        selector.push_back(compound);
+    }
+
+    if (selector.empty()) {
+        throw runtime_error("Empty selector");
+    }
+    return selector;
+}
+
+BookField ExtractionSchema::parseField(const string& name) {
+    if (name == "title") return BookField::Title;
+    if (name == "price") return BookField::Price;
+    if (name == "starRating") return BookField::StarRating;
+    if (name == "availability") return BookField::Availability;
+    if (name == "imageUrl") return BookField::ImageUrl;
+    if (name == "detailUrl") return BookField::DetailUrl;
+    throw runtime_error("Unknown book field: " + name);
+}
+
+FieldType ExtractionSchema::parseType(const string& name) {
+    if (name == "string") return FieldType::String;
+    if (name == "price") return FieldType::Price;
+    if (name == "rating") return FieldType::Rating;
+    if (name == "url") return FieldType::Url;
+    throw runtime_error("Unknown field type: " + name);
+}
+
+ExtractionSchema ExtractionSchema::parse(const string& text) {
+    ExtractionSchema schema;
+    istringstream lines(text);
+    string line;
+    int lineNumber = 0;
+
+    while (getline(lines, line)) {
+        lineNumber++;
+
+        istringstream tokens(line);
+        string keyword;
+        if (!(tokens >> keyword) || keyword[0] == '#') {
+            continue;
+        }
+
+        try {
+            if (keyword == "base") {
+                tokens >> schema.baseUrl_;
+            }
+            else if (keyword == "item") {
+                string rest;
+                getline(tokens, rest);
+                schema.item_ = parseSelector(rest);
+            }
+            else if (keyword == "field") {
+                string name, selector, source, type;
+                tokens >> name >> quoted(selector) >> source >> type;
+                if (type.empty()) {
+                    throw runtime_error("expected: field <name> \"<selector>\" <source> <type>");
+                }
+
+                FieldRule rule;
+                rule.field = parseField(name);
+                rule.selector = parseSelector(selector);
+                rule.type = parseType(type);
+
+                if (source != "text") {
+                    if (source[0] != '@') {
+                        throw runtime_error("source must be text, @attr or @attr|text");
+                    }
+                    size_t bar = source.find('|');
+                    rule.attribute = source.substr(1, bar == string::npos ? string::npos : bar - 1);
+                    rule.fallbackToText = bar != string::npos && source.substr(bar + 1) == "text";
+                }
+
+                // Numeric fields need their matching parser
+                bool priceField = rule.field == BookField::Price;
+                bool ratingField = rule.field == BookField::StarRating;
+                if (priceField != (rule.type == FieldType::Price) || ratingField != (rule.type == FieldType::Rating)) {
+                    throw runtime_error("type " + type + " doesn't fit field " + name);
+                }
+
+                schema.rules_.push_back(rule);
+            }
+            else {
+                throw runtime_error("unknown keyword " + keyword);
+            }
+        }
+        catch (const exception& e) {
+            throw runtime_error("Schema line " + to_string(lineNumber) + ": " + e.what());
+        }
+    }
+
+    if (schema.item_.empty()) {
+        throw runtime_error("Schema has no item selector");
+    }
+    return schema;
+}
+
+ExtractionSchema ExtractionSchema::load(const string& filename) {
+    ifstream file(filename);
+    if (!file.is_open()) {
+        throw runtime_error("Cannot open schema file: " + filename);
+    }
+
+    ostringstream content;
+    content << file.rdbuf();
+
+    ExtractionSchema schema = parse(content.str());
+    cout << "Loaded extraction schema " << filename << " (" << schema.rules_.size() << " fields)" << endl;
+    return schema;
+}
+
+ExtractionSchema ExtractionSchema::defaultListing() {
+    return parse(DEFAULT_LISTING_SCHEMA);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <gumbo.h>
+
+using namespace std;
+
+// One step of a selector: optional tag plus classes, e.g. "article.product_pod"
+// or ".price_color". Classes match whole tokens of the class attribute.
+struct CompoundSelector {
+    GumboTag tag = GUMBO_TAG_UNKNOWN;   // GUMBO_TAG_UNKNOWN matches any tag
+    vector<string> classes;
+
+    bool matches(const GumboNode* node) const;
+};
+
+// Descendant chain, e.g. "h3 a" = <a> somewhere inside <h3>
+typedef vector<CompoundSelector> Selector;
+
+enum class BookField { Title, Price, StarRating, Availability, ImageUrl, DetailUrl };
+enum class FieldType { String, Price, Rating, Url };
+
+struct FieldRule {
+    BookField field;
+    Selector selector;
+    string attribute;           // empty = text content
+    bool fallbackToText = false;
+    FieldType type;
+};
+
+// Extraction rules for one site, loaded from a schema file:
+//
+//   base  http://books.toscrape.com/
+//   item  article.product_pod
+//   field title  "h3 a"  @title|text  string
+//
+// "field <name> "<selector>" <source> <type>", where source is "text",
+// "@attr" or "@attr|text" (attribute, falling back to text content).
+class ExtractionSchema {
+public:
+    static ExtractionSchema parse(const string& text);
+    static ExtractionSchema load(const string& filename);
+    static ExtractionSchema defaultListing();
+
+    const Selector& itemSelector() const { return item_; }
+    const vector<FieldRule>& rules() const { return rules_; }
+    const string& baseUrl() const { return baseUrl_; }
+
+private:
+    Selector item_;
+    vector<FieldRule> rules_;
+    string baseUrl_;
+
+    static Selector parseSelector(const string& text);
+    static BookField parseField(const string& name);
+    static FieldType parseType(const string& name);
+};
@@ -0,0 +1,179 @@
+#include "FileReader.h"
+#include "PriceKernels.h"
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <cctype>
+#include <cstdlib>
+
+using namespace std;
+
+// Accepts either the base name ("results") or the full file name ("results.json")
+vector<BookData> FileReader::readRawData(const string& filename) {
+    string path = filename;
+    if (path.size() < 5 || path.compare(path.size() - 5, 5, ".json") != 0) {
+        path += ".json";
+    }
+
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) {
+        throw runtime_error("Cannot open file: " + path);
+    }
+
+    vector<BookData> books;
+
+    skipWhitespace(file);
+    if (file.get() != '[') {
+        throw runtime_error("Expected a JSON array in " + path);
+    }
+
+    while (true) {
+        skipWhitespace(file);
+        int next = file.peek();
+
+        if (next == ']' || next == EOF) {
+            break;
+        }
+        if (next == ',') {
+            file.get();
+            continue;
+        }
+
+        BookData book;
+        if (!readBook(file, book)) {
+            throw runtime_error("Malformed book record in " + path + " after " + to_string(books.size()) + " books");
+        }
+        books.push_back(move(book));
+    }
+
+    cout << "Loaded " << books.size() << " books from " << path << endl;
+    return books;
+}
+
+// One flat object, unknown keys are skipped
+bool FileReader::readBook(istream& in, BookData& book) {
+    if (in.get() != '{') {
+        return false;
+    }
+
+    while (true) {
+        skipWhitespace(in);
+        int next = in.peek();
+
+        if (next == '}') {
+            in.get();
+            return true;
+        }
+        if (next == ',') {
+            in.get();
+            continue;
+        }
+        if (next != '"') {
+            return false;
+        }
+
+        string key = readString(in);
+        skipWhitespace(in);
+        if (in.get() != ':') {
+            return false;
+        }
+        skipWhitespace(in);
+
+        bool isString = in.peek() == '"';
+        string value = isString ? readString(in) : readScalar(in);
+
+        try {
+            if (key == "title") {
+                book.title = value;
+            }
+            else if (key == "price") {
+                book.priceMinor = PriceKernels::parseMinorUnits(value);
+            }
+            else if (key == "starRating") {
+                book.starRating = stoi(value);
+            }
+            else if (key == "availability") {
+                book.availability = value;
+            }
+            else if (key == "imageUrl") {
+                book.imageUrl = value;
+            }
+            else if (key == "imageHash") {
+                book.imageHash = value;
+            }
+            else if (key == "detailUrl") {
+                book.detailUrl = value;
+            }
+            else if (key == "upc") {
+                book.upc = value;
+            }
+            else if (key == "stockCount") {
+                book.stockCount = stoi(value);
+            }
+            else if (key == "category") {
+                book.category = value;
+            }
+            else if (key == "description") {
+                book.description = value;
+            }
+        }
+        catch (...) {
+            return false;
+        }
+    }
+}
+
+string FileReader::readString(istream& in) {
+    string value;
+    in.get();  // opening quote
+
+    streambuf* buffer = in.rdbuf();
+    while (true) {
+        int ch = buffer->sbumpc();
+        if (ch == EOF || ch == '"') {
+            break;
+        }
+        if (ch != '\\') {
+            value += static_cast<char>(ch);
+            continue;
+        }
+
+        int escaped = buffer->sbumpc();
+        switch (escaped) {
+        case 'n': value += '\n'; break;
+        case 't': value += '\t'; break;
+        case 'r': value += '\r'; break;
+        case 'u': {
+            // Only needed for control characters, keep the code point if ASCII
+            string hex;
+            for (int i = 0; i < 4; ++i) {
+                hex += static_cast<char>(buffer->sbumpc());
+            }
+            unsigned long code = strtoul(hex.c_str(), nullptr, 16);
+            value += code < 0x80 ? static_cast<char>(code) : '?';
+            break;
+        }
+        case EOF: break;
+        default: value += static_cast<char>(escaped); break;
+        }
+    }
+    return value;
+}
+
+string FileReader::readScalar(istream& in) {
+    string value;
+    while (true) {
+        int ch = in.peek();
+        if (ch == EOF || ch == ',' || ch == '}' || ch == ']' || isspace(ch)) {
+            break;
+        }
+        value += static_cast<char>(in.get());
+    }
+    return value;
+}
+
+void FileReader::skipWhitespace(istream& in) {
+    while (isspace(in.peek())) {
+        in.get();
+    }
+}
@@ -0,0 +1,19 @@
+#pragma once
+#include <istream>
+#include <string>
+#include <vector>
+#include "BookData.h"
+
+using namespace std;
+
+// Loads books back from the .json file written by FileWriter::writeRawData
+class FileReader {
+public:
+    vector<BookData> readRawData(const string& filename);
+
+private:
+    bool readBook(istream& in, BookData& book);
+    string readString(istream& in);
+    string readScalar(istream& in);
+    void skipWhitespace(istream& in);
+};
@@ -1,5 +1,7 @@
 #include "FileWriter.h"
 #include "ScrapingStats.h"
+#include "PriceKernels.h"
+#include "BookTable.h"
 #include <fstream>
 #include <iomanip>
 #include <sstream>
@@ -17,35 +19,265 @@ void FileWriter::writeResults(const string& filename, const AnalysisResults& res
     file.close();
 }
 
-void FileWriter::writeRawData(const string& filename, const tbb::concurrent_vector<BookData>& books) {
+void FileWriter::writeRawData(const string& filename, const BookStore& books) {
     ofstream file(filename + ".json");
     if (!file.is_open()) {
         throw runtime_error("Cannot open file: " + filename + ".json");
     }
 
-    file << "[\n";
+    file << "[";
 
-    for (size_t i = 0; i < books.size(); ++i) {
-        const auto& book = books[i];
-        file << "  {\n";
-        file << "    \"title\": \"" << book.title << "\",\n";
-        file << "    \"price\": " << book.price << ",\n";
-        file << "    \"starRating\": " << book.starRating << ",\n";
-        file << "    \"availability\": \"" << book.availability << "\",\n";
-        file << "    \"imageUrl\": \"" << book.imageUrl << "\"\n";
-        file << "  }";
+    bool firstBook = true;
+    books.forEachSegment([&](const BookSegment& segment) {
+        for (const auto& book : segment) {
+            file << (firstBook ? "\n" : ",\n") << formatBookJson(book, "  ");
+            firstBook = false;
+        }
+    });
+
+    file << "\n]\n";
+
+    file.close();
+}
+
+void FileWriter::openRawData(const string& filename) {
+    rawStreamName_ = filename + ".json";
+    rawStream_.open(rawStreamName_);
+    if (!rawStream_.is_open()) {
+        throw runtime_error("Cannot open file: " + rawStreamName_);
+    }
+
+    rawStream_ << "[";
+    rawStreamEmpty_ = true;
+}
+
+void FileWriter::appendRawData(const vector<BookData>& books) {
+    for (const auto& book : books) {
+        rawStream_ << (rawStreamEmpty_ ? "\n" : ",\n") << formatBookJson(book, "  ");
+        rawStreamEmpty_ = false;
+    }
+    rawStream_.flush();
+}
+
+void FileWriter::closeRawData() {
+    rawStream_ << "\n]\n";
+    rawStream_.close();
+
+    if (rawStream_.fail()) {
+        throw runtime_error("Cannot write file: " + rawStreamName_);
+    }
+}
+
+void FileWriter::writeTable(const string& filename, const BookStore& books) {
+    BookTable::write(filename + ".columns", books);
+}
+
+// Writes books added, removed and changed since the previous run
+void FileWriter::writeDelta(const string& filename, const CatalogDelta& delta) {
+    ofstream file(filename + ".delta.json");
+    if (!file.is_open()) {
+        throw runtime_error("Cannot open file: " + filename + ".delta.json");
+    }
+
+    file << "{\n";
+    file << "  \"summary\": { \"added\": " << delta.added.size()
+        << ", \"removed\": " << delta.removed.size()
+        << ", \"changed\": " << delta.changed.size()
+        << ", \"unchanged\": " << delta.unchanged << " },\n";
+
+    file << "  \"added\": [\n";
+    for (size_t i = 0; i < delta.added.size(); ++i) {
+        file << formatBookJson(delta.added[i], "    ") << (i + 1 < delta.added.size() ? ",\n" : "\n");
+    }
+    file << "  ],\n";
 
-        if (i + 1 < books.size()) {
-            file << ",";
+    file << "  \"removed\": [\n";
+    for (size_t i = 0; i < delta.removed.size(); ++i) {
+        file << formatBookJson(delta.removed[i], "    ") << (i + 1 < delta.removed.size() ? ",\n" : "\n");
+    }
+    file << "  ],\n";
+
+    file << "  \"changed\": [\n";
+    for (size_t i = 0; i < delta.changed.size(); ++i) {
+        file << "    {\n";
+        file << "      \"before\":\n" << formatBookJson(delta.changed[i].before, "      ") << ",\n";
+        file << "      \"after\":\n" << formatBookJson(delta.changed[i].after, "      ") << "\n";
+        file << "    }" << (i + 1 < delta.changed.size() ? ",\n" : "\n");
+    }
+    file << "  ]\n";
+
+    file << "}\n";
+
+    file.close();
+}
+
+// Writes every duplicate cluster with the listing that was kept
+void FileWriter::writeDuplicates(const string& filename, const vector<DuplicateCluster>& clusters) {
+    ofstream file(filename + ".duplicates.json");
+    if (!file.is_open()) {
+        throw runtime_error("Cannot open file: " + filename + ".duplicates.json");
+    }
+
+    size_t duplicates = 0;
+    size_t exact = 0;
+    for (const auto& cluster : clusters) {
+        duplicates += cluster.books.size() - 1;
+        exact += cluster.exact ? 1 : 0;
+    }
+
+    file << fixed << setprecision(3);
+    file << "{\n";
+    file << "  \"summary\": { \"clusters\": " << clusters.size()
+        << ", \"exactClusters\": " << exact
+        << ", \"duplicates\": " << duplicates << " },\n";
+
+    file << "  \"clusters\": [\n";
+    for (size_t i = 0; i < clusters.size(); ++i) {
+        const DuplicateCluster& cluster = clusters[i];
+        file << "    {\n";
+        file << "      \"exact\": " << (cluster.exact ? "true" : "false") << ",\n";
+        file << "      \"similarity\": " << cluster.similarity << ",\n";
+        file << "      \"kept\":\n" << formatBookJson(cluster.books[0], "      ") << ",\n";
+        file << "      \"duplicates\": [\n";
+        for (size_t j = 1; j < cluster.books.size(); ++j) {
+            file << formatBookJson(cluster.books[j], "        ") << (j + 1 < cluster.books.size() ? ",\n" : "\n");
         }
-        file << "\n";
+        file << "      ]\n";
+        file << "    }" << (i + 1 < clusters.size() ? ",\n" : "\n");
     }
+    file << "  ]\n";
 
-    file << "]\n";
+    file << "}\n";
 
     file.close();
 }
 
+// Saves the analysis including price distributions as <filename>.stats.json
+void FileWriter::writeAnalysis(const string& filename, const AnalysisResults& results) {
+    ofstream file(filename + ".stats.json");
+    if (!file.is_open()) {
+        throw runtime_error("Cannot open file: " + filename + ".stats.json");
+    }
+
+    file << formatAnalysisJson(results) << "\n";
+
+    file.close();
+}
+
+string FileWriter::formatAnalysisJson(const AnalysisResults& results) {
+    ostringstream oss;
+
+    oss << fixed << setprecision(2);
+    oss << "{\n";
+    oss << "  \"bookCount\": " << results.bookCount << ",\n";
+    oss << "  \"fiveStarBooks\": " << results.fiveStarBooks << ",\n";
+    oss << "  \"averagePrice\": " << results.averagePrice << ",\n";
+    oss << "  \"totalValue\": " << PriceKernels::formatMinorUnits(results.totalValueMinor) << ",\n";
+    oss << "  \"booksInStock\": " << results.booksInStock << ",\n";
+    oss << "  \"averageRating\": " << results.averageRating << ",\n";
+    oss << "  \"mostExpensiveBook\":\n" << formatBookJson(results.mostExpensiveBook, "  ") << ",\n";
+    oss << "  \"cheapestBook\":\n" << formatBookJson(results.cheapestBook, "  ") << ",\n";
+
+    const PriceDistributions& distributions = results.priceDistributions;
+    oss << "  \"priceDistribution\": " << formatDistributionJson(distributions.overall) << ",\n";
+
+    oss << "  \"priceDistributionByRating\": {";
+    size_t n = 0;
+    for (const auto& pair : distributions.byRating) {
+        oss << (n++ > 0 ? "," : "") << "\n    \"" << pair.first << "\": " << formatDistributionJson(pair.second);
+    }
+    oss << "\n  },\n";
+
+    oss << "  \"priceDistributionByAvailability\": {";
+    n = 0;
+    for (const auto& pair : distributions.byAvailability) {
+        oss << (n++ > 0 ? "," : "") << "\n    \"" << escapeJson(pair.first) << "\": " << formatDistributionJson(pair.second);
+    }
+    oss << "\n  }\n";
+
+    oss << "}";
+
+    return oss.str();
+}
+
+string FileWriter::formatDistribution(const PriceDistribution& distribution) {
+    const QuantileSketch& q = distribution.quantiles;
+    ostringstream oss;
+
+    oss << fixed << setprecision(2)
+        << q.count() << " books, median " << q.quantile(0.5)
+        << ", p10 " << q.quantile(0.1)
+        << ", p90 " << q.quantile(0.9)
+        << ", p99 " << q.quantile(0.99);
+
+    return oss.str();
+}
+
+string FileWriter::formatDistributionJson(const PriceDistribution& distribution) {
+    const QuantileSketch& q = distribution.quantiles;
+    ostringstream oss;
+
+    oss << fixed << setprecision(2) << "{ \"count\": " << q.count()
+        << ", \"min\": " << q.minValue()
+        << ", \"p10\": " << q.quantile(0.1)
+        << ", \"p25\": " << q.quantile(0.25)
+        << ", \"median\": " << q.quantile(0.5)
+        << ", \"p75\": " << q.quantile(0.75)
+        << ", \"p90\": " << q.quantile(0.9)
+        << ", \"p99\": " << q.quantile(0.99)
+        << ", \"max\": " << q.maxValue()
+        << ", \"histogram\": [";
+
+    for (int i = 0; i <= PriceHistogram::BUCKET_COUNT; ++i) {
+        oss << (i > 0 ? ", " : "") << distribution.histogram.bucket(i);
+    }
+    oss << "] }";
+
+    return oss.str();
+}
+
+string FileWriter::formatBookJson(const BookData& book, const string& indent) {
+    ostringstream oss;
+
+    oss << indent << "{\n";
+    oss << indent << "  \"title\": \"" << escapeJson(book.title) << "\",\n";
+    oss << indent << "  \"price\": " << PriceKernels::formatMinorUnits(book.priceMinor) << ",\n";
+    oss << indent << "  \"starRating\": " << book.starRating << ",\n";
+    oss << indent << "  \"availability\": \"" << escapeJson(book.availability) << "\",\n";
+    oss << indent << "  \"imageUrl\": \"" << escapeJson(book.imageUrl) << "\"";
+    if (!book.imageHash.empty()) {
+        oss << ",\n" << indent << "  \"imageHash\": \"" << book.imageHash << "\"";
+    }
+    if (!book.upc.empty()) {
+        oss << ",\n" << indent << "  \"detailUrl\": \"" << escapeJson(book.detailUrl) << "\",\n";
+        oss << indent << "  \"upc\": \"" << escapeJson(book.upc) << "\",\n";
+        oss << indent << "  \"stockCount\": " << book.stockCount << ",\n";
+        oss << indent << "  \"category\": \"" << escapeJson(book.category) << "\",\n";
+        oss << indent << "  \"description\": \"" << escapeJson(book.description) << "\"";
+    }
+    oss << "\n";
+    oss << indent << "}";
+
+    return oss.str();
+}
+
+string FileWriter::escapeJson(const string& value) {
+    string escaped;
+    escaped.reserve(value.size());
+
+    for (char ch : value) {
+        switch (ch) {
+        case '"': escaped += "\\\""; break;
+        case '\\': escaped += "\\\\"; break;
+        case '\n': escaped += "\\n"; break;
+        case '\r': escaped += "\\r"; break;
+        case '\t': escaped += "\\t"; break;
+        default: escaped += ch; break;
+        }
+    }
+    return escaped;
+}
+
 string FileWriter::formatResults(const AnalysisResults& results, const ScrapingStats& stats) {
     ostringstream oss;
 
@@ -57,6 +289,7 @@ string FileWriter::formatResults(const AnalysisResults& results, const ScrapingS
     oss << "- Pages processed: " << stats.pagesProcessed.load() << "\n";
     oss << "- Books found: " << stats.booksFound.load() << "\n";
     oss << "- Failed requests: " << stats.failedRequests.load() << "\n";
+    oss << "- Unchanged pages (skipped): " << stats.pagesUnchanged.load() << "\n";
     oss << "- Execution time: " << formatDuration(stats.startTime, stats.endTime) << "\n\n";
 
     oss << "CONTENT ANALYSIS:\n";
@@ -64,11 +297,11 @@ string FileWriter::formatResults(const AnalysisResults& results, const ScrapingS
     oss << "2. Average book price: " << fixed << setprecision(2)
         << results.averagePrice << "\n";
     oss << "3. Most expensive book: \"" << results.mostExpensiveBook.title
-        << "\" (" << results.mostExpensiveBook.price << ")\n";
+        << "\" (" << PriceKernels::formatMinorUnits(results.mostExpensiveBook.priceMinor) << ")\n";
     oss << "4. Cheapest book: \"" << results.cheapestBook.title
-        << "\" (" << results.cheapestBook.price << ")\n";
-    oss << "5. Total value of all books: " << fixed << setprecision(2)
-        << results.totalValue << "\n\n";
+        << "\" (" << PriceKernels::formatMinorUnits(results.cheapestBook.priceMinor) << ")\n";
+    oss << "5. Total value of all books: "
+        << PriceKernels::formatMinorUnits(results.totalValueMinor) << "\n\n";
 
     oss << "ADDITIONAL STATS:\n";
     oss << "- Average rating: " << fixed << setprecision(1)
@@ -86,6 +319,33 @@ string FileWriter::formatResults(const AnalysisResults& results, const ScrapingS
         oss << "- " << pair.first << ": " << pair.second << " books\n";
     }
 
+    const PriceDistributions& distributions = results.priceDistributions;
+
+    oss << "\nPRICE DISTRIBUTION:\n";
+    oss << "- All books: " << formatDistribution(distributions.overall) << "\n";
+    for (const auto& pair : distributions.byRating) {
+        oss << "- " << pair.first << " star: " << formatDistribution(pair.second) << "\n";
+    }
+    for (const auto& pair : distributions.byAvailability) {
+        oss << "- " << pair.first << ": " << formatDistribution(pair.second) << "\n";
+    }
+
+    oss << "\nPRICE HISTOGRAM:\n";
+    const PriceHistogram& histogram = distributions.overall.histogram;
+    for (int i = 0; i <= PriceHistogram::BUCKET_COUNT; ++i) {
+        if (histogram.bucket(i) == 0) {
+            continue;
+        }
+        if (i == PriceHistogram::BUCKET_COUNT) {
+            oss << "- " << fixed << setprecision(0) << histogram.bucketStart(i) << "+ : ";
+        }
+        else {
+            oss << "- " << fixed << setprecision(0) << setw(3) << histogram.bucketStart(i)
+                << "-" << setw(3) << histogram.bucketStart(i + 1) << ": ";
+        }
+        oss << histogram.bucket(i) << " books\n";
+    }
+
     oss << "\n===============================================\n";
 
     return oss.str();
@@ -2,7 +2,11 @@
 #include "BookData.h"
 #include "ScrapingStats.h"
 #include "DataAnalyzer.h"
+#include "BookStore.h"
+#include "DuplicateDetector.h"
+#include <fstream>
 #include <string>
+#include <vector>
 #include <tbb/concurrent_vector.h>
 
 using namespace std;
@@ -11,9 +15,31 @@ using namespace chrono;
 class FileWriter {
 public:
     void writeResults(const string& filename, const AnalysisResults& results, const ScrapingStats& stats);
-    void writeRawData(const string& filename, const tbb::concurrent_vector<BookData>& books);
+    void writeRawData(const string& filename, const BookStore& books);
+    void writeDelta(const string& filename, const CatalogDelta& delta);
+    void writeAnalysis(const string& filename, const AnalysisResults& results);
+    // Binary columnar copy of the books as <filename>.columns, see BookTable
+    void writeTable(const string& filename, const BookStore& books);
+    void writeDuplicates(const string& filename, const vector<DuplicateCluster>& clusters);
+
+    // Contents of the .stats.json file
+    string formatAnalysisJson(const AnalysisResults& results);
+
+    // Streaming version of writeRawData, books are appended as pages finish
+    void openRawData(const string& filename);
+    void appendRawData(const vector<BookData>& books);
+    void closeRawData();
+    bool isStreamingRawData() const { return rawStream_.is_open(); }
 
 private:
+    ofstream rawStream_;
+    string rawStreamName_;
+    bool rawStreamEmpty_ = true;
+
     string formatResults(const AnalysisResults& results, const ScrapingStats& stats);
+    string formatDistribution(const PriceDistribution& distribution);
+    string formatDistributionJson(const PriceDistribution& distribution);
+    string formatBookJson(const BookData& book, const string& indent);
+    string escapeJson(const string& value);
     string formatDuration(const steady_clock::time_point& start, const steady_clock::time_point& end);
 };
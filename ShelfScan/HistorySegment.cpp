@@ -0,0 +1,208 @@
+#include "HistorySegment.h"
+#include "Varint.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static const char MAGIC[4] = { 'S', 'S', 'H', 'S' };
+
+void HistorySegment::write(const string& path, vector<HistoryRecord>& rows, uint64_t firstGeneration, uint64_t lastGeneration) {
+    sort(rows.begin(), rows.end(), [](const HistoryRecord& a, const HistoryRecord& b) {
+        return a.keyId != b.keyId ? a.keyId < b.keyId : a.time < b.time;
+    });
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.firstGeneration = firstGeneration;
+    header.lastGeneration = lastGeneration;
+    header.rowCount = rows.size();
+    header.minTime = rows.empty() ? 0 : INT64_MAX;
+    header.maxTime = rows.empty() ? 0 : INT64_MIN;
+
+    string columns[4];
+    vector<Run> runs;
+
+    for (size_t start = 0; start < rows.size();) {
+        size_t end = start;
+        while (end < rows.size() && rows[end].keyId == rows[start].keyId) {
+            end++;
+        }
+
+        Run run;
+        run.keyId = rows[start].keyId;
+        run.rows = static_cast<uint32_t>(end - start);
+        run.firstTime = rows[start].time;
+        run.lastTime = rows[end - 1].time;
+        run.firstPence = rows[start].pricePence;
+        run.lastPence = rows[end - 1].pricePence;
+        run.timeOffset = columns[0].size();
+        run.priceOffset = columns[1].size();
+        run.stockOffset = columns[2].size();
+        run.flagOffset = columns[3].size();
+        runs.push_back(run);
+
+        // Deltas restart with every run, so a run decodes on its own
+        int64_t previousTime = 0, previousPrice = 0, previousStock = 0;
+        for (size_t i = start; i < end; ++i) {
+            const HistoryRecord& row = rows[i];
+            putVarint(columns[0], zigzag(row.time - previousTime));
+            putVarint(columns[1], zigzag(row.pricePence - previousPrice));
+            putVarint(columns[2], zigzag(row.stockCount - previousStock));
+            columns[3].push_back(static_cast<char>(row.inStock));
+
+            previousTime = row.time;
+            previousPrice = row.pricePence;
+            previousStock = row.stockCount;
+        }
+
+        header.minTime = min(header.minTime, run.firstTime);
+        header.maxTime = max(header.maxTime, run.lastTime);
+        start = end;
+    }
+
+    header.runCount = static_cast<uint32_t>(runs.size());
+    uint64_t offset = sizeof(Header) + runs.size() * sizeof(Run);
+    for (int c = 0; c < 4; ++c) {
+        header.columnStart[c] = offset;
+        offset += columns[c].size();
+    }
+    header.columnEnd = offset;
+
+    string temp = path + ".tmp";
+    {
+        ofstream file(temp, ios::binary | ios::trunc);
+        if (!file.is_open()) {
+            throw runtime_error("Cannot create history segment: " + temp);
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(runs.data()), static_cast<streamsize>(runs.size() * sizeof(Run)));
+        for (const auto& column : columns) {
+            file.write(column.data(), static_cast<streamsize>(column.size()));
+        }
+        if (!file) {
+            throw runtime_error("Cannot write history segment: " + temp);
+        }
+    }
+    fs::rename(temp, path);
+}
+
+HistorySegment::HistorySegment(const string& path) : file_(path) {
+    if (file_.size() < sizeof(Header)) {
+        throw runtime_error("Truncated history segment: " + path);
+    }
+    memcpy(&header_, file_.data(), sizeof(Header));
+
+    if (memcmp(header_.magic, MAGIC, sizeof(MAGIC)) != 0 || header_.version != VERSION ||
+        header_.columnEnd != file_.size() ||
+        header_.columnStart[0] != sizeof(Header) + static_cast<uint64_t>(header_.runCount) * sizeof(Run)) {
+        throw runtime_error("Not a valid history segment: " + path);
+    }
+    for (int c = 0; c < 3; ++c) {
+        if (header_.columnStart[c] > header_.columnStart[c + 1]) {
+            throw runtime_error("Not a valid history segment: " + path);
+        }
+    }
+    if (header_.columnStart[3] > header_.columnEnd) {
+        throw runtime_error("Not a valid history segment: " + path);
+    }
+
+    // Directory entries point into the columns and findRun() needs them sorted
+    uint64_t rows = 0;
+    for (uint32_t i = 0; i < header_.runCount; ++i) {
+        Run entry = run(i);
+        if (!validRun(entry) || (i > 0 && run(i - 1).keyId >= entry.keyId)) {
+            throw runtime_error("Corrupt run in history segment: " + path);
+        }
+        rows += entry.rows;
+    }
+    if (rows != header_.rowCount) {
+        throw runtime_error("Corrupt run in history segment: " + path);
+    }
+}
+
+uint64_t HistorySegment::columnSize(int column) const {
+    return (column == 3 ? header_.columnEnd : header_.columnStart[column + 1]) - header_.columnStart[column];
+}
+
+// Every row takes at least one byte in each column
+bool HistorySegment::validRun(const Run& entry) const {
+    uint64_t offsets[4] = { entry.timeOffset, entry.priceOffset, entry.stockOffset, entry.flagOffset };
+    for (int c = 0; c < 4; ++c) {
+        if (offsets[c] > columnSize(c) || entry.rows > columnSize(c) - offsets[c]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Directory entries are read with memcpy, the mapping gives no alignment guarantee
+HistorySegment::Run HistorySegment::run(uint32_t index) const {
+    Run entry;
+    memcpy(&entry, file_.data() + sizeof(Header) + static_cast<size_t>(index) * sizeof(Run), sizeof(Run));
+    return entry;
+}
+
+bool HistorySegment::findRun(uint32_t keyId, Run& found) const {
+    uint32_t low = 0, high = header_.runCount;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        Run entry = run(middle);
+        if (entry.keyId < keyId) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    if (low == header_.runCount) {
+        return false;
+    }
+    found = run(low);
+    return found.keyId == keyId;
+}
+
+void HistorySegment::decode(const Run& entry, vector<HistoryRecord>& rows) const {
+    if (!validRun(entry)) {
+        throw runtime_error("Corrupt run in history segment: " + path());
+    }
+
+    const char* base = file_.data();
+    const char* times = base + header_.columnStart[0] + entry.timeOffset;
+    const char* prices = base + header_.columnStart[1] + entry.priceOffset;
+    const char* stocks = base + header_.columnStart[2] + entry.stockOffset;
+    const char* flags = base + header_.columnStart[3] + entry.flagOffset;
+
+    HistoryRecord row;
+    row.keyId = entry.keyId;
+    int64_t time = 0, price = 0, stock = 0;
+
+    for (uint32_t i = 0; i < entry.rows; ++i) {
+        time += unzigzag(getVarint(times, base + header_.columnStart[1]));
+        price += unzigzag(getVarint(prices, base + header_.columnStart[2]));
+        stock += unzigzag(getVarint(stocks, base + header_.columnStart[3]));
+
+        row.time = time;
+        row.pricePence = price;
+        row.stockCount = static_cast<int32_t>(stock);
+        row.inStock = static_cast<uint8_t>(flags[i]);
+        rows.push_back(row);
+    }
+}
+
+vector<HistoryRecord> HistorySegment::allRows() const {
+    vector<HistoryRecord> rows;
+    rows.reserve(header_.rowCount);
+    for (uint32_t i = 0; i < header_.runCount; ++i) {
+        decode(run(i), rows);
+    }
+    return rows;
+}
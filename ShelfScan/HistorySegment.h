@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+using namespace std;
+
+// One observation of a book, as appended to the history log
+struct HistoryRecord {
+    uint32_t keyId = 0;
+    int32_t stockCount = -1;    // -1 = unknown
+    int64_t time = 0;           // seconds since the epoch
+    int64_t pricePence = 0;
+    uint8_t inStock = 0;
+    uint8_t padding[7] = {};
+};
+
+// Compacted, read-only part of the history, memory mapped. Rows are sorted by
+// book and time and stored column by column (time, price, stock, in stock);
+// within a book's run times and prices are delta encoded as varints. A
+// directory sorted by book id gives each run's offsets along with its first
+// and last observation, so most queries never decode a run.
+// Covers history log generations [firstGeneration, lastGeneration].
+class HistorySegment {
+public:
+    struct Run {
+        uint32_t keyId;
+        uint32_t rows;
+        int64_t firstTime;
+        int64_t lastTime;
+        int64_t firstPence;
+        int64_t lastPence;
+        uint64_t timeOffset;        // into each column
+        uint64_t priceOffset;
+        uint64_t stockOffset;
+        uint64_t flagOffset;
+    };
+
+    // Sorts rows and writes them to path (through a temp file and a rename)
+    static void write(const string& path, vector<HistoryRecord>& rows, uint64_t firstGeneration, uint64_t lastGeneration);
+
+    explicit HistorySegment(const string& path);
+
+    const string& path() const { return file_.path(); }
+    uint64_t firstGeneration() const { return header_.firstGeneration; }
+    uint64_t lastGeneration() const { return header_.lastGeneration; }
+    uint64_t rowCount() const { return header_.rowCount; }
+    uint32_t runCount() const { return header_.runCount; }
+    int64_t minTime() const { return header_.minTime; }
+    int64_t maxTime() const { return header_.maxTime; }
+
+    Run run(uint32_t index) const;
+    // Run of a book, false if the segment has no rows for it
+    bool findRun(uint32_t keyId, Run& found) const;
+    void decode(const Run& run, vector<HistoryRecord>& rows) const;
+    vector<HistoryRecord> allRows() const;
+
+private:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t firstGeneration;
+        uint64_t lastGeneration;
+        uint64_t rowCount;
+        uint32_t runCount;
+        uint32_t reserved;
+        int64_t minTime;
+        int64_t maxTime;
+        uint64_t columnStart[4];    // time, price, stock, flag columns
+        uint64_t columnEnd;
+    };
+
+    static const uint32_t VERSION = 1;
+
+    MappedFile file_;
+    Header header_;
+
+    uint64_t columnSize(int column) const;
+    bool validRun(const Run& entry) const;
+};
@@ -1,261 +1,234 @@
 #include "HtmlParser.h"
+#include "PriceKernels.h"
+#include "TextKernels.h"
 #include <iostream>
 #include <algorithm>
 #include <sstream>
 #include <cctype>
+#include <cstring>
 #include <gumbo.h>
 
 using namespace std;
 
-string HtmlParser::getTextContent(GumboNode* node) {
-    if (node->type == GUMBO_NODE_TEXT) {
-        return string(node->v.text.text);
+HtmlParser::HtmlParser() : schema_(ExtractionSchema::defaultListing()) {
+}
+
+void HtmlParser::setSchema(const ExtractionSchema& schema) {
+    schema_ = schema;
+}
 
-    } else if (node->type == GUMBO_NODE_ELEMENT) {
-        string text_content = "";
+// Collects the text nodes under node as spans into Gumbo's buffers, the
+// caller joins them once instead of concatenating per node
+void HtmlParser::gatherText(GumboNode* node, vector<string_view>& spans) {
+    if (node->type == GUMBO_NODE_TEXT) {
+        spans.push_back(node->v.text.text);
+    }
+    else if (node->type == GUMBO_NODE_ELEMENT) {
         GumboVector* children = &node->v.element.children;
         for (unsigned int i = 0; i < children->length; ++i) {
-            text_content += getTextContent(static_cast<GumboNode*>(children->data[i]));
+            gatherText(static_cast<GumboNode*>(children->data[i]), spans);
         }
-
-        return text_content;
     }
-    return "";
 }
 
-GumboNode* HtmlParser::findNodeByClass(GumboNode* node, const string& class_name) {
-    if (node->type != GUMBO_NODE_ELEMENT) {
-        return nullptr;
-    }
-    
-    GumboAttribute* class_attr = gumbo_get_attribute(&node->v.element.attributes, "class");
-    if (class_attr) {
-        string class_value = string(class_attr->value);
-        if (class_value.find(class_name) != string::npos) {
-            return node;
-        }
-    }
-    
-    GumboVector* children = &node->v.element.children;
-    for (unsigned int i = 0; i < children->length; ++i) {
-        GumboNode* result = findNodeByClass(static_cast<GumboNode*>(children->data[i]), class_name);
-        if (result) {
-            return result;
-        }
-    }
-    
-    return nullptr;
+// Price in minor units (pence), "GBP 51.77" -> 5177
+int64_t HtmlParser::parsePriceString(string_view price_text) {
+    return PriceKernels::parseMinorUnits(price_text);
 }
 
-GumboNode* HtmlParser::findNodeByTag(GumboNode* node, GumboTag tag) {
-    if (node->type == GUMBO_NODE_ELEMENT && node->v.element.tag == tag) {
-        return node;
-    }
-    
-    if (node->type == GUMBO_NODE_ELEMENT) {
-        GumboVector* children = &node->v.element.children;
-        for (unsigned int i = 0; i < children->length; ++i) {
-            GumboNode* result = findNodeByTag(static_cast<GumboNode*>(children->data[i]), tag);
-            if (result) {
-                return result;
-            }
+int HtmlParser::parseStarRating(string_view ratingClass) {
+    static const char* const RATINGS[] = { "one", "two", "three", "four", "five" };
+
+    for (int i = 0; i < 5; ++i) {
+        if (TextKernels::containsIgnoreCase(ratingClass, RATINGS[i])) {
+            return i + 1;
         }
     }
-    
-    return nullptr;
+
+    return 0;
 }
 
-string HtmlParser::cleanText(const string& text) {
-    string result = text;
-    
-    size_t start = result.find_first_not_of(" \t\n\r\f\v");
-    if (start == string::npos) {
-        return "";
+// "In stock (22 available)" -> 22, "Out of stock" -> 0, -1 if no count is given
+int HtmlParser::parseStockCount(string_view availabilityText) {
+    size_t digits = availabilityText.find_first_of("0123456789");
+    if (digits != string_view::npos) {
+        size_t end = availabilityText.find_first_not_of("0123456789", digits);
+        int count;
+        if (TextKernels::parseInt(availabilityText.substr(digits, end - digits), count)) {
+            return count;
+        }
     }
-    
-    size_t end = result.find_last_not_of(" \t\n\r\f\v");
-    result = result.substr(start, end - start + 1);
-    
-    string::size_type pos = 0;
-    while ((pos = result.find("  ", pos)) != string::npos) {
-        result.replace(pos, 2, " ");
+
+    if (TextKernels::containsIgnoreCase(availabilityText, "out of stock")) {
+        return 0;
     }
-    
-    return result;
+    return -1;
 }
 
-float HtmlParser::parsePriceString(const string& price_text) {
-    string cleaned = cleanText(price_text);
+// Walks the item subtree once for all field rules. progress[r] is how many
+// leading steps of rule r's selector the ancestors of node already match;
+// the first node (in document order) matching the last step wins.
+void HtmlParser::matchFields(GumboNode* node, vector<size_t>& progress, vector<GumboNode*>& matched, size_t& remaining) {
+    if (node->type != GUMBO_NODE_ELEMENT) {
+        return;
+    }
 
-    string numbersOnly;
-    bool foundDot = false;
+    const vector<FieldRule>& rules = schema_.rules();
+    vector<size_t> advanced;
 
-    for (unsigned char uc : cleaned) {
-        if (uc >= '0' && uc <= '9') {
-            numbersOnly += static_cast<char>(uc);
-        }
-        else if ((uc == '.' || uc == ',') && !foundDot) {
-            numbersOnly += '.';
-            foundDot = true;
+    for (size_t r = 0; r < rules.size(); ++r) {
+        const Selector& selector = rules[r].selector;
+        if (matched[r] || !selector[progress[r]].matches(node)) {
+            continue;
         }
-    }
 
-    try {
-        if (numbersOnly.empty()) {
-            return 0;
+        if (progress[r] + 1 == selector.size()) {
+            matched[r] = node;
+            remaining--;
         }
         else {
-            return stof(numbersOnly);
+            progress[r]++;
+            advanced.push_back(r);
         }
     }
-    catch (...) {
-        return 0;
-    }
-}
 
-int HtmlParser::parseStarRating(const string& ratingClass) {
-    string lowerClass = ratingClass;
-
-    for (char& ch : lowerClass) {
-        ch = static_cast<char>(std::tolower(static_cast<unsigned char>(ch)));
+    GumboVector* children = &node->v.element.children;
+    for (unsigned int i = 0; i < children->length && remaining > 0; ++i) {
+        matchFields(static_cast<GumboNode*>(children->data[i]), progress, matched, remaining);
     }
 
-    if (lowerClass.find("one") != string::npos) {
-        return 1;
-    }
-    if (lowerClass.find("two") != string::npos) {
-        return 2;
+    for (size_t r : advanced) {
+        progress[r]--;
     }
-    if (lowerClass.find("three") != string::npos) {
-        return 3;
+}
+
+// spans and text are scratch buffers shared by all fields of a book
+void HtmlParser::applyField(BookData& book, const FieldRule& rule, GumboNode* node, vector<string_view>& spans, string& text) {
+    spans.clear();
+
+    if (rule.attribute.empty()) {
+        gatherText(node, spans);
     }
-    if (lowerClass.find("four") != string::npos) {
-        return 4;
+    else {
+        GumboAttribute* attr = gumbo_get_attribute(&node->v.element.attributes, rule.attribute.c_str());
+        if (attr) {
+            spans.push_back(attr->value);
+        }
+        else if (rule.fallbackToText) {
+            gatherText(node, spans);
+        }
+        else {
+            return;
+        }
     }
-    if (lowerClass.find("five") != string::npos) {
-        return 5;
+
+    TextKernels::normalizeSpans(spans, text);
+
+    switch (rule.type) {
+    case FieldType::Price:
+        book.priceMinor = parsePriceString(text);
+        return;
+    case FieldType::Rating:
+        book.starRating = parseStarRating(text);
+        return;
+    case FieldType::Url:
+        if (text.compare(0, 4, "http") != 0) {
+            text.insert(0, schema_.baseUrl());
+        }
+        break;
+    case FieldType::String:
+        break;
     }
 
-    return 0;
+    switch (rule.field) {
+    case BookField::Title:
+        book.title = text;
+        break;
+    case BookField::Availability:
+        book.availability = text;
+        break;
+    case BookField::ImageUrl:
+        book.imageUrl = text;
+        break;
+    case BookField::DetailUrl:
+        book.detailUrl = text;
+        break;
+    default:
+        break;
+    }
 }
 
-// Parses single book 
+// Parses single book from the schema's field rules
 BookData HtmlParser::parseBookFromNode(GumboNode* articleNode) {
     BookData book;
-    
-    // Find title
-    GumboNode* h3_node = findNodeByTag(articleNode, GUMBO_TAG_H3);
-    if (h3_node) {
-        GumboNode* a_node = findNodeByTag(h3_node, GUMBO_TAG_A);
-        if (a_node) {
-            GumboAttribute* titleAttr = gumbo_get_attribute(&a_node->v.element.attributes, "title");
-            if (titleAttr) {
-                book.title = cleanText(string(titleAttr->value));
-            } else {
-                book.title = cleanText(getTextContent(a_node));
-            }
-        }
-    }
-    
-    // Find price
-    GumboNode* priceNode = findNodeByClass(articleNode, "price_color");
-    if (priceNode) {
-        string priceText = getTextContent(priceNode);
-        book.price = parsePriceString(priceText);
-    }
-    
-    // Find rating
-    GumboNode* ratingNode = findNodeByClass(articleNode, "star-rating");
-    if (ratingNode) {
-        GumboAttribute* classAttr = gumbo_get_attribute(&ratingNode->v.element.attributes, "class");
-        if (classAttr) {
-            book.starRating = parseStarRating(string(classAttr->value));
-        }
-    }
-    
-    // Find availability
-    GumboNode* availNode = findNodeByClass(articleNode, "availability");
-    if (availNode) {
-        book.availability = cleanText(getTextContent(availNode));
+
+    const vector<FieldRule>& rules = schema_.rules();
+    vector<size_t> progress(rules.size(), 0);
+    vector<GumboNode*> matched(rules.size(), nullptr);
+    size_t remaining = rules.size();
+
+    GumboVector* children = &articleNode->v.element.children;
+    for (unsigned int i = 0; i < children->length && remaining > 0; ++i) {
+        matchFields(static_cast<GumboNode*>(children->data[i]), progress, matched, remaining);
     }
-    
-    // Find image URL
-    GumboNode* imgNode = findNodeByTag(articleNode, GUMBO_TAG_IMG);
-    if (imgNode) {
-        GumboAttribute* srcAttr = gumbo_get_attribute(&imgNode->v.element.attributes, "src");
-        if (srcAttr) {
-            string url = string(srcAttr->value);
-            if (url.find("http") != 0) {
-                url = "http://books.toscrape.com/" + url;
-            }
-            book.imageUrl = url;
+
+    vector<string_view> spans;
+    string text;
+    for (size_t r = 0; r < rules.size(); ++r) {
+        if (matched[r]) {
+            applyField(book, rules[r], matched[r], spans, text);
         }
     }
-    
+
     return book;
 }
 
-// Search for all book articles in DOM
-void HtmlParser::searchForBooks(GumboNode* node, vector<BookData>& books) {
+// Search for all book items in DOM, progress = matched steps of the item selector
+void HtmlParser::searchForBooks(GumboNode* node, vector<BookData>& books, size_t progress) {
     if (node->type != GUMBO_NODE_ELEMENT) {
         return;
     }
-    
-    // Looks for <article class="product_pod">
-    if (node->v.element.tag == GUMBO_TAG_ARTICLE) {
-        GumboAttribute* class_attr = gumbo_get_attribute(&node->v.element.attributes, "class");
-        if (class_attr && string(class_attr->value).find("product_pod") != string::npos) {
+
+    const Selector& item = schema_.itemSelector();
+    if (item[progress].matches(node)) {
+        if (progress + 1 == item.size()) {
             BookData book = parseBookFromNode(node);
             if (!book.title.empty()) {
                 books.push_back(book);
-                cout << "Found book: " << book.title << " (" << book.price << " GBP)" << endl;
+                cout << "Found book: " << book.title << " (" << PriceKernels::formatMinorUnits(book.priceMinor) << " GBP)" << endl;
             }
         }
+        else {
+            progress++;
+        }
     }
-    
+
     // Recursively searches children
     GumboVector* children = &node->v.element.children;
     for (unsigned int i = 0; i < children->length; ++i) {
-        searchForBooks(static_cast<GumboNode*>(children->data[i]), books);
+        searchForBooks(static_cast<GumboNode*>(children->data[i]), books, progress);
     }
 }
 
-// Search for pagination links
-void HtmlParser::searchForLinks(GumboNode* node, vector<string>& links) {
+// Search for pagination links, resolved against the page they are on and
+// limited to the same site
+void HtmlParser::searchForLinks(GumboNode* node, const string& pageUrl, vector<string>& links) {
     if (node->type != GUMBO_NODE_ELEMENT) {
         return;
     }
     
     if (node->v.element.tag == GUMBO_TAG_A) {
         GumboAttribute* href = gumbo_get_attribute(&node->v.element.attributes, "href");
-        if (href) {
-            string link = string(href->value);
+        
+        // Filters for pagination links
+        if (href && strstr(href->value, "page-") != nullptr) {
+            string link = resolveUrl(pageUrl, href->value);
+            string site = resolveUrl(pageUrl, "/");
             
-            // Filters for pagination links
-            if (link.find("page-") != string::npos) {
-                // Cleans relative paths
-                if (link.substr(0, 2) == "./") {
-                    link = link.substr(2);
-                }
-                
-                // Makes absolute URL
-                if (link.find("http") != 0) {
-                    if (link[0] == '/') {
-                        link = "http://books.toscrape.com" + link;
-                    } else {
-                        if (link.find("catalogue/") == string::npos) {
-                            link = "http://books.toscrape.com/catalogue/" + link;
-                        } else {
-                            link = "http://books.toscrape.com/" + link;
-                        }
-                    }
-                }
-                
-                // Adds unique links only
-                if (link.find("books.toscrape.com") != string::npos && find(links.begin(), links.end(), link) == links.end()) {
-                    links.push_back(link);
-                    cout << "Found pagination link: " << link << endl;
-                }
+            // Adds unique links only
+            if (link.compare(0, site.size(), site) == 0 && find(links.begin(), links.end(), link) == links.end()) {
+                links.push_back(link);
+                cout << "Found pagination link: " << link << endl;
             }
         }
     }
@@ -263,7 +236,7 @@ void HtmlParser::searchForLinks(GumboNode* node, vector<string>& links) {
     // Recursively searches children
     GumboVector* children = &node->v.element.children;
     for (unsigned int i = 0; i < children->length; ++i) {
-        searchForLinks(static_cast<GumboNode*>(children->data[i]), links);
+        searchForLinks(static_cast<GumboNode*>(children->data[i]), pageUrl, links);
     }
 }
 
@@ -272,20 +245,259 @@ vector<BookData> HtmlParser::parseBooksFromHtml(const string& html_content) {
     vector<BookData> books;
     
     GumboOutput* output = gumbo_parse(html_content.c_str());
-    searchForBooks(output->root, books);
+    searchForBooks(output->root, books, 0);
     gumbo_destroy_output(&kGumboDefaultOptions, output);
     
     return books;
 }
 
 // Finds all pagination links on page
-vector<string> HtmlParser::extractPageLinks(const string& html_content) {
+vector<string> HtmlParser::extractPageLinks(const string& html_content, const string& pageUrl) {
     vector<string> links;
     
     GumboOutput* output = gumbo_parse(html_content.c_str());
-    searchForLinks(output->root, links);
+    searchForLinks(output->root, pageUrl, links);
     gumbo_destroy_output(&kGumboDefaultOptions, output);
     
     cout << "Gumbo parser found " << links.size() << " pagination links" << endl;
     return links;
-}
\ No newline at end of file
+}
+
+// Books and pagination links from a single parse of the page
+void HtmlParser::parsePage(const string& html_content, const string& pageUrl, vector<BookData>& books, vector<string>& links) {
+    GumboOutput* output = gumbo_parse(html_content.c_str());
+    searchForBooks(output->root, books, 0);
+    searchForLinks(output->root, pageUrl, links);
+    gumbo_destroy_output(&kGumboDefaultOptions, output);
+}
+
+// <li class="current">Page 2 of 50</li> and <li class="next"><a href="page-3.html">
+void HtmlParser::searchForPagination(GumboNode* node, PaginationInfo& info, vector<string_view>& spans, string& text) {
+    if (node->type != GUMBO_NODE_ELEMENT) {
+        return;
+    }
+
+    static const CompoundSelector CURRENT{ GUMBO_TAG_LI, { "current" } };
+    static const CompoundSelector NEXT{ GUMBO_TAG_LI, { "next" } };
+
+    if (CURRENT.matches(node)) {
+        spans.clear();
+        gatherText(node, spans);
+        TextKernels::normalizeSpans(spans, text);
+
+        // First number is the current page, the second the page count
+        size_t first = text.find_first_of("0123456789");
+        size_t firstEnd = text.find_first_not_of("0123456789", first);
+        size_t second = text.find_first_of("0123456789", firstEnd);
+        if (second != string::npos) {
+            size_t secondEnd = text.find_first_not_of("0123456789", second);
+            string_view view(text);
+            if (!TextKernels::parseInt(view.substr(first, firstEnd - first), info.current) ||
+                !TextKernels::parseInt(view.substr(second, secondEnd - second), info.total)) {
+                info.current = info.total = 0;
+            }
+        }
+        return;
+    }
+
+    if (NEXT.matches(node)) {
+        GumboVector* children = &node->v.element.children;
+        for (unsigned int i = 0; i < children->length; ++i) {
+            GumboNode* child = static_cast<GumboNode*>(children->data[i]);
+            if (child->type == GUMBO_NODE_ELEMENT && child->v.element.tag == GUMBO_TAG_A) {
+                GumboAttribute* href = gumbo_get_attribute(&child->v.element.attributes, "href");
+                if (href) {
+                    info.nextLink = href->value;
+                }
+            }
+        }
+        return;
+    }
+
+    GumboVector* children = &node->v.element.children;
+    for (unsigned int i = 0; i < children->length; ++i) {
+        searchForPagination(static_cast<GumboNode*>(children->data[i]), info, spans, text);
+    }
+}
+
+PaginationInfo HtmlParser::parsePagination(const string& html_content) {
+    PaginationInfo info;
+    vector<string_view> spans;
+    string text;
+
+    GumboOutput* output = gumbo_parse(html_content.c_str());
+    searchForPagination(output->root, info, spans, text);
+    gumbo_destroy_output(&kGumboDefaultOptions, output);
+
+    return info;
+}
+
+// <tr><th>UPC</th><td>a897fe39b1053632</td></tr>, the other rows only
+// matter for the stock count
+void HtmlParser::readProductRow(GumboNode* row, BookData& book, vector<string_view>& spans, string& text) {
+    GumboNode* header = nullptr;
+    GumboNode* value = nullptr;
+
+    GumboVector* cells = &row->v.element.children;
+    for (unsigned int i = 0; i < cells->length; ++i) {
+        GumboNode* cell = static_cast<GumboNode*>(cells->data[i]);
+        if (cell->type != GUMBO_NODE_ELEMENT) {
+            continue;
+        }
+        if (cell->v.element.tag == GUMBO_TAG_TH && !header) {
+            header = cell;
+        }
+        else if (cell->v.element.tag == GUMBO_TAG_TD && !value) {
+            value = cell;
+        }
+    }
+    if (!header || !value) {
+        return;
+    }
+
+    spans.clear();
+    gatherText(header, spans);
+    TextKernels::normalizeSpans(spans, text);
+    bool upcRow = text == "UPC";
+    bool availabilityRow = text == "Availability";
+    if (!upcRow && !availabilityRow) {
+        return;
+    }
+
+    spans.clear();
+    gatherText(value, spans);
+    TextKernels::normalizeSpans(spans, text);
+    if (upcRow) {
+        book.upc = text;
+    }
+    else {
+        book.stockCount = parseStockCount(text);
+    }
+}
+
+// Home / Books / <category> / <title>, the category is the item before the title
+void HtmlParser::readBreadcrumb(GumboNode* list, BookData& book, vector<string_view>& spans, string& text) {
+    vector<GumboNode*> items;
+
+    GumboVector* children = &list->v.element.children;
+    for (unsigned int i = 0; i < children->length; ++i) {
+        GumboNode* child = static_cast<GumboNode*>(children->data[i]);
+        if (child->type == GUMBO_NODE_ELEMENT && child->v.element.tag == GUMBO_TAG_LI) {
+            items.push_back(child);
+        }
+    }
+    if (items.size() < 3) {
+        return;
+    }
+
+    spans.clear();
+    gatherText(items[items.size() - 2], spans);
+    TextKernels::normalizeSpans(spans, text);
+    book.category = text;
+}
+
+// Single walk over the product page for the table rows, the breadcrumb and
+// the <p> that follows <div id="product_description">
+void HtmlParser::searchProductPage(GumboNode* node, BookData& book, vector<string_view>& spans, string& text) {
+    if (node->type != GUMBO_NODE_ELEMENT) {
+        return;
+    }
+
+    static const CompoundSelector BREADCRUMB{ GUMBO_TAG_UL, { "breadcrumb" } };
+
+    if (node->v.element.tag == GUMBO_TAG_TR) {
+        readProductRow(node, book, spans, text);
+        return;
+    }
+    if (BREADCRUMB.matches(node)) {
+        readBreadcrumb(node, book, spans, text);
+        return;
+    }
+
+    bool descriptionNext = false;
+    GumboVector* children = &node->v.element.children;
+    for (unsigned int i = 0; i < children->length; ++i) {
+        GumboNode* child = static_cast<GumboNode*>(children->data[i]);
+        if (child->type != GUMBO_NODE_ELEMENT) {
+            continue;
+        }
+
+        if (descriptionNext && child->v.element.tag == GUMBO_TAG_P) {
+            spans.clear();
+            gatherText(child, spans);
+            TextKernels::normalizeSpans(spans, text);
+            book.description = text;
+            descriptionNext = false;
+            continue;
+        }
+
+        GumboAttribute* id = gumbo_get_attribute(&child->v.element.attributes, "id");
+        descriptionNext = id && strcmp(id->value, "product_description") == 0;
+
+        searchProductPage(child, book, spans, text);
+    }
+}
+
+bool HtmlParser::parseProductPage(const string& html_content, BookData& book) {
+    book.upc.clear();
+    book.stockCount = -1;
+    book.category.clear();
+    book.description.clear();
+
+    vector<string_view> spans;
+    string text;
+
+    GumboOutput* output = gumbo_parse(html_content.c_str());
+    searchProductPage(output->root, book, spans, text);
+    gumbo_destroy_output(&kGumboDefaultOptions, output);
+
+    return !book.upc.empty();
+}
+
+// "book_1/index.html" on http://host/catalogue/page-2.html ->
+// http://host/catalogue/book_1/index.html, with "." and ".." segments removed
+string HtmlParser::resolveUrl(const string& pageUrl, const string& link) {
+    if (link.compare(0, 7, "http://") == 0 || link.compare(0, 8, "https://") == 0) {
+        return link;
+    }
+
+    size_t scheme = pageUrl.find("://");
+    size_t pathStart = scheme == string::npos ? string::npos : pageUrl.find('/', scheme + 3);
+    string origin = pageUrl.substr(0, pathStart);
+
+    string path;
+    if (!link.empty() && link[0] == '/') {
+        path = link;
+    }
+    else {
+        string directory = pathStart == string::npos ? "/" : pageUrl.substr(pathStart, pageUrl.rfind('/') - pathStart + 1);
+        path = directory + link;
+    }
+
+    vector<string> segments;
+    size_t start = 1;
+    while (start <= path.size()) {
+        size_t slash = path.find('/', start);
+        string segment = path.substr(start, slash == string::npos ? string::npos : slash - start);
+
+        if (segment == "..") {
+            if (!segments.empty()) {
+                segments.pop_back();
+            }
+        }
+        else if (segment != "." && (!segment.empty() || slash == string::npos)) {
+            segments.push_back(segment);
+        }
+
+        if (slash == string::npos) {
+            break;
+        }
+        start = slash + 1;
+    }
+
+    string resolved = origin;
+    for (const auto& segment : segments) {
+        resolved += "/" + segment;
+    }
+    return resolved;
+}
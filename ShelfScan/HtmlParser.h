@@ -1,26 +1,57 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 #include <gumbo.h>
 #include "BookData.h"
+#include "ExtractionSchema.h"
 
 using namespace std;
 
+// "Page 2 of 50" and the link to the next page, numbers are 0 if absent
+struct PaginationInfo {
+    int current = 0;
+    int total = 0;
+    string nextLink;
+};
+
 class HtmlParser {
 public:
+    HtmlParser();
+
+    // Item and field rules used for book extraction
+    void setSchema(const ExtractionSchema& schema);
+
     vector<BookData> parseBooksFromHtml(const string& html_content);
-    vector<string> extractPageLinks(const string& html_content);
+    // Links come back absolute, resolved against pageUrl
+    vector<string> extractPageLinks(const string& html_content, const string& pageUrl);
+    void parsePage(const string& html_content, const string& pageUrl, vector<BookData>& books, vector<string>& links);
+
+    PaginationInfo parsePagination(const string& html_content);
+
+    // Fills UPC, stock count, category and description from a product page,
+    // false if the page has no UPC
+    bool parseProductPage(const string& html_content, BookData& book);
+
+    // Resolves a link against the URL of the page it was found on
+    static string resolveUrl(const string& pageUrl, const string& link);
 
 private:
-    string getTextContent(GumboNode* node);
-    GumboNode* findNodeByClass(GumboNode* node, const string& class_name);
-    GumboNode* findNodeByTag(GumboNode* node, GumboTag tag);
+    ExtractionSchema schema_;
+
+    void gatherText(GumboNode* node, vector<string_view>& spans);
 
     BookData parseBookFromNode(GumboNode* article_node);
-    void searchForBooks(GumboNode* node, vector<BookData>& books);
-    void searchForLinks(GumboNode* node, vector<string>& links);
+    void matchFields(GumboNode* node, vector<size_t>& progress, vector<GumboNode*>& matched, size_t& remaining);
+    void applyField(BookData& book, const FieldRule& rule, GumboNode* node, vector<string_view>& spans, string& text);
+    void searchForBooks(GumboNode* node, vector<BookData>& books, size_t progress);
+    void searchForLinks(GumboNode* node, const string& pageUrl, vector<string>& links);
+    void searchForPagination(GumboNode* node, PaginationInfo& info, vector<string_view>& spans, string& text);
+    void searchProductPage(GumboNode* node, BookData& book, vector<string_view>& spans, string& text);
+    void readProductRow(GumboNode* row, BookData& book, vector<string_view>& spans, string& text);
+    void readBreadcrumb(GumboNode* list, BookData& book, vector<string_view>& spans, string& text);
 
-    string cleanText(const string& text);
-    float parsePriceString(const string& price_text);
-    int parseStarRating(const string& rating_class);
+    int64_t parsePriceString(string_view price_text);
+    int parseStarRating(string_view rating_class);
+    int parseStockCount(string_view availability_text);
 };
\ No newline at end of file
@@ -2,9 +2,12 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <algorithm>
+#include <cctype>
 #include <curl/curl.h>
 
 using namespace std;
+using namespace std::chrono;
 
 size_t WriteCallback(void* contents, size_t size, size_t nmemb, string* data) {
     size_t totalSize = size * nmemb;
@@ -12,73 +15,301 @@ size_t WriteCallback(void* contents, size_t size, size_t nmemb, string* data) {
     return totalSize;
 }
 
-HttpDownloader::HttpDownloader() {
+size_t StreamCallback(void* contents, size_t size, size_t nmemb, const HttpDownloader::BodySink* sink) {
+    size_t totalSize = size * nmemb;
+    return (*sink)(static_cast<const char*>(contents), totalSize) ? totalSize : 0;
+}
+
+// Options shared by every request
+void setCommonOptions(CURL* curl, long maxTime) {
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);          // Follow redirects
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 10L);              // Max 10 redirects
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);          // 5 seconds for connection
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, maxTime);            // Max time for whole request
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);             // Fail on HTTP errors
+
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+}
+
+// Cuts a transfer off once the downloader is cancelled or the deadline passed
+struct TransferLimit {
+    const atomic<bool>* cancelled;
+    steady_clock::time_point deadline;
+};
+
+int ProgressCallback(TransferLimit* limit, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    return (limit->cancelled->load() || steady_clock::now() >= limit->deadline) ? 1 : 0;
+}
+
+// Picks ETag and Last-Modified out of the response headers
+size_t HeaderCallback(char* buffer, size_t size, size_t nitems, HttpResponse* response) {
+    size_t totalSize = size * nitems;
+    string line(buffer, totalSize);
+
+    // A new status line means a redirect, forget headers of the previous response
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        response->etag.clear();
+        response->lastModified.clear();
+        return totalSize;
+    }
+
+    size_t colon = line.find(':');
+    if (colon == string::npos) {
+        return totalSize;
+    }
+
+    string name = line.substr(0, colon);
+    transform(name.begin(), name.end(), name.begin(),
+        [](unsigned char ch) { return static_cast<char>(tolower(ch)); });
+
+    size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+    size_t valueEnd = line.find_last_not_of(" \t\r\n");
+    string value = (valueStart == string::npos || valueEnd < valueStart) ? "" : line.substr(valueStart, valueEnd - valueStart + 1);
+
+    if (name == "etag") {
+        response->etag = value;
+    }
+    else if (name == "last-modified") {
+        response->lastModified = value;
+    }
+
+    return totalSize;
+}
+
+HttpDownloader::HttpDownloader() : deadline_(TimePoint::max().time_since_epoch().count()) {
     curl_global_init(CURL_GLOBAL_DEFAULT);
 }
 
 HttpDownloader::~HttpDownloader() {
+    for (void* handle : handles_) {
+        if (handle) {
+            curl_easy_cleanup(handle);
+        }
+    }
     curl_global_cleanup();
 }
 
+// Handle of the calling thread with all options reset, the connection
+// cache survives the reset
+void* HttpDownloader::acquireHandle() {
+    void*& handle = handles_.local();
+    if (!handle) {
+        handle = curl_easy_init();
+        if (!handle) {
+            throw runtime_error("Failed to initialize libcurl");
+        }
+    }
+    else {
+        curl_easy_reset(handle);
+    }
+    return handle;
+}
+
 string HttpDownloader::download(const string& url) {
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        throw runtime_error("Failed to initialize libcurl");
+    return fetch(url).body;
+}
+
+void HttpDownloader::setDeadline(TimePoint deadline) {
+    deadline_ = deadline.time_since_epoch().count();
+}
+
+void HttpDownloader::clearDeadline() {
+    deadline_ = TimePoint::max().time_since_epoch().count();
+    cancelled_ = false;
+}
+
+void HttpDownloader::setUrlTimeout(milliseconds timeout) {
+    urlTimeout_ = timeout;
+}
+
+// Safe to call from any thread while requests are running
+void HttpDownloader::cancel() {
+    cancelled_ = true;
+}
+
+bool HttpDownloader::expired() const {
+    return cancelled_ || steady_clock::now().time_since_epoch().count() >= deadline_;
+}
+
+void HttpDownloader::resetBreakers() {
+    breakers_.clear();
+}
+
+// Crawl deadline, or the URL's own if that comes first
+HttpDownloader::TimePoint HttpDownloader::deadlineFor(TimePoint start) const {
+    TimePoint deadline{ steady_clock::duration(deadline_.load()) };
+    if (urlTimeout_.count() > 0) {
+        deadline = min(deadline, start + duration_cast<steady_clock::duration>(urlTimeout_));
     }
+    return deadline;
+}
 
-    string response_data;
-    CURLcode res;
+long HttpDownloader::perform(void* handle, const string& url, TimePoint deadline) {
+    CURL* curl = handle;
+    string host = CircuitBreaker::hostOf(url);
 
-    try {
+    if (cancelled_ || steady_clock::now() >= deadline) {
+        throw DeadlineExceeded("No time left for " + url);
+    }
+    if (!breakers_.allow(host)) {
+        throw HostUnavailable("Circuit breaker for " + host + " is open, skipped " + url);
+    }
 
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_data);
+    TransferLimit limit{ &cancelled_, deadline };
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &limit);
 
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);          // Follow redirects
-        curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 10L);              // Max 10 redirects
-        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 5L);          // 5 seconds for connection
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, MAX_TIME);           // Max time for whole request
-        curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);             // Fail on HTTP errors
+    // The callback runs only about once a second on a stalled transfer,
+    // curl's own timeout hits the deadline exactly
+    long long remainingMs = duration_cast<milliseconds>(deadline - steady_clock::now()).count();
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, static_cast<long>(max(1LL, min(remainingMs, MAX_TIME * 1000LL))));
 
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
-        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    CURLcode res = curl_easy_perform(curl);
 
-        res = curl_easy_perform(curl);
+    long statusCode = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &statusCode);
 
-        if (res != CURLE_OK) {
-            curl_easy_cleanup(curl);
-            throw runtime_error("HTTP request failed: " + string(curl_easy_strerror(res)));
-        }
+    // Cancelling or the end of the crawl isn't the host's doing, a transfer
+    // that ran into the URL's own timeout is: a host that only stalls has to
+    // trip its breaker even when the URL timeout is below MAX_TIME
+    if (res != CURLE_OK && expired()) {
+        breakers_.recordAborted(host);
+        throw DeadlineExceeded("Deadline reached during request for " + url);
+    }
+    if (res != CURLE_OK && steady_clock::now() >= deadline) {
+        breakers_.recordFailure(host);
+        throw DeadlineExceeded("URL timeout reached during request for " + url);
+    }
+
+    // Any answer but a server error means the host is up; an aborted body sink isn't the host's fault
+    bool hostFailed = (res != CURLE_OK && res != CURLE_HTTP_RETURNED_ERROR && res != CURLE_WRITE_ERROR) ||
+        statusCode >= 500 || statusCode == 429;
+    if (hostFailed) {
+        breakers_.recordFailure(host);
+    }
+    else {
+        breakers_.recordSuccess(host);
+    }
+
+    if (res != CURLE_OK) {
+        throw runtime_error("HTTP request failed: " + string(curl_easy_strerror(res)));
+    }
+    return statusCode;
+}
+
+HttpResponse HttpDownloader::fetch(const string& url, const string& etag, const string& lastModified) {
+    return fetchUntil(url, etag, lastModified, deadlineFor(steady_clock::now()));
+}
 
-        long response_code;
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+HttpResponse HttpDownloader::fetchUntil(const string& url, const string& etag, const string& lastModified, TimePoint deadline) {
+    CURL* curl = acquireHandle();
 
-        if (response_code >= 400) {
-            curl_easy_cleanup(curl);
-            throw runtime_error("HTTP error " + to_string(response_code) + " for URL: " + url);
+    HttpResponse response;
+    struct curl_slist* headers = nullptr;
+
+    try {
+
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response.body);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response);
+
+        // Conditional request, server answers 304 if the page didn't change
+        if (!etag.empty()) {
+            headers = curl_slist_append(headers, ("If-None-Match: " + etag).c_str());
+        }
+        if (!lastModified.empty()) {
+            headers = curl_slist_append(headers, ("If-Modified-Since: " + lastModified).c_str());
+        }
+        if (headers) {
+            curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
         }
 
-        curl_easy_cleanup(curl);
+        setCommonOptions(curl, MAX_TIME);
 
-        if (!isValidResponse(response_data)) {
-            throw runtime_error("Invalid HTTP response received from: " + url);
+        response.statusCode = perform(curl, url, deadline);
+
+        if (response.statusCode >= 400) {
+            throw runtime_error("HTTP error " + to_string(response.statusCode) + " for URL: " + url);
         }
 
-        return response_data;
+        if (!response.notModified() && !isValidResponse(response.body)) {
+            throw runtime_error("Invalid HTTP response received from: " + url);
+        }
 
     }
     catch (...) {
-        curl_easy_cleanup(curl);
+        curl_slist_free_all(headers);
         throw;
     }
+
+    curl_slist_free_all(headers);
+
+    return response;
+}
+
+long HttpDownloader::stream(const string& url, const BodySink& sink) {
+    return streamUntil(url, sink, deadlineFor(steady_clock::now()));
+}
+
+long HttpDownloader::streamUntil(const string& url, const BodySink& sink, TimePoint deadline) {
+    CURL* curl = acquireHandle();
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &sink);
+    setCommonOptions(curl, MAX_TIME);
+
+    return perform(curl, url, deadline);
+}
+
+long HttpDownloader::streamWithRetry(const string& url, const function<BodySink()>& openSink, int maxRetries) {
+    TimePoint deadline = deadlineFor(steady_clock::now());
+
+    for (int attempt = 1; attempt <= maxRetries; ++attempt) {
+        try {
+            return streamUntil(url, openSink(), deadline);
+        }
+        catch (const DeadlineExceeded&) {
+            throw;
+        }
+        catch (const HostUnavailable&) {
+            throw;
+        }
+        catch (const exception& e) {
+            cerr << "Download attempt " << attempt << " failed for " << url << ": " << e.what() << endl;
+
+            if (attempt == maxRetries) {
+                throw runtime_error("All " + to_string(maxRetries) + " download attempts failed for: " + url);
+            }
+
+            exponentialBackoff(attempt, deadline);
+        }
+    }
+    return 0;
 }
 
 string HttpDownloader::downloadWithRetry(const string& url, int maxRetries) {
+    return fetchWithRetry(url, "", "", maxRetries).body;
+}
+
+// Deadline and open breaker errors aren't retried, a retry couldn't succeed
+HttpResponse HttpDownloader::fetchWithRetry(const string& url, const string& etag, const string& lastModified, int maxRetries) {
+    TimePoint deadline = deadlineFor(steady_clock::now());
+
     for (int attempt = 1; attempt <= maxRetries; ++attempt) {
         try {
             cout << "Attempting download " << attempt << "/" << maxRetries << " for: " << url << endl;
-            return download(url);
+            return fetchUntil(url, etag, lastModified, deadline);
+        }
+        catch (const DeadlineExceeded&) {
+            throw;
+        }
+        catch (const HostUnavailable&) {
+            throw;
         }
         catch (const exception& e) {
             cerr << "Download attempt " << attempt << " failed for " << url << ": " << e.what() << endl;
@@ -87,16 +318,27 @@ string HttpDownloader::downloadWithRetry(const string& url, int maxRetries) {
                 throw runtime_error("All " + to_string(maxRetries) + " download attempts failed for: " + url);
             }
 
-            exponentialBackoff(attempt);
+            exponentialBackoff(attempt, deadline);
         }
     }
-    return "";
+    return HttpResponse();
 }
 
-void HttpDownloader::exponentialBackoff(int attempt) {
+// Gives up instead of waiting past the deadline, and wakes up early when cancelled
+void HttpDownloader::exponentialBackoff(int attempt, TimePoint deadline) {
     int waitTimeMs = (1 << attempt) * 1000;
+    TimePoint retryAt = steady_clock::now() + milliseconds(waitTimeMs);
+    if (retryAt >= deadline) {
+        throw DeadlineExceeded("No time left to retry");
+    }
+
     cout << "Waiting " << waitTimeMs / 1000.0 << "s before retry..." << endl;
-    this_thread::sleep_for(chrono::milliseconds(waitTimeMs));
+    while (steady_clock::now() < retryAt) {
+        if (cancelled_) {
+            throw DeadlineExceeded("Cancelled while waiting to retry");
+        }
+        this_thread::sleep_for(min<steady_clock::duration>(milliseconds(100), retryAt - steady_clock::now()));
+    }
 }
 
 bool HttpDownloader::isValidResponse(const string& content) {
@@ -1,5 +1,32 @@
 #pragma once
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
 #include <string>
+#include <tbb/enumerable_thread_specific.h>
+#include "CircuitBreaker.h"
+
+// Result of a (possibly conditional) HTTP request
+struct HttpResponse {
+    long statusCode = 0;
+    std::string body;
+    std::string etag;
+    std::string lastModified;
+
+    bool notModified() const { return statusCode == 304; }
+};
+
+// Request given up without (further) attempts: the crawl or URL deadline
+// passed, or the downloader was cancelled
+struct DeadlineExceeded : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Request not sent because the host's circuit breaker is open
+struct HostUnavailable : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
 
 class HttpDownloader {
 private:
@@ -13,7 +40,51 @@ public:
     std::string download(const std::string& url);
     std::string downloadWithRetry(const std::string& url, int max_retries = MAX_RETRIES);
 
+    // Sends If-None-Match / If-Modified-Since when validators are given,
+    // a 304 response comes back with an empty body
+    HttpResponse fetch(const std::string& url, const std::string& etag = "", const std::string& lastModified = "");
+    HttpResponse fetchWithRetry(const std::string& url, const std::string& etag = "", const std::string& lastModified = "", int max_retries = MAX_RETRIES);
+
+    // Hands the body to sink chunk by chunk as it arrives instead of buffering
+    // it, sink returns false to abort. Returns the status code, throws like fetch()
+    typedef std::function<bool(const char* data, size_t length)> BodySink;
+    long stream(const std::string& url, const BodySink& sink);
+    // stream() with fetchWithRetry's retries and backoff, all attempts within one
+    // URL timeout. openSink gives a fresh sink for every attempt.
+    long streamWithRetry(const std::string& url, const std::function<BodySink()>& openSink, int max_retries = MAX_RETRIES);
+
+    // Time limits: transfers still running at the crawl deadline are cut off
+    // and later requests fail at once; the URL timeout bounds one URL across
+    // all of its attempts and backoff waits. cancel() acts like a deadline
+    // that already passed, until clearDeadline().
+    void setDeadline(std::chrono::steady_clock::time_point deadline);
+    void clearDeadline();
+    void setUrlTimeout(std::chrono::milliseconds timeout);
+    void cancel();
+    bool expired() const;
+
+    const CircuitBreaker& breakers() const { return breakers_; }
+    void resetBreakers();
+
 private:
-    void exponentialBackoff(int attempt);
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    std::atomic<std::chrono::steady_clock::rep> deadline_;
+    std::atomic<bool> cancelled_{ false };
+    std::chrono::milliseconds urlTimeout_{ 0 };
+    CircuitBreaker breakers_;
+
+    TimePoint deadlineFor(TimePoint start) const;
+    HttpResponse fetchUntil(const std::string& url, const std::string& etag, const std::string& lastModified, TimePoint deadline);
+    long streamUntil(const std::string& url, const BodySink& sink, TimePoint deadline);
+    // Performs a request set up on curl, with the time limit and the host's breaker
+    long perform(void* curl, const std::string& url, TimePoint deadline);
+
+    // One curl handle (CURL*) per thread, reused between requests so
+    // connections and DNS lookups to the same host are kept
+    tbb::enumerable_thread_specific<void*> handles_;
+    void* acquireHandle();
+
+    void exponentialBackoff(int attempt, TimePoint deadline);
     bool isValidResponse(const std::string& content);
-};
\ No newline at end of file
+};
@@ -0,0 +1,113 @@
+#include "ImageStore.h"
+#include "Sha256.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+ImageStore::ImageStore(const string& root) : root_(root) {
+    fs::create_directories(fs::path(root_) / "tmp");
+}
+
+string ImageStore::pathFor(const string& hash) const {
+    return (fs::path(root_) / hash.substr(0, 2) / hash).string();
+}
+
+bool ImageStore::contains(const string& hash) const {
+    return !hash.empty() && fs::exists(pathFor(hash));
+}
+
+// Unique across threads and across shard processes sharing the directory
+string ImageStore::tempPath() {
+    static const unsigned processTag = random_device()();
+    return (fs::path(root_) / "tmp" / (to_string(processTag) + "-" + to_string(tempCounter_++) + ".part")).string();
+}
+
+string ImageStore::fetch(HttpDownloader& downloader, const string& url) {
+    // Books sharing a cover URL wait for the first download instead of repeating it
+    tbb::concurrent_hash_map<string, string>::accessor entry;
+    if (!fetchedUrls_.insert(entry, url)) {
+        return entry->second;
+    }
+
+    try {
+        entry->second = download(downloader, url);
+    }
+    catch (const DeadlineExceeded& e) {
+        cerr << "Image download given up for " << url << ": " << e.what() << endl;
+    }
+    catch (const HostUnavailable& e) {
+        cerr << "Image download skipped for " << url << ": " << e.what() << endl;
+    }
+    catch (const exception& e) {
+        cerr << "Image download failed for " << url << ": " << e.what() << endl;
+    }
+
+    return entry->second;
+}
+
+// Retried with the downloader's backoff, every attempt starts a new file and hash
+string ImageStore::download(HttpDownloader& downloader, const string& url) {
+    string temp = tempPath();
+    ofstream file;
+    Sha256 hasher;
+
+    long statusCode;
+    try {
+        statusCode = downloader.streamWithRetry(url, [&]() {
+            file.close();
+            file.open(temp, ios::binary | ios::trunc);
+            if (!file.is_open()) {
+                throw runtime_error("Cannot create " + temp);
+            }
+            hasher = Sha256();
+
+            return HttpDownloader::BodySink([&](const char* data, size_t length) {
+                hasher.update(data, length);
+                file.write(data, static_cast<streamsize>(length));
+                return static_cast<bool>(file);
+            });
+        });
+        file.close();
+    }
+    catch (...) {
+        file.close();
+        error_code error;
+        fs::remove(temp, error);
+        throw;
+    }
+
+    if (statusCode != 200) {
+        fs::remove(temp);
+        throw runtime_error("HTTP status " + to_string(statusCode));
+    }
+
+    string hash = hasher.finish();
+    fs::path target = pathFor(hash);
+
+    error_code error;
+    if (fs::exists(target)) {
+        fs::remove(temp, error);
+        duplicates_++;
+        return hash;
+    }
+
+    // Another thread or process may store the same bytes at the same time,
+    // any of the renames leaves the right content in place
+    fs::create_directories(target.parent_path());
+    fs::rename(temp, target, error);
+    if (error) {
+        fs::remove(temp, error);
+        if (!fs::exists(target)) {
+            throw runtime_error("Cannot store image as " + target.string());
+        }
+        duplicates_++;
+        return hash;
+    }
+
+    downloaded_++;
+    return hash;
+}
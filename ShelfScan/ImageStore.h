@@ -0,0 +1,34 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <tbb/concurrent_hash_map.h>
+#include "HttpDownloader.h"
+
+using namespace std;
+
+// Content-addressed store for downloaded cover images. A file is named by the
+// SHA-256 of its bytes (<root>/ab/abcdef...), so identical covers are written
+// once. Bodies stream from curl straight into a temp file while being hashed.
+class ImageStore {
+public:
+    explicit ImageStore(const string& root);
+
+    // Downloads url once per run, returns the content hash ("" on failure)
+    string fetch(HttpDownloader& downloader, const string& url);
+
+    bool contains(const string& hash) const;
+    string pathFor(const string& hash) const;
+
+    int downloaded() const { return downloaded_; }
+    int duplicates() const { return duplicates_; }
+
+private:
+    string root_;
+    tbb::concurrent_hash_map<string, string> fetchedUrls_;
+    atomic<unsigned> tempCounter_{ 0 };
+    atomic<int> downloaded_{ 0 };
+    atomic<int> duplicates_{ 0 };
+
+    string download(HttpDownloader& downloader, const string& url);
+    string tempPath();
+};
@@ -0,0 +1,183 @@
+#include "IpcChannel.h"
+#include <cstring>
+#include <cstdio>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+#define CLOSE_SOCKET closesocket
+static const SocketHandle INVALID_HANDLE = INVALID_SOCKET;
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define CLOSE_SOCKET ::close
+static const SocketHandle INVALID_HANDLE = -1;
+#endif
+
+// Don't get killed by SIGPIPE when the other side went away
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+using namespace std;
+
+// Winsock has to be started once per process before any socket call
+static void ensureSocketsInitialized() {
+#ifdef _WIN32
+    static bool initialized = [] {
+        WSADATA data;
+        if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+            throw runtime_error("WSAStartup failed");
+        }
+        return true;
+    }();
+    (void)initialized;
+#endif
+}
+
+static sockaddr_un makeAddress(const string& path) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(address.sun_path)) {
+        throw runtime_error("Socket path too long: " + path);
+    }
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+IpcChannel::IpcChannel() : handle_(INVALID_HANDLE) {
+}
+
+IpcChannel::IpcChannel(SocketHandle handle) : handle_(handle) {
+}
+
+IpcChannel::~IpcChannel() {
+    close();
+}
+
+IpcChannel::IpcChannel(IpcChannel&& other) noexcept
+    : handle_(other.handle_), buffer_(move(other.buffer_)) {
+    other.handle_ = INVALID_HANDLE;
+}
+
+IpcChannel& IpcChannel::operator=(IpcChannel&& other) noexcept {
+    if (this != &other) {
+        close();
+        handle_ = other.handle_;
+        buffer_ = move(other.buffer_);
+        other.handle_ = INVALID_HANDLE;
+    }
+    return *this;
+}
+
+IpcChannel IpcChannel::connectTo(const string& path) {
+    ensureSocketsInitialized();
+
+    SocketHandle handle = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (handle == INVALID_HANDLE) {
+        throw runtime_error("Cannot create socket");
+    }
+
+    sockaddr_un address = makeAddress(path);
+    if (connect(handle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        CLOSE_SOCKET(handle);
+        throw runtime_error("Cannot connect to " + path);
+    }
+
+    return IpcChannel(handle);
+}
+
+void IpcChannel::sendLine(const string& line) {
+    string message = line + "\n";
+    size_t sent = 0;
+
+    while (sent < message.size()) {
+        int n = send(handle_, message.data() + sent, static_cast<int>(message.size() - sent), SEND_FLAGS);
+        if (n <= 0) {
+            throw runtime_error("IPC send failed");
+        }
+        sent += static_cast<size_t>(n);
+    }
+}
+
+// Returns false once the other side closed the connection
+bool IpcChannel::receiveLine(string& line) {
+    while (true) {
+        size_t newline = buffer_.find('\n');
+        if (newline != string::npos) {
+            line = buffer_.substr(0, newline);
+            buffer_.erase(0, newline + 1);
+            return true;
+        }
+
+        char chunk[4096];
+        int n = recv(handle_, chunk, sizeof(chunk), 0);
+        if (n <= 0) {
+            return false;
+        }
+        buffer_.append(chunk, static_cast<size_t>(n));
+    }
+}
+
+bool IpcChannel::isOpen() const {
+    return handle_ != INVALID_HANDLE;
+}
+
+void IpcChannel::close() {
+    if (handle_ != INVALID_HANDLE) {
+        CLOSE_SOCKET(handle_);
+        handle_ = INVALID_HANDLE;
+    }
+}
+
+void IpcChannel::shutdown() {
+    if (handle_ != INVALID_HANDLE) {
+#ifdef _WIN32
+        ::shutdown(handle_, SD_BOTH);
+#else
+        ::shutdown(handle_, SHUT_RDWR);
+#endif
+    }
+}
+
+IpcListener::IpcListener(const string& path) : handle_(INVALID_HANDLE), path_(path) {
+    ensureSocketsInitialized();
+
+    // Leftover socket file from a crashed run would make bind fail
+    remove(path_.c_str());
+
+    handle_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (handle_ == INVALID_HANDLE) {
+        throw runtime_error("Cannot create socket");
+    }
+
+    sockaddr_un address = makeAddress(path_);
+    if (::bind(handle_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(handle_, 64) != 0) {
+        CLOSE_SOCKET(handle_);
+        throw runtime_error("Cannot listen on " + path_);
+    }
+}
+
+IpcListener::~IpcListener() {
+    if (handle_ != INVALID_HANDLE) {
+        CLOSE_SOCKET(handle_);
+    }
+    remove(path_.c_str());
+}
+
+IpcChannel IpcListener::accept() {
+    SocketHandle client = ::accept(handle_, nullptr, nullptr);
+    if (client == INVALID_HANDLE) {
+        throw runtime_error("Accept failed on " + path_);
+    }
+    return IpcChannel(client);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+#ifdef _WIN32
+typedef uintptr_t SocketHandle;
+#else
+typedef int SocketHandle;
+#endif
+
+// Line-oriented connection over a Unix domain socket
+// (AF_UNIX is available on Linux and on Windows 10+ through afunix.h)
+class IpcChannel {
+public:
+    IpcChannel();
+    explicit IpcChannel(SocketHandle handle);
+    ~IpcChannel();
+
+    IpcChannel(IpcChannel&& other) noexcept;
+    IpcChannel& operator=(IpcChannel&& other) noexcept;
+    IpcChannel(const IpcChannel&) = delete;
+    IpcChannel& operator=(const IpcChannel&) = delete;
+
+    static IpcChannel connectTo(const string& path);
+
+    void sendLine(const string& line);
+    bool receiveLine(string& line);
+    bool isOpen() const;
+    void close();
+    // Ends the connection both ways but keeps the handle, safe while another
+    // thread waits in receiveLine (which then returns false)
+    void shutdown();
+
+private:
+    SocketHandle handle_;
+    string buffer_;
+};
+
+// Listening end of a Unix domain socket, removes the socket file when destroyed
+class IpcListener {
+public:
+    explicit IpcListener(const string& path);
+    ~IpcListener();
+
+    IpcListener(const IpcListener&) = delete;
+    IpcListener& operator=(const IpcListener&) = delete;
+
+    IpcChannel accept();
+
+private:
+    SocketHandle handle_;
+    string path_;
+};
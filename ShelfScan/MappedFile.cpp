@@ -0,0 +1,111 @@
+#include "MappedFile.h"
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile::MappedFile() {
+}
+
+MappedFile::MappedFile(const string& path) : path_(path) {
+#ifdef _WIN32
+    // Share delete so the file can be replaced while a reader still has it mapped
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw runtime_error("Cannot open " + path);
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        throw runtime_error("Cannot read size of " + path);
+    }
+    size_ = static_cast<size_t>(size.QuadPart);
+
+    if (size_ > 0) {
+        mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_) {
+            data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        }
+    }
+    CloseHandle(file);
+
+    if (size_ > 0 && !data_) {
+        unmap();
+        throw runtime_error("Cannot map " + path);
+    }
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        throw runtime_error("Cannot open " + path);
+    }
+
+    struct stat info;
+    if (fstat(file, &info) != 0) {
+        ::close(file);
+        throw runtime_error("Cannot read size of " + path);
+    }
+    size_ = static_cast<size_t>(info.st_size);
+
+    if (size_ > 0) {
+        void* address = mmap(nullptr, size_, PROT_READ, MAP_SHARED, file, 0);
+        if (address == MAP_FAILED) {
+            ::close(file);
+            throw runtime_error("Cannot map " + path);
+        }
+        data_ = static_cast<const char*>(address);
+    }
+    ::close(file);
+#endif
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        unmap();
+        path_ = move(other.path_);
+        data_ = exchange(other.data_, nullptr);
+        size_ = exchange(other.size_, 0);
+#ifdef _WIN32
+        mapping_ = exchange(other.mapping_, nullptr);
+#endif
+    }
+    return *this;
+}
+
+void MappedFile::unmap() {
+#ifdef _WIN32
+    if (data_) {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_) {
+        CloseHandle(mapping_);
+    }
+    mapping_ = nullptr;
+#else
+    if (data_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+// Read-only memory mapping of a whole file. An empty file maps to no data.
+// The size is fixed at mapping time, bytes appended later aren't visible.
+class MappedFile {
+public:
+    MappedFile();
+    explicit MappedFile(const string& path);
+    ~MappedFile();
+
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    const string& path() const { return path_; }
+
+private:
+    string path_;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    void* mapping_ = nullptr;
+#endif
+
+    void unmap();
+};
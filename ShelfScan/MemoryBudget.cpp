@@ -0,0 +1,43 @@
+#include "MemoryBudget.h"
+#include <tbb/task_arena.h>
+
+using namespace std;
+
+void MemoryBudget::setLimit(size_t bytes) {
+    limit_ = bytes;
+}
+
+bool MemoryBudget::exceeded() const {
+    return limit_ > 0 && total_ > limit_;
+}
+
+void MemoryBudget::reserve(MemoryUse use, size_t bytes) {
+    used_[static_cast<int>(use)] += bytes;
+    size_t total = total_ += bytes;
+
+    size_t peak = peak_;
+    while (total > peak && !peak_.compare_exchange_weak(peak, total)) {
+    }
+}
+
+void MemoryBudget::release(MemoryUse use, size_t bytes) {
+    used_[static_cast<int>(use)] -= bytes;
+    total_ -= bytes;
+
+    if (limit_ > 0) {
+        // Taking the lock orders this with a waiter checking the condition
+        { lock_guard<mutex> lock(mutex_); }
+        roomAvailable_.notify_all();
+    }
+}
+
+void MemoryBudget::waitForRoom() {
+    // With a single thread nobody else could parse the buffered pages
+    if (!exceeded() || tbb::this_task_arena::max_concurrency() < 2) {
+        return;
+    }
+
+    throttled_++;
+    unique_lock<mutex> lock(mutex_);
+    roomAvailable_.wait(lock, [this] { return !exceeded() || used(MemoryUse::PageBuffers) == 0; });
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+using namespace std;
+
+enum class MemoryUse { PageBuffers, Books, Urls, PageCache, Sort };
+
+// Approximate bytes held by the crawl, split by what holds them. With a limit
+// set, downloads are throttled and stored books spill to disk when the total
+// goes over it. A limit of 0 means unlimited (only accounting is done).
+class MemoryBudget {
+public:
+    void setLimit(size_t bytes);
+    size_t limit() const { return limit_; }
+
+    void reserve(MemoryUse use, size_t bytes);
+    void release(MemoryUse use, size_t bytes);
+
+    size_t used() const { return total_; }
+    size_t used(MemoryUse use) const { return used_[static_cast<int>(use)]; }
+    size_t peak() const { return peak_; }
+    bool exceeded() const;
+
+    // Blocks while over budget and page buffers are still held; those are
+    // released after parsing, so waiting always makes progress
+    void waitForRoom();
+    int throttled() const { return throttled_; }
+
+private:
+    static const int USE_COUNT = 5;
+
+    size_t limit_ = 0;
+    atomic<size_t> used_[USE_COUNT] = {};
+    atomic<size_t> total_{ 0 };
+    atomic<size_t> peak_{ 0 };
+    atomic<int> throttled_{ 0 };
+
+    mutex mutex_;
+    condition_variable roomAvailable_;
+};
@@ -0,0 +1,232 @@
+#include "PageCache.h"
+#include "BookSerializer.h"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <unordered_set>
+
+using namespace std;
+
+static const char* CACHE_MAGIC = "SHELFSCAN-CACHE 2";
+
+// 64-bit FNV-1a, good enough to tell whether a page body changed
+uint64_t PageCache::hashContent(const string& content) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char ch : content) {
+        hash ^= ch;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool PageCache::load(const string& filename) {
+    ifstream file(filename);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    string line;
+    if (!getline(file, line) || line != CACHE_MAGIC) {
+        cerr << "Ignoring page cache with unknown format: " << filename << endl;
+        return false;
+    }
+
+    // Each page is stored as:
+    // P <url> <hash> <etag> <last-modified> <book count> <link count>
+    // followed by one line per book and one line per link. Product pages
+    // start with D instead and have one book, their parsed fields.
+    while (getline(file, line)) {
+        if (line.empty() || (line[0] != 'P' && line[0] != 'D')) {
+            continue;
+        }
+
+        istringstream header(line.substr(2));
+        string url, hashHex, etag, lastModified, bookCount, linkCount;
+        getline(header, url, '\t');
+        getline(header, hashHex, '\t');
+        getline(header, etag, '\t');
+        getline(header, lastModified, '\t');
+        getline(header, bookCount, '\t');
+        getline(header, linkCount, '\t');
+
+        PageCacheEntry entry;
+        entry.productPage = line[0] == 'D';
+        try {
+            entry.contentHash = stoull(hashHex, nullptr, 16);
+            entry.etag = BookSerializer::unescapeField(etag);
+            entry.lastModified = BookSerializer::unescapeField(lastModified);
+
+            int books = stoi(bookCount);
+            for (int i = 0; i < books; ++i) {
+                BookData book;
+                if (!BookSerializer::readBook(file, book)) {
+                    throw runtime_error("truncated book list");
+                }
+                entry.books.push_back(book);
+            }
+
+            int links = stoi(linkCount);
+            for (int i = 0; i < links && getline(file, line); ++i) {
+                entry.links.push_back(BookSerializer::unescapeField(line));
+            }
+        }
+        catch (const exception& e) {
+            cerr << "Corrupted page cache entry for " << url << ": " << e.what() << endl;
+            entries_.clear();
+            return false;
+        }
+
+        EntryMap::accessor acc;
+        entries_.insert(acc, BookSerializer::unescapeField(url));
+        acc->second = move(entry);
+    }
+
+    cout << "Loaded page cache with " << entries_.size() << " pages from " << filename << endl;
+    return true;
+}
+
+void PageCache::writeEntry(ostream& out, const string& url, const PageCacheEntry& entry, const vector<BookData>& books) {
+    out << (entry.productPage ? "D " : "P ") << BookSerializer::escapeField(url) << '\t'
+        << hex << entry.contentHash << dec << '\t'
+        << BookSerializer::escapeField(entry.etag) << '\t'
+        << BookSerializer::escapeField(entry.lastModified) << '\t'
+        << books.size() << '\t'
+        << entry.links.size() << "\n";
+
+    for (const auto& book : books) {
+        BookSerializer::writeBook(out, book);
+    }
+    for (const auto& link : entry.links) {
+        out << BookSerializer::escapeField(link) << "\n";
+    }
+}
+
+void PageCache::save(const string& filename) const {
+    ofstream file(filename);
+    if (!file.is_open()) {
+        throw runtime_error("Cannot open file: " + filename);
+    }
+
+    file << CACHE_MAGIC << "\n";
+
+    for (const auto& pair : entries_) {
+        writeEntry(file, pair.first, pair.second, pair.second.books);
+    }
+}
+
+void PageCache::save(const string& filename, const BookStore& store) const {
+    ofstream file(filename);
+    if (!file.is_open()) {
+        throw runtime_error("Cannot open file: " + filename);
+    }
+
+    file << CACHE_MAGIC << "\n";
+
+    unordered_set<string> written;
+    store.forEachPage([&](const string& url, const vector<BookData>& books) {
+        EntryMap::const_accessor acc;
+        if (entries_.find(acc, url) && written.insert(url).second) {
+            writeEntry(file, url, acc->second, books);
+        }
+    });
+
+    // Link-only pages and pages kept from the previous run
+    for (const auto& pair : entries_) {
+        if (written.count(pair.first) == 0) {
+            writeEntry(file, pair.first, pair.second, pair.second.books);
+        }
+    }
+}
+
+size_t PageCache::memoryBytes() const {
+    size_t bytes = 0;
+    for (const auto& pair : entries_) {
+        bytes += sizeof(PageCacheEntry) + pair.first.size() + pair.second.etag.size() + pair.second.lastModified.size();
+        for (const auto& book : pair.second.books) {
+            bytes += BookStore::bytesOf(book);
+        }
+        for (const auto& link : pair.second.links) {
+            bytes += sizeof(string) + link.size();
+        }
+    }
+    return bytes;
+}
+
+bool PageCache::lookup(const string& url, PageCacheEntry& entry) const {
+    EntryMap::const_accessor acc;
+    if (!entries_.find(acc, url)) {
+        return false;
+    }
+    entry = acc->second;
+    return true;
+}
+
+void PageCache::store(const string& url, const PageCacheEntry& entry) {
+    EntryMap::accessor acc;
+    entries_.insert(acc, url);
+    acc->second = entry;
+}
+
+void PageCache::storeValidators(const string& url, uint64_t contentHash, const string& etag, const string& lastModified) {
+    EntryMap::accessor acc;
+    entries_.insert(acc, url);
+    acc->second.contentHash = contentHash;
+    acc->second.etag = etag;
+    acc->second.lastModified = lastModified;
+}
+
+void PageCache::storeBooks(const string& url, const vector<BookData>& books) {
+    EntryMap::accessor acc;
+    entries_.insert(acc, url);
+    acc->second.books = books;
+}
+
+void PageCache::storeDetails(const string& url, const BookData& details) {
+    EntryMap::accessor acc;
+    entries_.insert(acc, url);
+    acc->second.books.assign(1, details);
+    acc->second.productPage = true;
+}
+
+void PageCache::storeLinks(const string& url, const vector<string>& links) {
+    EntryMap::accessor acc;
+    entries_.insert(acc, url);
+    acc->second.links = links;
+}
+
+vector<BookData> PageCache::allBooks() const {
+    vector<BookData> books;
+    for (const auto& pair : entries_) {
+        if (!pair.second.productPage) {
+            books.insert(books.end(), pair.second.books.begin(), pair.second.books.end());
+        }
+    }
+    return books;
+}
+
+// Books of all pages except the given ones (e.g. pages that failed this run)
+vector<BookData> PageCache::allBooksExcept(const tbb::concurrent_unordered_set<string>& skippedUrls) const {
+    vector<BookData> books;
+    for (const auto& pair : entries_) {
+        if (!pair.second.productPage && skippedUrls.count(pair.first) == 0) {
+            books.insert(books.end(), pair.second.books.begin(), pair.second.books.end());
+        }
+    }
+    return books;
+}
+
+size_t PageCache::size() const {
+    return entries_.size();
+}
+
+bool PageCache::empty() const {
+    return entries_.empty();
+}
+
+void PageCache::clear() {
+    entries_.clear();
+}
+
+void PageCache::swap(PageCache& other) {
+    entries_.swap(other.entries_);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <tbb/concurrent_hash_map.h>
+#include <tbb/concurrent_unordered_set.h>
+#include "BookData.h"
+#include "BookStore.h"
+
+using namespace std;
+
+// What we remember about a page between runs
+struct PageCacheEntry {
+    uint64_t contentHash = 0;
+    string etag;
+    string lastModified;
+    vector<BookData> books;
+    vector<string> links;
+    // Product page: books holds the one book's fields parsed from it, which
+    // aren't listed books of the catalogue
+    bool productPage = false;
+};
+
+// Per-URL cache of page validators (ETag / Last-Modified / content hash)
+// together with the books and links extracted from the page, so unchanged
+// pages can be skipped on the next run without re-parsing them.
+class PageCache {
+public:
+    bool load(const string& filename);
+    void save(const string& filename) const;
+    // Books of pages found in the store are taken from there
+    void save(const string& filename, const BookStore& store) const;
+
+    bool lookup(const string& url, PageCacheEntry& entry) const;
+    void store(const string& url, const PageCacheEntry& entry);
+    void storeValidators(const string& url, uint64_t contentHash, const string& etag, const string& lastModified);
+    void storeBooks(const string& url, const vector<BookData>& books);
+    void storeDetails(const string& url, const BookData& details);
+    void storeLinks(const string& url, const vector<string>& links);
+
+    // Listed books, product pages are left out
+    vector<BookData> allBooks() const;
+    vector<BookData> allBooksExcept(const tbb::concurrent_unordered_set<string>& skippedUrls) const;
+    size_t size() const;
+    bool empty() const;
+    void clear();
+    void swap(PageCache& other);
+
+    static uint64_t hashContent(const string& content);
+
+    // Rough bytes held, for the memory budget
+    size_t memoryBytes() const;
+
+private:
+    typedef tbb::concurrent_hash_map<string, PageCacheEntry> EntryMap;
+    EntryMap entries_;
+
+    static void writeEntry(ostream& out, const string& url, const PageCacheEntry& entry, const vector<BookData>& books);
+};
@@ -0,0 +1,37 @@
+#include "PriceHistogram.h"
+#include <sstream>
+
+using namespace std;
+
+PriceHistogram::PriceHistogram() : counts_(BUCKET_COUNT + 1, 0) {
+}
+
+void PriceHistogram::add(float price) {
+    int index = price <= 0 ? 0 : static_cast<int>(price / BUCKET_WIDTH);
+    if (index > BUCKET_COUNT) {
+        index = BUCKET_COUNT;
+    }
+    counts_[index]++;
+}
+
+void PriceHistogram::merge(const PriceHistogram& other) {
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        counts_[i] += other.counts_[i];
+    }
+}
+
+string PriceHistogram::serialize() const {
+    ostringstream oss;
+    for (size_t i = 0; i < counts_.size(); ++i) {
+        oss << (i > 0 ? " " : "") << counts_[i];
+    }
+    return oss.str();
+}
+
+PriceHistogram PriceHistogram::deserialize(const string& text) {
+    PriceHistogram histogram;
+    istringstream iss(text);
+    for (size_t i = 0; i < histogram.counts_.size() && (iss >> histogram.counts_[i]); ++i) {
+    }
+    return histogram;
+}
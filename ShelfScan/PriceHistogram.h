@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Price counts in fixed 5 GBP buckets from 0 to 100, plus one overflow bucket
+class PriceHistogram {
+public:
+    static const int BUCKET_COUNT = 20;
+    static constexpr float BUCKET_WIDTH = 5.0f;
+
+    PriceHistogram();
+
+    void add(float price);
+    void merge(const PriceHistogram& other);
+
+    // Index BUCKET_COUNT is the overflow bucket (>= 100)
+    uint64_t bucket(int index) const { return counts_[index]; }
+    float bucketStart(int index) const { return index * BUCKET_WIDTH; }
+
+    string serialize() const;
+    static PriceHistogram deserialize(const string& text);
+
+private:
+    vector<uint64_t> counts_;
+};
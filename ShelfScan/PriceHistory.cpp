@@ -0,0 +1,574 @@
+#include "PriceHistory.h"
+#include "DataAnalyzer.h"
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/blocked_range.h>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static_assert(sizeof(HistoryRecord) == 32, "History log records must stay 32 bytes");
+
+static string toLower(string text) {
+    transform(text.begin(), text.end(), text.begin(),
+        [](unsigned char ch) { return static_cast<char>(tolower(ch)); });
+    return text;
+}
+
+static bool hasAffixes(const string& name, const string& prefix, const string& suffix) {
+    return name.size() > prefix.size() + suffix.size() &&
+        name.compare(0, prefix.size(), prefix) == 0 &&
+        name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+PriceHistory::PriceHistory(const string& directory) : directory_(directory) {
+    load();
+}
+
+PriceHistory::~PriceHistory() {
+    if (compactor_.joinable()) {
+        compactor_.join();
+    }
+}
+
+string PriceHistory::logPath(uint64_t generation) const {
+    return (fs::path(directory_) / ("log-" + to_string(generation) + ".bin")).string();
+}
+
+string PriceHistory::segmentPath(uint64_t first, uint64_t last) const {
+    return (fs::path(directory_) / ("segment-" + to_string(first) + "-" + to_string(last) + ".bin")).string();
+}
+
+// Picks up where the last process stopped: segments made redundant by a merge
+// and logs already compacted are deleted, a torn record at the end of a file
+// is cut off, and logs sealed but never compacted are compacted now
+void PriceHistory::load() {
+    fs::create_directories(directory_);
+    loadKeys();
+
+    vector<shared_ptr<const HistorySegment>> found;
+    vector<uint64_t> logs;
+
+    for (const auto& entry : fs::directory_iterator(directory_)) {
+        string name = entry.path().filename().string();
+
+        if (hasAffixes(name, "segment-", ".bin")) {
+            try {
+                found.push_back(make_shared<const HistorySegment>(entry.path().string()));
+            }
+            catch (const exception& e) {
+                cerr << "History: ignoring " << e.what() << endl;
+            }
+        }
+        else if (hasAffixes(name, "log-", ".bin")) {
+            logs.push_back(stoull(name.substr(4, name.size() - 8)));
+        }
+        else if (hasAffixes(name, "segment-", ".tmp")) {
+            error_code error;
+            fs::remove(entry.path(), error);
+        }
+    }
+
+    // Widest first among segments starting at the same generation
+    sort(found.begin(), found.end(), [](const shared_ptr<const HistorySegment>& a, const shared_ptr<const HistorySegment>& b) {
+        return a->firstGeneration() != b->firstGeneration()
+            ? a->firstGeneration() < b->firstGeneration()
+            : a->lastGeneration() > b->lastGeneration();
+    });
+
+    uint64_t covered = 0;
+    vector<string> redundant;
+    for (auto& segment : found) {
+        if (segment->lastGeneration() <= covered) {
+            redundant.push_back(segment->path());
+            segment.reset();
+            continue;
+        }
+        covered = segment->lastGeneration();
+        segments_.push_back(segment);
+    }
+
+    sort(logs.begin(), logs.end());
+    generation_ = max(covered + 1, logs.empty() ? 0 : logs.back());
+    for (uint64_t generation : logs) {
+        if (generation <= covered) {
+            redundant.push_back(logPath(generation));
+        }
+        else if (generation < generation_) {
+            sealedLogs_.push_back(generation);
+        }
+    }
+
+    for (const auto& path : redundant) {
+        error_code error;
+        fs::remove(path, error);
+    }
+
+    string active = logPath(generation_);
+    if (fs::exists(active)) {
+        uintmax_t size = fs::file_size(active);
+        if (size % sizeof(HistoryRecord) != 0) {
+            fs::resize_file(active, size - size % sizeof(HistoryRecord));
+        }
+        logRecords_ = static_cast<size_t>(size / sizeof(HistoryRecord));
+    }
+
+    log_.open(active, ios::binary | ios::app);
+    if (!log_.is_open()) {
+        throw runtime_error("Cannot open history log: " + active);
+    }
+
+    startCompaction();
+}
+
+// keys.bin: per book the key and title, both prefixed with their uint32 length
+void PriceHistory::loadKeys() {
+    string path = (fs::path(directory_) / "keys.bin").string();
+    uintmax_t validBytes = 0;
+
+    {
+        ifstream file(path, ios::binary);
+        uint32_t length;
+        string key, title;
+
+        while (file.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+            key.resize(length);
+            if (!file.read(&key[0], length) || !file.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+                break;
+            }
+            title.resize(length);
+            if (!file.read(&title[0], length)) {
+                break;
+            }
+
+            keyIds_.emplace(key, static_cast<uint32_t>(keys_.size()));
+            keys_.push_back(key);
+            titles_.push_back(title);
+            validBytes = static_cast<uintmax_t>(file.tellg());
+        }
+    }
+
+    if (fs::exists(path) && fs::file_size(path) != validBytes) {
+        fs::resize_file(path, validBytes);
+    }
+
+    keyFile_.open(path, ios::binary | ios::app);
+    if (!keyFile_.is_open()) {
+        throw runtime_error("Cannot open history keys: " + path);
+    }
+}
+
+uint32_t PriceHistory::keyIdFor(const string& key, const string& title) {
+    auto it = keyIds_.find(key);
+    if (it != keyIds_.end()) {
+        return it->second;
+    }
+
+    uint32_t id = static_cast<uint32_t>(keys_.size());
+    keyIds_.emplace(key, id);
+    keys_.push_back(key);
+    titles_.push_back(title);
+
+    uint32_t length = static_cast<uint32_t>(key.size());
+    keyFile_.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    keyFile_.write(key.data(), length);
+    length = static_cast<uint32_t>(title.size());
+    keyFile_.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    keyFile_.write(title.data(), length);
+    return id;
+}
+
+HistoryRecord PriceHistory::observe(const BookData& book, uint32_t keyId, int64_t time) {
+    HistoryRecord record;
+    record.keyId = keyId;
+    record.time = time;
+    record.pricePence = book.priceMinor;
+    record.stockCount = book.stockCount;
+    record.inStock = toLower(book.availability).find("in stock") != string::npos ? 1 : 0;
+    return record;
+}
+
+void PriceHistory::record(const BookStore& books, int64_t time) {
+    lock_guard<mutex> lock(mutex_);
+
+    vector<HistoryRecord> records;
+    records.reserve(books.size());
+    books.forEachSegment([&](const BookSegment& segment) {
+        for (const auto& book : segment) {
+            records.push_back(observe(book, keyIdFor(DataAnalyzer::bookKey(book), book.title), time));
+        }
+    });
+    append(records);
+}
+
+void PriceHistory::record(const vector<BookData>& books, int64_t time) {
+    lock_guard<mutex> lock(mutex_);
+
+    vector<HistoryRecord> records;
+    records.reserve(books.size());
+    for (const auto& book : books) {
+        records.push_back(observe(book, keyIdFor(DataAnalyzer::bookKey(book), book.title), time));
+    }
+    append(records);
+}
+
+// Keys go to disk before the records that use them
+void PriceHistory::append(const vector<HistoryRecord>& records) {
+    keyFile_.flush();
+    log_.write(reinterpret_cast<const char*>(records.data()), static_cast<streamsize>(records.size() * sizeof(HistoryRecord)));
+    log_.flush();
+    if (!keyFile_ || !log_) {
+        throw runtime_error("Cannot write price history in " + directory_);
+    }
+    logRecords_ += records.size();
+
+    if (logRecords_ >= COMPACT_RECORDS && !compacting_) {
+        sealLog();
+    }
+    startCompaction();
+}
+
+void PriceHistory::sealLog() {
+    log_.close();
+    sealedLogs_.push_back(generation_);
+    generation_++;
+    logRecords_ = 0;
+
+    log_.open(logPath(generation_), ios::binary | ios::app);
+    if (!log_.is_open()) {
+        throw runtime_error("Cannot open history log: " + logPath(generation_));
+    }
+}
+
+// Called with the lock held. The previous compactor has passed its last use
+// of the lock once compacting_ is false, so joining it here can't deadlock.
+void PriceHistory::startCompaction() {
+    if (compacting_ || sealedLogs_.empty()) {
+        return;
+    }
+    if (compactor_.joinable()) {
+        compactor_.join();
+    }
+
+    // Size-tiered: newest segments are folded in while the next older one is
+    // no bigger than all of them together, so old data is rewritten only
+    // a logarithmic number of times
+    vector<shared_ptr<const HistorySegment>> inputs;
+    if (segments_.size() >= MAX_SEGMENTS) {
+        uint64_t rows = 0;
+        size_t first = segments_.size();
+        while (first > 0 && (segments_.size() - first < 2 || segments_[first - 1]->rowCount() <= rows)) {
+            first--;
+            rows += segments_[first]->rowCount();
+        }
+        inputs.assign(segments_.begin() + first, segments_.end());
+    }
+
+    compacting_ = true;
+    compactor_ = thread(&PriceHistory::compact, this, sealedLogs_, inputs);
+}
+
+void PriceHistory::compact(vector<uint64_t> generations, vector<shared_ptr<const HistorySegment>> inputs) {
+    vector<string> obsolete;
+
+    try {
+        vector<HistoryRecord> rows;
+        for (const auto& segment : inputs) {
+            auto segmentRows = segment->allRows();
+            rows.insert(rows.end(), segmentRows.begin(), segmentRows.end());
+        }
+        for (uint64_t generation : generations) {
+            MappedFile log(logPath(generation));
+            size_t count = recordsIn(log);
+            for (size_t i = 0; i < count; ++i) {
+                rows.push_back(recordAt(log, i));
+            }
+        }
+
+        uint64_t first = inputs.empty() ? generations.front() : inputs.front()->firstGeneration();
+        uint64_t last = generations.back();
+        string path = segmentPath(first, last);
+
+        HistorySegment::write(path, rows, first, last);
+        auto segment = make_shared<const HistorySegment>(path);
+
+        {
+            lock_guard<mutex> lock(mutex_);
+            for (const auto& input : inputs) {
+                segments_.erase(remove(segments_.begin(), segments_.end(), input), segments_.end());
+                obsolete.push_back(input->path());
+            }
+            segments_.push_back(segment);
+            sort(segments_.begin(), segments_.end(), [](const shared_ptr<const HistorySegment>& a, const shared_ptr<const HistorySegment>& b) {
+                return a->firstGeneration() < b->firstGeneration();
+            });
+
+            for (uint64_t generation : generations) {
+                sealedLogs_.erase(remove(sealedLogs_.begin(), sealedLogs_.end(), generation), sealedLogs_.end());
+                obsolete.push_back(logPath(generation));
+            }
+        }
+
+        cout << "History: compacted " << rows.size() << " observations into " << path
+            << " (" << fs::file_size(path) / 1024 << " KB)" << endl;
+    }
+    catch (const exception& e) {
+        cerr << "History compaction failed: " << e.what() << endl;
+    }
+
+    // A query may still map an obsolete file; where it can't be removed
+    // now, the next load() removes it
+    inputs.clear();
+    for (const auto& path : obsolete) {
+        error_code error;
+        fs::remove(path, error);
+    }
+
+    lock_guard<mutex> lock(mutex_);
+    compacting_ = false;
+}
+
+PriceHistory::Snapshot PriceHistory::snapshot() const {
+    lock_guard<mutex> lock(mutex_);
+
+    Snapshot snap;
+    snap.segments = segments_;
+
+    vector<uint64_t> generations = sealedLogs_;
+    generations.push_back(generation_);
+    for (uint64_t generation : generations) {
+        string path = logPath(generation);
+        if (fs::exists(path)) {
+            snap.logs.push_back(make_shared<const MappedFile>(path));
+        }
+    }
+    return snap;
+}
+
+size_t PriceHistory::recordsIn(const MappedFile& log) {
+    return log.size() / sizeof(HistoryRecord);
+}
+
+HistoryRecord PriceHistory::recordAt(const MappedFile& log, size_t index) {
+    HistoryRecord record;
+    memcpy(&record, log.data() + index * sizeof(HistoryRecord), sizeof(HistoryRecord));
+    return record;
+}
+
+vector<PricePoint> PriceHistory::history(const string& key) const {
+    uint32_t keyId;
+    {
+        lock_guard<mutex> lock(mutex_);
+        auto it = keyIds_.find(key);
+        if (it == keyIds_.end()) {
+            return {};
+        }
+        keyId = it->second;
+    }
+
+    Snapshot snap = snapshot();
+    size_t segmentCount = snap.segments.size();
+    vector<vector<HistoryRecord>> found(segmentCount + snap.logs.size());
+
+    tbb::parallel_for(size_t(0), found.size(), [&](size_t i) {
+        if (i < segmentCount) {
+            HistorySegment::Run run;
+            if (snap.segments[i]->findRun(keyId, run)) {
+                snap.segments[i]->decode(run, found[i]);
+            }
+            return;
+        }
+
+        const MappedFile& log = *snap.logs[i - segmentCount];
+        size_t count = recordsIn(log);
+        for (size_t r = 0; r < count; ++r) {
+            HistoryRecord record = recordAt(log, r);
+            if (record.keyId == keyId) {
+                found[i].push_back(record);
+            }
+        }
+    });
+
+    vector<PricePoint> points;
+    for (const auto& rows : found) {
+        for (const auto& row : rows) {
+            points.push_back(PricePoint{ row.time, row.pricePence, row.stockCount, row.inStock != 0 });
+        }
+    }
+    sort(points.begin(), points.end(), [](const PricePoint& a, const PricePoint& b) { return a.time < b.time; });
+    return points;
+}
+
+namespace {
+
+    struct Observation {
+        int64_t time;
+        int64_t pence;
+    };
+
+    // Per book: last price at or before the window start, first and last inside it
+    struct ChangeSummary {
+        Observation before{ INT64_MIN, 0 };
+        Observation first{ INT64_MAX, 0 };
+        Observation last{ INT64_MIN, 0 };
+
+        void observe(int64_t time, int64_t pence, int64_t windowStart) {
+            if (time <= windowStart) {
+                if (time > before.time) {
+                    before = Observation{ time, pence };
+                }
+                return;
+            }
+            if (time < first.time) {
+                first = Observation{ time, pence };
+            }
+            if (time > last.time) {
+                last = Observation{ time, pence };
+            }
+        }
+
+        void merge(const ChangeSummary& other, int64_t windowStart) {
+            if (other.before.time != INT64_MIN) {
+                observe(other.before.time, other.before.pence, windowStart);
+            }
+            if (other.first.time != INT64_MAX) {
+                observe(other.first.time, other.first.pence, windowStart);
+            }
+            if (other.last.time != INT64_MIN) {
+                observe(other.last.time, other.last.pence, windowStart);
+            }
+        }
+    };
+
+    typedef unordered_map<uint32_t, ChangeSummary> ChangeMap;
+
+}
+
+// Runs entirely before or after the window start are summed up from the
+// segment directory; only runs crossing it are decoded
+vector<PriceChange> PriceHistory::priceChanges(double minFraction, int days, int64_t now) const {
+    int64_t windowStart = now - static_cast<int64_t>(days) * 86400;
+
+    Snapshot snap = snapshot();
+    size_t segmentCount = snap.segments.size();
+    size_t sourceCount = segmentCount + snap.logs.size();
+
+    ChangeMap summaries = tbb::parallel_reduce(
+        tbb::blocked_range<size_t>(0, sourceCount, 1),
+        ChangeMap(),
+        [&](const tbb::blocked_range<size_t>& range, ChangeMap summary) {
+            vector<HistoryRecord> rows;
+
+            for (size_t i = range.begin(); i != range.end(); ++i) {
+                if (i >= segmentCount) {
+                    const MappedFile& log = *snap.logs[i - segmentCount];
+                    size_t count = recordsIn(log);
+                    for (size_t r = 0; r < count; ++r) {
+                        HistoryRecord record = recordAt(log, r);
+                        summary[record.keyId].observe(record.time, record.pricePence, windowStart);
+                    }
+                    continue;
+                }
+
+                const HistorySegment& segment = *snap.segments[i];
+                for (uint32_t r = 0; r < segment.runCount(); ++r) {
+                    HistorySegment::Run run = segment.run(r);
+                    ChangeSummary& book = summary[run.keyId];
+
+                    if (run.lastTime <= windowStart || run.firstTime > windowStart) {
+                        book.observe(run.firstTime, run.firstPence, windowStart);
+                        book.observe(run.lastTime, run.lastPence, windowStart);
+                        continue;
+                    }
+
+                    rows.clear();
+                    segment.decode(run, rows);
+                    for (const auto& row : rows) {
+                        book.observe(row.time, row.pricePence, windowStart);
+                    }
+                }
+            }
+            return summary;
+        },
+        [windowStart](ChangeMap a, ChangeMap b) {
+            if (a.size() < b.size()) {
+                swap(a, b);
+            }
+            for (const auto& entry : b) {
+                a[entry.first].merge(entry.second, windowStart);
+            }
+            return a;
+        });
+
+    vector<PriceChange> changes;
+    lock_guard<mutex> lock(mutex_);
+
+    for (const auto& entry : summaries) {
+        const ChangeSummary& book = entry.second;
+        if (book.last.time == INT64_MIN) {
+            continue;   // not seen in the window
+        }
+
+        const Observation& from = book.before.time != INT64_MIN ? book.before : book.first;
+        if (from.time == book.last.time || from.pence == 0) {
+            continue;
+        }
+
+        PriceChange change{ keys_[entry.first], titles_[entry.first], from.time, book.last.time, from.pence, book.last.pence };
+        if (fabs(change.change()) >= minFraction) {
+            changes.push_back(change);
+        }
+    }
+
+    sort(changes.begin(), changes.end(), [](const PriceChange& a, const PriceChange& b) {
+        return fabs(a.change()) > fabs(b.change());
+    });
+    return changes;
+}
+
+vector<string> PriceHistory::findKeys(const string& text) const {
+    string needle = toLower(text);
+    vector<string> keys;
+
+    lock_guard<mutex> lock(mutex_);
+    for (size_t i = 0; i < keys_.size(); ++i) {
+        if (keys_[i] == text || toLower(titles_[i]).find(needle) != string::npos) {
+            keys.push_back(keys_[i]);
+        }
+    }
+    return keys;
+}
+
+string PriceHistory::titleOf(const string& key) const {
+    lock_guard<mutex> lock(mutex_);
+    auto it = keyIds_.find(key);
+    return it == keyIds_.end() ? string() : titles_[it->second];
+}
+
+size_t PriceHistory::segmentCount() const {
+    lock_guard<mutex> lock(mutex_);
+    return segments_.size();
+}
+
+string PriceHistory::formatTime(int64_t time) {
+    time_t seconds = static_cast<time_t>(time);
+    tm utc;
+#ifdef _WIN32
+    gmtime_s(&utc, &seconds);
+#else
+    gmtime_r(&seconds, &utc);
+#endif
+    ostringstream oss;
+    oss << put_time(&utc, "%Y-%m-%d %H:%M");
+    return oss.str();
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "BookData.h"
+#include "BookStore.h"
+#include "HistorySegment.h"
+#include "MappedFile.h"
+
+using namespace std;
+
+struct PricePoint {
+    int64_t time;
+    int64_t pricePence;
+    int stockCount;
+    bool inStock;
+};
+
+struct PriceChange {
+    string key;
+    string title;
+    int64_t fromTime;
+    int64_t toTime;
+    int64_t fromPence;
+    int64_t toPence;
+
+    double change() const {
+        return fromPence == 0 ? 0.0 : static_cast<double>(toPence - fromPence) / fromPence;
+    }
+};
+
+// Price and stock of every book over time, one observation per book per run,
+// kept in a directory:
+//   keys.bin                  book keys (DataAnalyzer::bookKey) and titles, append-only
+//   log-<G>.bin               append-only log of fixed-size records
+//   segment-<F>-<L>.bin       compacted logs F..L, see HistorySegment
+// Once the log holds COMPACT_RECORDS records it is sealed, a new one is started
+// and a background thread compacts the sealed log into a segment. At
+// MAX_SEGMENTS segments the newest ones of similar size are merged in too, so
+// queries touch few files after years of runs. Queries map every file and run over
+// them in parallel.
+class PriceHistory {
+public:
+    static const size_t COMPACT_RECORDS = 65536;
+    static const size_t MAX_SEGMENTS = 16;
+
+    explicit PriceHistory(const string& directory);
+    // Waits for a running compaction
+    ~PriceHistory();
+
+    PriceHistory(const PriceHistory&) = delete;
+    PriceHistory& operator=(const PriceHistory&) = delete;
+
+    // One observation per book, all at the same time (seconds since the epoch)
+    void record(const BookStore& books, int64_t time);
+    void record(const vector<BookData>& books, int64_t time);
+
+    // Observations of one book in time order
+    vector<PricePoint> history(const string& key) const;
+    // Books whose latest price differs by at least minFraction from their
+    // price at the start of the last `days` days (or their first price in them)
+    vector<PriceChange> priceChanges(double minFraction, int days, int64_t now) const;
+    // Keys whose UPC equals text or whose title contains it, ignoring case
+    vector<string> findKeys(const string& text) const;
+    string titleOf(const string& key) const;
+
+    size_t segmentCount() const;
+
+    static string formatTime(int64_t time);
+
+private:
+    string directory_;
+    mutable mutex mutex_;
+
+    unordered_map<string, uint32_t> keyIds_;
+    vector<string> keys_;
+    vector<string> titles_;
+    ofstream keyFile_;
+
+    uint64_t generation_ = 1;           // of the log being appended to
+    ofstream log_;
+    size_t logRecords_ = 0;
+    vector<uint64_t> sealedLogs_;       // waiting for or in compaction
+    vector<shared_ptr<const HistorySegment>> segments_;     // by generation
+
+    thread compactor_;
+    bool compacting_ = false;
+
+    // What a query reads, mapped while holding the lock so compaction can't
+    // remove a file in between
+    struct Snapshot {
+        vector<shared_ptr<const HistorySegment>> segments;
+        vector<shared_ptr<const MappedFile>> logs;
+    };
+    Snapshot snapshot() const;
+
+    void load();
+    void loadKeys();
+    uint32_t keyIdFor(const string& key, const string& title);
+    void append(const vector<HistoryRecord>& records);
+    void sealLog();
+    void startCompaction();
+    void compact(vector<uint64_t> generations, vector<shared_ptr<const HistorySegment>> inputs);
+
+    string logPath(uint64_t generation) const;
+    string segmentPath(uint64_t first, uint64_t last) const;
+    static size_t recordsIn(const MappedFile& log);
+    static HistoryRecord recordAt(const MappedFile& log, size_t index);
+    static HistoryRecord observe(const BookData& book, uint32_t keyId, int64_t time);
+};
@@ -0,0 +1,265 @@
+#include "PriceKernels.h"
+#include <algorithm>
+#include <charconv>
+#include <climits>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SHELFSCAN_X86_64 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts AVX2 intrinsics anywhere, GCC/Clang need the function marked
+#if defined(SHELFSCAN_X86_64) && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+using namespace std;
+
+namespace {
+
+int64_t sumScalar(const int64_t* prices, size_t count) {
+    int64_t sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += prices[i];
+    }
+    return sum;
+}
+
+int64_t maxScalar(const int64_t* prices, size_t count) {
+    int64_t best = LLONG_MIN;
+    for (size_t i = 0; i < count; ++i) {
+        if (prices[i] > best) {
+            best = prices[i];
+        }
+    }
+    return best;
+}
+
+int64_t minPositiveScalar(const int64_t* prices, size_t count) {
+    int64_t best = LLONG_MAX;
+    for (size_t i = 0; i < count; ++i) {
+        if (prices[i] > 0 && prices[i] < best) {
+            best = prices[i];
+        }
+    }
+    return best;
+}
+
+size_t findScalar(const int64_t* prices, size_t count, int64_t value) {
+    for (size_t i = 0; i < count; ++i) {
+        if (prices[i] == value) {
+            return i;
+        }
+    }
+    return count;
+}
+
+#ifdef SHELFSCAN_X86_64
+
+TARGET_AVX2 int64_t horizontalSum(__m256i v) {
+    __m128i low = _mm256_castsi256_si128(v);
+    __m128i high = _mm256_extracti128_si256(v, 1);
+    __m128i pair = _mm_add_epi64(low, high);
+    return _mm_cvtsi128_si64(pair) + _mm_extract_epi64(pair, 1);
+}
+
+TARGET_AVX2 int64_t sumAvx2(const int64_t* prices, size_t count) {
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        acc0 = _mm256_add_epi64(acc0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prices + i)));
+        acc1 = _mm256_add_epi64(acc1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prices + i + 4)));
+    }
+
+    return horizontalSum(_mm256_add_epi64(acc0, acc1)) + sumScalar(prices + i, count - i);
+}
+
+// AVX2 has no 64-bit min/max, use compare + blend
+TARGET_AVX2 int64_t maxAvx2(const int64_t* prices, size_t count) {
+    __m256i best = _mm256_set1_epi64x(LLONG_MIN);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prices + i));
+        best = _mm256_blendv_epi8(best, v, _mm256_cmpgt_epi64(v, best));
+    }
+
+    alignas(32) int64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), best);
+
+    int64_t result = maxScalar(prices + i, count - i);
+    for (int64_t lane : lanes) {
+        if (lane > result) {
+            result = lane;
+        }
+    }
+    return result;
+}
+
+TARGET_AVX2 int64_t minPositiveAvx2(const int64_t* prices, size_t count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i none = _mm256_set1_epi64x(LLONG_MAX);
+    __m256i best = none;
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prices + i));
+        // Non-positive prices (missing / unparsable) never win
+        v = _mm256_blendv_epi8(none, v, _mm256_cmpgt_epi64(v, zero));
+        best = _mm256_blendv_epi8(best, v, _mm256_cmpgt_epi64(best, v));
+    }
+
+    alignas(32) int64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), best);
+
+    int64_t result = minPositiveScalar(prices + i, count - i);
+    for (int64_t lane : lanes) {
+        if (lane < result) {
+            result = lane;
+        }
+    }
+    return result;
+}
+
+TARGET_AVX2 size_t findAvx2(const int64_t* prices, size_t count, int64_t value) {
+    const __m256i needle = _mm256_set1_epi64x(value);
+    size_t i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(prices + i));
+        int mask = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(v, needle)));
+        if (mask != 0) {
+            for (size_t lane = 0; lane < 4; ++lane) {
+                if (mask & (1 << lane)) {
+                    return i + lane;
+                }
+            }
+        }
+    }
+
+    return i + findScalar(prices + i, count - i, value);
+}
+
+#endif
+
+}
+
+bool PriceKernels::hasAvx2() {
+#ifdef SHELFSCAN_X86_64
+#ifdef _MSC_VER
+    static const bool supported = [] {
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) {
+            return false;
+        }
+
+        // OS must save the YMM registers (OSXSAVE + XCR0 bits 1 and 2)
+        __cpuid(info, 1);
+        bool osxsave = (info[2] & (1 << 27)) != 0;
+        if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) {
+            return false;
+        }
+
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    }();
+    return supported;
+#else
+    static const bool supported = __builtin_cpu_supports("avx2");
+    return supported;
+#endif
+#else
+    return false;
+#endif
+}
+
+int64_t PriceKernels::sumPrices(const int64_t* prices, size_t count) {
+#ifdef SHELFSCAN_X86_64
+    if (hasAvx2()) {
+        return sumAvx2(prices, count);
+    }
+#endif
+    return sumScalar(prices, count);
+}
+
+// LLONG_MIN for an empty column
+int64_t PriceKernels::maxPrice(const int64_t* prices, size_t count) {
+#ifdef SHELFSCAN_X86_64
+    if (hasAvx2()) {
+        return maxAvx2(prices, count);
+    }
+#endif
+    return maxScalar(prices, count);
+}
+
+// LLONG_MAX when no price is positive
+int64_t PriceKernels::minPositivePrice(const int64_t* prices, size_t count) {
+#ifdef SHELFSCAN_X86_64
+    if (hasAvx2()) {
+        return minPositiveAvx2(prices, count);
+    }
+#endif
+    return minPositiveScalar(prices, count);
+}
+
+// Index of the first occurrence, count if there is none
+size_t PriceKernels::findPrice(const int64_t* prices, size_t count, int64_t value) {
+#ifdef SHELFSCAN_X86_64
+    if (hasAvx2()) {
+        return findAvx2(prices, count, value);
+    }
+#endif
+    return findScalar(prices, count, value);
+}
+
+// Only two fraction digits are kept, a third one rounds half up
+int64_t PriceKernels::parseMinorUnits(string_view text) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+
+    while (p != end && (*p < '0' || *p > '9')) {
+        p++;
+    }
+    if (p == end) {
+        return 0;
+    }
+
+    int64_t whole = 0;
+    p = from_chars(p, end, whole).ptr;
+
+    if (p == end || (*p != '.' && *p != ',') || p + 1 == end || p[1] < '0' || p[1] > '9') {
+        return whole * 100;
+    }
+    p++;
+
+    // Two fraction digits are kept, the third rounds half up
+    int64_t fraction = 0;
+    const char* fractionEnd = from_chars(p, min(p + 2, end), fraction).ptr;
+    if (fractionEnd - p == 1) {
+        fraction *= 10;
+    }
+
+    bool roundUp = fractionEnd == p + 2 && fractionEnd != end && *fractionEnd >= '5' && *fractionEnd <= '9';
+
+    return whole * 100 + fraction + (roundUp ? 1 : 0);
+}
+
+string PriceKernels::formatMinorUnits(int64_t minorUnits) {
+    bool negative = minorUnits < 0;
+    uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(minorUnits) : static_cast<uint64_t>(minorUnits);
+
+    string cents = to_string(magnitude % 100);
+    if (cents.size() < 2) {
+        cents = "0" + cents;
+    }
+
+    return (negative ? "-" : "") + to_string(magnitude / 100) + "." + cents;
+}
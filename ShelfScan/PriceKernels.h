@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+// Prices are kept as integer minor units (pence), so aggregates are exact and
+// don't depend on how work was split between threads. These kernels work on a
+// flat price column; AVX2 versions are picked at runtime when the CPU has it,
+// the scalar fallbacks return identical results.
+class PriceKernels {
+public:
+    static int64_t sumPrices(const int64_t* prices, size_t count);
+    static int64_t maxPrice(const int64_t* prices, size_t count);
+    static int64_t minPositivePrice(const int64_t* prices, size_t count);
+    static size_t findPrice(const int64_t* prices, size_t count, int64_t value);
+
+    static bool hasAvx2();
+
+    // "£59.99" <-> 5999, parses the first number in the text ('.' or ',' as
+    // decimal separator), 0 if there is none
+    static int64_t parseMinorUnits(string_view text);
+    static string formatMinorUnits(int64_t minorUnits);
+};
@@ -0,0 +1,208 @@
+#include "QuantileSketch.h"
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+using namespace std;
+
+QuantileSketch::QuantileSketch(int k) : k_(k) {
+    grow();
+}
+
+// Lower levels get geometrically smaller capacity (factor 2/3)
+size_t QuantileSketch::capacity(size_t level) const {
+    size_t depth = compactors_.size() - level - 1;
+    return max<size_t>(2, static_cast<size_t>(ceil(k_ * pow(2.0 / 3.0, static_cast<double>(depth)))));
+}
+
+void QuantileSketch::grow() {
+    compactors_.emplace_back();
+
+    maxSize_ = 0;
+    for (size_t h = 0; h < compactors_.size(); ++h) {
+        maxSize_ += capacity(h);
+    }
+}
+
+void QuantileSketch::add(float value) {
+    if (count_ == 0) {
+        min_ = max_ = value;
+    }
+    else {
+        min_ = min(min_, value);
+        max_ = max(max_, value);
+    }
+
+    compactors_[0].push_back(value);
+    count_++;
+    size_++;
+
+    if (size_ >= maxSize_) {
+        compress();
+    }
+}
+
+// Compacts the lowest full level(s) until the sketch fits again.
+// Alternating the kept half instead of flipping a coin keeps results reproducible.
+void QuantileSketch::compress() {
+    for (size_t h = 0; h < compactors_.size(); ++h) {
+        if (compactors_[h].size() < capacity(h)) {
+            continue;
+        }
+        if (h + 1 >= compactors_.size()) {
+            grow();
+        }
+
+        vector<float>& level = compactors_[h];
+        sort(level.begin(), level.end());
+
+        // Odd item out stays on this level
+        float leftover = 0;
+        bool hasLeftover = level.size() % 2 == 1;
+        if (hasLeftover) {
+            leftover = level.back();
+            level.pop_back();
+        }
+
+        vector<float>& next = compactors_[h + 1];
+        for (size_t i = promoteOdd_ ? 1 : 0; i < level.size(); i += 2) {
+            next.push_back(level[i]);
+        }
+        promoteOdd_ = !promoteOdd_;
+
+        level.clear();
+        if (hasLeftover) {
+            level.push_back(leftover);
+        }
+
+        size_ = 0;
+        for (const auto& compactor : compactors_) {
+            size_ += compactor.size();
+        }
+        if (size_ < maxSize_) {
+            break;
+        }
+    }
+}
+
+void QuantileSketch::merge(const QuantileSketch& other) {
+    if (other.count_ == 0) {
+        return;
+    }
+
+    if (count_ == 0) {
+        min_ = other.min_;
+        max_ = other.max_;
+    }
+    else {
+        min_ = min(min_, other.min_);
+        max_ = max(max_, other.max_);
+    }
+
+    while (compactors_.size() < other.compactors_.size()) {
+        grow();
+    }
+    for (size_t h = 0; h < other.compactors_.size(); ++h) {
+        compactors_[h].insert(compactors_[h].end(), other.compactors_[h].begin(), other.compactors_[h].end());
+    }
+
+    count_ += other.count_;
+    size_ = 0;
+    for (const auto& compactor : compactors_) {
+        size_ += compactor.size();
+    }
+
+    while (size_ >= maxSize_) {
+        compress();
+    }
+}
+
+float QuantileSketch::quantile(double q) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    if (q <= 0) {
+        return min_;
+    }
+    if (q >= 1) {
+        return max_;
+    }
+
+    vector<pair<float, uint64_t>> weighted;
+    weighted.reserve(size_);
+    uint64_t totalWeight = 0;
+
+    for (size_t h = 0; h < compactors_.size(); ++h) {
+        uint64_t weight = 1ULL << h;
+        for (float value : compactors_[h]) {
+            weighted.emplace_back(value, weight);
+            totalWeight += weight;
+        }
+    }
+
+    sort(weighted.begin(), weighted.end());
+
+    double target = q * static_cast<double>(totalWeight);
+    uint64_t cumulative = 0;
+    for (const auto& item : weighted) {
+        cumulative += item.second;
+        if (static_cast<double>(cumulative) >= target) {
+            return item.first;
+        }
+    }
+    return max_;
+}
+
+// "k count min max promoteOdd;level0 values;level1 values;..."
+string QuantileSketch::serialize() const {
+    ostringstream oss;
+    oss << setprecision(9) << k_ << ' ' << count_ << ' ' << min_ << ' ' << max_ << ' ' << promoteOdd_;
+
+    for (const auto& compactor : compactors_) {
+        oss << ';';
+        for (size_t i = 0; i < compactor.size(); ++i) {
+            oss << (i > 0 ? " " : "") << compactor[i];
+        }
+    }
+    return oss.str();
+}
+
+QuantileSketch QuantileSketch::deserialize(const string& text) {
+    istringstream levels(text);
+    string header;
+    getline(levels, header, ';');
+
+    istringstream headerStream(header);
+    int k = 200;
+    headerStream >> k;
+
+    QuantileSketch sketch(k);
+    headerStream >> sketch.count_ >> sketch.min_ >> sketch.max_ >> sketch.promoteOdd_;
+
+    sketch.compactors_.clear();
+    string level;
+    while (getline(levels, level, ';')) {
+        sketch.compactors_.emplace_back();
+
+        istringstream values(level);
+        float value;
+        while (values >> value) {
+            sketch.compactors_.back().push_back(value);
+        }
+    }
+
+    if (sketch.compactors_.empty()) {
+        sketch.compactors_.emplace_back();
+    }
+
+    sketch.maxSize_ = 0;
+    sketch.size_ = 0;
+    for (size_t h = 0; h < sketch.compactors_.size(); ++h) {
+        sketch.maxSize_ += sketch.capacity(h);
+        sketch.size_ += sketch.compactors_[h].size();
+    }
+
+    return sketch;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// KLL quantile sketch: approximate quantiles of a stream in bounded memory.
+// Items live in a stack of compactors where level h items weigh 2^h; a full
+// level is sorted and every other item is promoted. Sketches built on
+// different threads or processes can be merged.
+class QuantileSketch {
+public:
+    explicit QuantileSketch(int k = 200);
+
+    void add(float value);
+    void merge(const QuantileSketch& other);
+
+    float quantile(double q) const;
+    uint64_t count() const { return count_; }
+    float minValue() const { return min_; }
+    float maxValue() const { return max_; }
+
+    string serialize() const;
+    static QuantileSketch deserialize(const string& text);
+
+private:
+    int k_;
+    uint64_t count_ = 0;
+    float min_ = 0;
+    float max_ = 0;
+    size_t size_ = 0;
+    size_t maxSize_ = 0;
+    bool promoteOdd_ = false;
+    vector<vector<float>> compactors_;
+
+    size_t capacity(size_t level) const;
+    void grow();
+    void compress();
+};
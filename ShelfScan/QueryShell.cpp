@@ -0,0 +1,170 @@
+#include "QueryShell.h"
+#include "PriceKernels.h"
+#include <cctype>
+#include <chrono>
+#include <iomanip>
+#include <stdexcept>
+
+using namespace std;
+using namespace chrono;
+
+QueryShell::QueryShell(const BookIndex& index) : index_(index) {
+}
+
+void QueryShell::run(istream& in, ostream& out) {
+    out << "Query mode over " << index_.size() << " books. Type 'help' for syntax, 'quit' to exit.\n";
+
+    string line;
+    while (true) {
+        out << "> " << flush;
+        if (!getline(in, line) || !execute(line, out)) {
+            break;
+        }
+    }
+}
+
+// Returns false when the user asked to quit
+bool QueryShell::execute(const string& line, ostream& out) {
+    vector<string> tokens = tokenize(line);
+    if (tokens.empty()) {
+        return true;
+    }
+
+    const string& command = tokens[0];
+    if (command == "quit" || command == "exit") {
+        return false;
+    }
+    if (command == "help") {
+        printHelp(out);
+        return true;
+    }
+    if (command != "find" && command != "count") {
+        out << "Unknown command: " << command << " (try 'help')\n";
+        return true;
+    }
+
+    BookQuery query;
+    try {
+        query = parseQuery(tokens, 1);
+    }
+    catch (const exception& e) {
+        out << "Invalid query: " << e.what() << "\n";
+        return true;
+    }
+
+    auto start = steady_clock::now();
+
+    if (command == "count") {
+        size_t matches = index_.count(query);
+        double ms = duration<double, milli>(steady_clock::now() - start).count();
+        out << matches << " books (" << fixed << setprecision(3) << ms << " ms)\n";
+        return true;
+    }
+
+    // Listing everything by accident floods the terminal
+    if (query.limit == 0) {
+        query.limit = 20;
+    }
+
+    vector<uint32_t> ids = index_.query(query);
+    double ms = duration<double, milli>(steady_clock::now() - start).count();
+
+    for (uint32_t id : ids) {
+        const BookData& book = index_.book(id);
+        out << setw(8) << PriceKernels::formatMinorUnits(book.priceMinor) << " GBP  "
+            << book.starRating << "/5  " << book.title
+            << " (" << book.availability << ")\n";
+    }
+    out << ids.size() << " books (" << fixed << setprecision(3) << ms << " ms)\n";
+
+    return true;
+}
+
+BookQuery QueryShell::parseQuery(const vector<string>& tokens, size_t first) {
+    BookQuery query;
+
+    for (size_t i = first; i < tokens.size(); ++i) {
+        const string& token = tokens[i];
+
+        if (token == "instock") {
+            query.inStockOnly = true;
+        }
+        else if (token.compare(0, 7, "price>=") == 0) {
+            query.hasMinPrice = true;
+            query.minPrice = PriceKernels::parseMinorUnits(token.substr(7));
+        }
+        else if (token.compare(0, 7, "price<=") == 0) {
+            query.hasMaxPrice = true;
+            query.maxPrice = PriceKernels::parseMinorUnits(token.substr(7));
+        }
+        else if (token.compare(0, 7, "rating=") == 0) {
+            query.starRating = stoi(token.substr(7));
+        }
+        else if (token.compare(0, 13, "availability=") == 0) {
+            query.availability = token.substr(13);
+        }
+        else if (token.compare(0, 6, "title~") == 0) {
+            query.titleContains = token.substr(6);
+        }
+        else if (token == "sort=price") {
+            query.order = BookQuery::Order::PriceAscending;
+        }
+        else if (token == "sort=-price") {
+            query.order = BookQuery::Order::PriceDescending;
+        }
+        else if (token.compare(0, 6, "limit=") == 0) {
+            query.limit = stoul(token.substr(6));
+        }
+        else {
+            throw runtime_error("unknown filter '" + token + "'");
+        }
+    }
+
+    return query;
+}
+
+void QueryShell::printHelp(ostream& out) {
+    out << "Commands:\n"
+        << "  find <filters>    list matching books (default limit 20)\n"
+        << "  count <filters>   number of matching books\n"
+        << "  quit              leave query mode\n"
+        << "Filters:\n"
+        << "  price>=N price<=N    price range\n"
+        << "  rating=N             star rating 1-5\n"
+        << "  instock              only books in stock\n"
+        << "  availability=\"...\"   exact availability text\n"
+        << "  title~\"...\"          title contains text (case insensitive)\n"
+        << "  sort=price|-price    cheapest / most expensive first\n"
+        << "  limit=N              at most N results\n";
+}
+
+// Splits on whitespace, double quotes group words (title~"harry potter")
+vector<string> QueryShell::tokenize(const string& line) {
+    vector<string> tokens;
+    string current;
+    bool inQuotes = false;
+    bool hasToken = false;
+
+    for (char ch : line) {
+        if (ch == '"') {
+            inQuotes = !inQuotes;
+            hasToken = true;
+        }
+        else if (isspace(static_cast<unsigned char>(ch)) && !inQuotes) {
+            if (hasToken) {
+                tokens.push_back(current);
+                current.clear();
+                hasToken = false;
+            }
+        }
+        else {
+            current += ch;
+            hasToken = true;
+        }
+    }
+
+    if (hasToken) {
+        tokens.push_back(current);
+    }
+    return tokens;
+}
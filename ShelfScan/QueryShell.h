@@ -0,0 +1,27 @@
+#pragma once
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "BookIndex.h"
+
+using namespace std;
+
+// Interactive query mode over a BookIndex, one query per line, e.g.
+//   find price>=10 price<=20 rating=5 instock sort=-price limit=10
+//   count title~"harry potter"
+class QueryShell {
+public:
+    explicit QueryShell(const BookIndex& index);
+
+    void run(istream& in, ostream& out);
+    bool execute(const string& line, ostream& out);
+
+private:
+    const BookIndex& index_;
+
+    BookQuery parseQuery(const vector<string>& tokens, size_t first);
+    void printHelp(ostream& out);
+
+    static vector<string> tokenize(const string& line);
+};
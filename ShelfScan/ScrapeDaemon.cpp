@@ -0,0 +1,259 @@
+#include "ScrapeDaemon.h"
+#include "QueryShell.h"
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+using namespace std;
+using namespace chrono;
+
+ScrapeDaemon::ScrapeDaemon(const string& socketPath, const string& outputPrefix, int intervalSeconds)
+    : socketPath_(socketPath), outputPrefix_(outputPrefix), interval_(intervalSeconds) {
+    if (intervalSeconds < 1) {
+        throw runtime_error("Re-scrape interval must be at least 1 second");
+    }
+}
+
+void ScrapeDaemon::setOptions(const ScrapeOptions& options) {
+    scraper_.applyOptions(options);
+}
+
+// Scrapes, then sleeps until the interval is over or a client asks for a run
+int ScrapeDaemon::run(const string& baseUrl) {
+    IpcListener listener(socketPath_);
+    thread server([this, &listener] { serve(listener); });
+
+    cout << "Daemon listening on " << socketPath_ << ", re-scraping every "
+        << interval_.count() << " s" << endl;
+
+    scraper_.loadPreviousRun(outputPrefix_);
+
+    while (true) {
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (stopping_) {
+                break;
+            }
+        }
+        scrapeOnce(baseUrl);
+
+        unique_lock<mutex> lock(mutex_);
+        wake_.wait_for(lock, interval_, [this] { return rescrapeRequested_ || stopping_; });
+        if (stopping_) {
+            break;
+        }
+        rescrapeRequested_ = false;
+    }
+
+    // Wakes the server thread if it waits in accept()
+    try {
+        IpcChannel::connectTo(socketPath_);
+    }
+    catch (const exception&) {
+    }
+    server.join();
+    disconnectClients();
+
+    cout << "Daemon stopped after " << runs_ << " runs." << endl;
+    return 0;
+}
+
+// A failed run keeps the previous results served
+void ScrapeDaemon::scrapeOnce(const string& baseUrl) {
+    int runNumber;
+    {
+        // reset() clears a cancellation, so it runs before scraping_ is set:
+        // a SHUTDOWN from here on cancels this run, an earlier one skips it
+        lock_guard<mutex> lock(mutex_);
+        if (started_ > 0) {
+            scraper_.reset();
+        }
+        if (stopping_) {
+            return;
+        }
+        started_++;
+        scraping_ = true;
+        runNumber = runs_ + 1;
+    }
+
+    try {
+        cout << "Daemon: run " << runNumber << " started" << endl;
+
+        scraper_.streamRawData(outputPrefix_);
+        scraper_.crawl(baseUrl);
+        AnalysisResults results = scraper_.saveResults(outputPrefix_);
+        auto index = make_shared<const BookIndex>(scraper_.snapshotBooks());
+
+        lock_guard<mutex> lock(mutex_);
+        lastResults_ = results;
+        index_ = index;
+        runs_ = runNumber;
+        lastRunEnd_ = system_clock::now();
+    }
+    catch (const exception& e) {
+        cerr << "Daemon: run " << runNumber << " failed: " << e.what() << endl;
+    }
+
+    lock_guard<mutex> lock(mutex_);
+    scraping_ = false;
+}
+
+// Accepts clients until the daemon stops, every client gets a detached thread
+void ScrapeDaemon::serve(IpcListener& listener) {
+    while (true) {
+        auto client = make_shared<IpcChannel>();
+        try {
+            *client = listener.accept();
+        }
+        catch (const exception& e) {
+            cerr << "Daemon: " << e.what() << endl;
+            continue;
+        }
+
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (stopping_) {
+                return;
+            }
+            clients_.insert(client);
+        }
+
+        thread([this, client] { serveClient(client); }).detach();
+    }
+}
+
+// Serves one client until it disconnects or is disconnected
+void ScrapeDaemon::serveClient(shared_ptr<IpcChannel> client) {
+    try {
+        string line;
+        while (client->receiveLine(line) && handleCommand(line, *client)) {
+        }
+    }
+    catch (const exception& e) {
+        cerr << "Daemon: client error: " << e.what() << endl;
+    }
+
+    // The daemon may be destroyed as soon as clients_ is empty, so the
+    // notification waits until this thread is completely done
+    unique_lock<mutex> lock(mutex_);
+    clients_.erase(client);
+    notify_all_at_thread_exit(clientsDone_, move(lock));
+}
+
+// Idle clients wait in receiveLine, ending their connections lets their threads finish
+void ScrapeDaemon::disconnectClients() {
+    unique_lock<mutex> lock(mutex_);
+    for (const auto& client : clients_) {
+        client->shutdown();
+    }
+    clientsDone_.wait(lock, [this] { return clients_.empty(); });
+}
+
+// False once the client should be disconnected
+bool ScrapeDaemon::handleCommand(const string& line, IpcChannel& client) {
+    size_t space = line.find(' ');
+    string command = line.substr(0, space);
+    string argument = space == string::npos ? "" : line.substr(space + 1);
+
+    bool keepOpen = true;
+    ostringstream reply;
+
+    if (command == "STATUS") {
+        reply << formatStatus();
+    }
+    else if (command == "QUERY") {
+        shared_ptr<const BookIndex> index;
+        {
+            lock_guard<mutex> lock(mutex_);
+            index = index_;
+        }
+
+        if (!index) {
+            reply << "No finished run yet";
+        }
+        else {
+            QueryShell(*index).execute(argument, reply);
+        }
+    }
+    else if (command == "RESCRAPE") {
+        lock_guard<mutex> lock(mutex_);
+        rescrapeRequested_ = true;
+        wake_.notify_all();
+        reply << (scraping_ ? "Run in progress, next one starts right after" : "Run started");
+    }
+    else if (command == "SHUTDOWN") {
+        lock_guard<mutex> lock(mutex_);
+        stopping_ = true;
+        wake_.notify_all();
+        if (scraping_) {
+            scraper_.cancel();
+        }
+        reply << "Stopping" << (scraping_ ? ", current run cancelled (its partial results are saved)" : "");
+        keepOpen = false;
+    }
+    else {
+        reply << "Unknown command: " << command << " (STATUS, QUERY <query>, RESCRAPE, SHUTDOWN)";
+    }
+
+    istringstream lines(reply.str());
+    string replyLine;
+    while (getline(lines, replyLine)) {
+        client.sendLine(replyLine);
+    }
+    client.sendLine("END");
+
+    return keepOpen;
+}
+
+string ScrapeDaemon::formatStatus() {
+    AnalysisResults live = scraper_.liveResults();
+    const ScrapingStats& stats = scraper_.stats();
+
+    lock_guard<mutex> lock(mutex_);
+    ostringstream oss;
+
+    oss << "{\n";
+    oss << "  \"runs\": " << runs_ << ",\n";
+    if (runs_ > 0) {
+        time_t finished = system_clock::to_time_t(lastRunEnd_);
+        tm utc;
+#ifdef _WIN32
+        gmtime_s(&utc, &finished);
+#else
+        gmtime_r(&finished, &utc);
+#endif
+        oss << "  \"lastRunFinished\": \"" << put_time(&utc, "%Y-%m-%dT%H:%M:%SZ") << "\",\n";
+    }
+    oss << "  \"scraping\": " << (scraping_ ? "true" : "false") << ",\n";
+    if (scraping_) {
+        oss << fixed << setprecision(2)
+            << "  \"progress\": { \"pagesProcessed\": " << stats.pagesProcessed.load()
+            << ", \"booksFound\": " << stats.booksFound.load()
+            << ", \"averagePrice\": " << live.averagePrice << " },\n";
+    }
+    string results = runs_ > 0 ? writer_.formatAnalysisJson(lastResults_) : "null";
+    for (size_t pos = results.find('\n'); pos != string::npos; pos = results.find('\n', pos + 3)) {
+        results.replace(pos, 1, "\n  ");
+    }
+    oss << "  \"results\": " << results << "\n";
+    oss << "}";
+
+    return oss.str();
+}
+
+int ScrapeDaemon::send(const string& socketPath, const string& command, ostream& out) {
+    IpcChannel channel = IpcChannel::connectTo(socketPath);
+    channel.sendLine(command);
+
+    string line;
+    while (channel.receiveLine(line)) {
+        if (line == "END") {
+            return 0;
+        }
+        out << line << "\n";
+    }
+
+    cerr << "Daemon closed the connection" << endl;
+    return 1;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include "ShelfScan.h"
+#include "BookIndex.h"
+#include "IpcChannel.h"
+
+using namespace std;
+
+// Long-running scraper. One ShelfScan stays alive between runs, so its
+// connections, page cache and image store stay warm; the catalogue is
+// re-scraped every interval and the latest results are served on a Unix
+// socket, one command per line:
+//   STATUS           last run's analysis (JSON) and progress of the current run
+//   QUERY <query>    query shell command over the last run's books, e.g. QUERY find rating=5 limit=3
+//   RESCRAPE         start the next run now
+//   SHUTDOWN         cancel the current run (partial results are saved) and exit
+// Every reply ends with a line "END". Each client is served by its own thread,
+// so an idle connection doesn't hold up the others.
+class ScrapeDaemon {
+public:
+    ScrapeDaemon(const string& socketPath, const string& outputPrefix, int intervalSeconds);
+
+    void setOptions(const ScrapeOptions& options);
+    int run(const string& baseUrl);
+
+    // Client side: sends one command and prints the reply
+    static int send(const string& socketPath, const string& command, ostream& out);
+
+private:
+    string socketPath_;
+    string outputPrefix_;
+    chrono::seconds interval_;
+    ShelfScan scraper_;
+    FileWriter writer_;
+
+    // Shared with the threads serving the socket and its clients
+    mutex mutex_;
+    condition_variable wake_;
+    bool rescrapeRequested_ = false;
+    bool stopping_ = false;
+    bool scraping_ = false;
+    int runs_ = 0;              // finished runs
+    int started_ = 0;           // failed ones included
+    AnalysisResults lastResults_;
+    shared_ptr<const BookIndex> index_;
+    chrono::system_clock::time_point lastRunEnd_;
+    set<shared_ptr<IpcChannel>> clients_;   // connected, each with its own thread
+    condition_variable clientsDone_;
+
+    void scrapeOnce(const string& baseUrl);
+    void serve(IpcListener& listener);
+    void serveClient(shared_ptr<IpcChannel> client);
+    void disconnectClients();
+    bool handleCommand(const string& line, IpcChannel& client);
+    string formatStatus();
+};
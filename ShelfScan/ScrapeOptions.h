@@ -0,0 +1,66 @@
+#pragma once
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Scraper settings given on the command line, shard workers get the same
+// ones passed through as arguments (except the price history and duplicate
+// removal, which the coordinator does over the workers' results)
+struct ScrapeOptions {
+    string schemaFile;      // extraction schema, empty = built-in default
+    string imageDir;        // cover image store, empty = covers aren't fetched
+    size_t memoryBudgetMb = 0;  // 0 = unlimited
+    bool fetchDetails = false;  // follow every book to its product page
+    string sitemapUrl;      // seeds the crawl, empty = <site>/sitemap.xml
+    int maxPages = 0;       // listing pages scraped at most, 0 = ShelfScan::MAX_PAGES
+    int timeLimitSeconds = 0;   // whole crawl, partial results after it, 0 = none
+    int urlTimeoutSeconds = 0;  // one URL including retries, 0 = none
+    string historyDir;      // price history store, empty = no history kept
+    bool dedup = false;     // drop duplicate listings before the analysis
+    bool columnar = false;  // also write the books as a binary columnar file
+    string outputOrder;     // page, price or title, empty = crawl order
+
+    vector<string> toArguments() const {
+        vector<string> args;
+        if (!schemaFile.empty()) {
+            args.push_back("--schema");
+            args.push_back(schemaFile);
+        }
+        if (!imageDir.empty()) {
+            args.push_back("--images");
+            args.push_back(imageDir);
+        }
+        if (!sitemapUrl.empty()) {
+            args.push_back("--sitemap");
+            args.push_back(sitemapUrl);
+        }
+        if (maxPages > 0) {
+            args.push_back("--max-pages");
+            args.push_back(to_string(maxPages));
+        }
+        if (timeLimitSeconds > 0) {
+            args.push_back("--time-limit");
+            args.push_back(to_string(timeLimitSeconds));
+        }
+        if (urlTimeoutSeconds > 0) {
+            args.push_back("--url-timeout");
+            args.push_back(to_string(urlTimeoutSeconds));
+        }
+        if (fetchDetails) {
+            args.push_back("--details");
+        }
+        if (columnar) {
+            args.push_back("--columnar");
+        }
+        if (!outputOrder.empty()) {
+            args.push_back("--order");
+            args.push_back(outputOrder);
+        }
+        if (memoryBudgetMb > 0) {
+            args.push_back("--memory");
+            args.push_back(to_string(memoryBudgetMb));
+        }
+        return args;
+    }
+};
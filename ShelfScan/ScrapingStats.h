@@ -9,6 +9,9 @@ struct ScrapingStats {
     atomic<int> pagesProcessed{ 0 };
     atomic<int> booksFound{ 0 };
     atomic<int> failedRequests{ 0 };
+    atomic<int> pagesUnchanged{ 0 };
+    atomic<int> detailPages{ 0 };
+    atomic<int> duplicateBooks{ 0 };
     chrono::steady_clock::time_point startTime;
     chrono::steady_clock::time_point endTime;
 };
\ No newline at end of file
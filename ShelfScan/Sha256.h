@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// Incremental SHA-256, fed chunk by chunk while a download streams to disk
+class Sha256 {
+public:
+    Sha256();
+
+    void update(const void* data, size_t length);
+
+    // Lower case hex digest, the object can't be updated afterwards
+    string finish();
+
+private:
+    uint32_t state_[8];
+    uint8_t block_[64];
+    size_t blockLength_ = 0;
+    uint64_t totalLength_ = 0;
+
+    void compress(const uint8_t* block);
+};
@@ -0,0 +1,341 @@
+#include "ShardCoordinator.h"
+#include "ShardProtocol.h"
+#include "ShelfScan.h"
+#include "CrawlSeeder.h"
+#include "DuplicateDetector.h"
+#include "FileReader.h"
+#include "PriceHistory.h"
+#include <iostream>
+#include <stdexcept>
+#include <unordered_set>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <climits>
+#endif
+
+using namespace std;
+using namespace chrono;
+
+ShardCoordinator::ShardCoordinator(int shardCount, const string& outputPrefix)
+    : shardCount_(shardCount), outputPrefix_(outputPrefix), socketPath_(defaultSocketPath()) {
+    if (shardCount_ < 1) {
+        throw runtime_error("Shard count must be at least 1");
+    }
+}
+
+void ShardCoordinator::setOptions(const ScrapeOptions& options) {
+    options_ = options;
+}
+
+ShardCoordinator::~ShardCoordinator() {
+    // Closing the sockets makes any remaining worker exit
+    workers_.clear();
+    waitForWorkers();
+}
+
+// Crawls in rounds: every shard gets its batch of owned URLs, and the links
+// they discover are routed to their owners for the next round
+AnalysisResults ShardCoordinator::run(const string& baseUrl) {
+    cout << "Starting sharded crawl with " << shardCount_ << " worker processes." << endl;
+    stats_.startTime = steady_clock::now();
+
+    IpcListener listener(socketPath_);
+    spawnWorkers();
+
+    // Workers connect in any order, HELLO tells which shard is which
+    workers_.resize(shardCount_);
+    for (int i = 0; i < shardCount_; ++i) {
+        IpcChannel channel = listener.accept();
+
+        string line, argument;
+        if (!channel.receiveLine(line) || ShardProtocol::splitCommand(line, argument) != "HELLO") {
+            throw runtime_error("Unexpected handshake from shard worker");
+        }
+
+        int shardId = stoi(argument);
+        if (shardId < 0 || shardId >= shardCount_ || workers_[shardId].isOpen()) {
+            throw runtime_error("Invalid shard id in handshake: " + argument);
+        }
+        workers_[shardId] = move(channel);
+    }
+
+    unordered_set<string> seenUrls{ baseUrl };
+    int maxPages = options_.maxPages > 0 ? options_.maxPages : ShelfScan::MAX_PAGES;
+    vector<vector<string>> pendingPages(shardCount_);
+    vector<vector<string>> pendingLinks(shardCount_);
+    int scheduledPages = 0;
+
+    // Listing pages known up front go out in the first round
+    HttpDownloader downloader;
+    HtmlParser parser;
+    CrawlSeeder seeder(downloader, parser);
+    seeder.setSitemap(options_.sitemapUrl);
+
+    for (const auto& url : seeder.seed(baseUrl)) {
+        if (scheduledPages < maxPages && seenUrls.insert(url).second) {
+            pendingPages[ShardProtocol::ownerOf(url, shardCount_)].push_back(url);
+            scheduledPages++;
+        }
+    }
+
+    // Otherwise the start page is explored for links only, its books are the same as page 1
+    if (scheduledPages == 0) {
+        pendingLinks[ShardProtocol::ownerOf(baseUrl, shardCount_)].push_back(baseUrl);
+    }
+
+    // Workers stop their own downloads at the time limit; no round starts after it
+    auto deadline = options_.timeLimitSeconds > 0
+        ? stats_.startTime + seconds(options_.timeLimitSeconds)
+        : steady_clock::time_point::max();
+
+    bool hasWork = true;
+    int round = 0;
+
+    while (hasWork) {
+        round++;
+
+        for (int i = 0; i < shardCount_; ++i) {
+            for (const auto& url : pendingPages[i]) {
+                workers_[i].sendLine("URL " + url);
+            }
+            for (const auto& url : pendingLinks[i]) {
+                workers_[i].sendLine("LINKS " + url);
+            }
+            workers_[i].sendLine("CRAWL");
+
+            cout << "[Coordinator] Round " << round << ": shard " << i << " got "
+                << pendingPages[i].size() + pendingLinks[i].size() << " URL(s)" << endl;
+
+            pendingPages[i].clear();
+            pendingLinks[i].clear();
+        }
+
+        hasWork = false;
+
+        for (int i = 0; i < shardCount_; ++i) {
+            string line;
+            while (true) {
+                if (!workers_[i].receiveLine(line)) {
+                    throw runtime_error("Shard worker " + to_string(i) + " disconnected");
+                }
+
+                string argument;
+                string command = ShardProtocol::splitCommand(line, argument);
+                if (command == "IDLE") {
+                    break;
+                }
+
+                if (command == "FOUND" &&
+                    ShelfScan::isCatalogueUrl(argument) &&
+                    argument.find("index.html") == string::npos &&
+                    scheduledPages < maxPages &&
+                    seenUrls.insert(argument).second) {
+                    pendingPages[ShardProtocol::ownerOf(argument, shardCount_)].push_back(argument);
+                    scheduledPages++;
+                    hasWork = true;
+                }
+            }
+        }
+
+        if (hasWork && steady_clock::now() >= deadline) {
+            cout << "[Coordinator] Time limit reached after round " << round << ", results are partial" << endl;
+            hasWork = false;
+        }
+    }
+
+    AnalysisResults results = collectResults();
+    stats_.endTime = steady_clock::now();
+
+    workers_.clear();
+    waitForWorkers();
+
+    // A book on pages of two shards is a repeat neither shard can see. The
+    // history is fed the same books as the report, from one writer for all shards.
+    bool filterBooks = options_.dedup || options_.fetchDetails;
+    if (filterBooks || !options_.historyDir.empty()) {
+        MemoryBudget budget;
+        if (options_.memoryBudgetMb > 0) {
+            budget.setLimit(options_.memoryBudgetMb * 1024 * 1024);
+        }
+        BookStore books(budget);
+        combineShards(books);
+
+        if (filterBooks) {
+            results = analyzer_.analyzeStore(books);
+        }
+
+        if (!options_.historyDir.empty()) {
+            PriceHistory history(options_.historyDir);
+            history.record(books, duration_cast<seconds>(system_clock::now().time_since_epoch()).count());
+        }
+    }
+
+    writer_.writeResults(outputPrefix_, results, stats_);
+    writer_.writeAnalysis(outputPrefix_, results);
+
+    cout << "Sharded crawl finished: " << stats_.pagesProcessed.load() << " pages, "
+        << results.bookCount << " books from " << shardCount_ << " shards." << endl;
+
+    return results;
+}
+
+AnalysisResults ShardCoordinator::collectResults() {
+    AnalysisResults merged;
+
+    for (int i = 0; i < shardCount_; ++i) {
+        workers_[i].sendLine("STOP");
+    }
+
+    // Merge in shard order so the report doesn't depend on timing
+    for (int i = 0; i < shardCount_; ++i) {
+        AnalysisResults partial;
+        string line;
+
+        while (true) {
+            if (!workers_[i].receiveLine(line)) {
+                throw runtime_error("Shard worker " + to_string(i) + " disconnected before sending results");
+            }
+
+            string argument;
+            string command = ShardProtocol::splitCommand(line, argument);
+            if (command == "BYE") {
+                break;
+            }
+            if (command == "RESULT") {
+                ShardProtocol::decodeResult(argument, partial, stats_);
+            }
+        }
+
+        merged = DataAnalyzer::mergeResults(merged, partial);
+    }
+
+    return merged;
+}
+
+// Reads the books of all shards into one store and leaves out UPC repeats and
+// duplicates across them like a single scraper does. Each shard is one page
+// of the store, in shard order.
+void ShardCoordinator::combineShards(BookStore& books) {
+    FileReader reader;
+
+    for (int i = 0; i < shardCount_; ++i) {
+        string shardOutput = outputPrefix_ + ".shard-" + to_string(i);
+        books.append(shardOutput, reader.readRawData(shardOutput + ".json"));
+    }
+
+    if (options_.fetchDetails) {
+        vector<size_t> repeated = DuplicateDetector::repeatedUpcs(books);
+        books.erase(repeated);
+        cout << "[Coordinator] " << repeated.size() << " listings left out by UPC across shards" << endl;
+    }
+
+    if (options_.dedup) {
+        DuplicateDetector detector;
+        vector<DuplicateCluster> clusters = detector.remove(books);
+        writer_.writeDuplicates(outputPrefix_, clusters);
+
+        size_t removed = 0;
+        for (const auto& cluster : clusters) {
+            removed += cluster.positions.size() - 1;
+        }
+        cout << "[Coordinator] Duplicates: " << removed << " listings removed from "
+            << clusters.size() << " clusters across shards" << endl;
+    }
+}
+
+void ShardCoordinator::spawnWorkers() {
+    string exe = executablePath();
+    vector<string> optionArgs = options_.toArguments();
+
+    for (int i = 0; i < shardCount_; ++i) {
+        string shardId = to_string(i);
+
+#ifdef _WIN32
+        string commandLine = "\"" + exe + "\" --worker " + shardId +
+            " --socket \"" + socketPath_ + "\" --output \"" + outputPrefix_ + "\"";
+        for (const auto& arg : optionArgs) {
+            commandLine += " \"" + arg + "\"";
+        }
+
+        STARTUPINFOA startupInfo = {};
+        startupInfo.cb = sizeof(startupInfo);
+        PROCESS_INFORMATION processInfo = {};
+
+        if (!CreateProcessA(exe.c_str(), &commandLine[0], nullptr, nullptr, FALSE, 0,
+            nullptr, nullptr, &startupInfo, &processInfo)) {
+            throw runtime_error("Cannot start shard worker " + shardId);
+        }
+
+        CloseHandle(processInfo.hThread);
+        processes_.push_back(reinterpret_cast<intptr_t>(processInfo.hProcess));
+#else
+        pid_t pid = fork();
+        if (pid < 0) {
+            throw runtime_error("Cannot start shard worker " + shardId);
+        }
+
+        if (pid == 0) {
+            vector<char*> args = {
+                const_cast<char*>(exe.c_str()),
+                const_cast<char*>("--worker"), const_cast<char*>(shardId.c_str()),
+                const_cast<char*>("--socket"), const_cast<char*>(socketPath_.c_str()),
+                const_cast<char*>("--output"), const_cast<char*>(outputPrefix_.c_str())
+            };
+            for (const auto& arg : optionArgs) {
+                args.push_back(const_cast<char*>(arg.c_str()));
+            }
+            args.push_back(nullptr);
+            execv(exe.c_str(), args.data());
+            _exit(127);
+        }
+
+        processes_.push_back(static_cast<intptr_t>(pid));
+#endif
+    }
+}
+
+void ShardCoordinator::waitForWorkers() {
+    for (intptr_t process : processes_) {
+#ifdef _WIN32
+        HANDLE handle = reinterpret_cast<HANDLE>(process);
+        WaitForSingleObject(handle, INFINITE);
+        CloseHandle(handle);
+#else
+        int status = 0;
+        waitpid(static_cast<pid_t>(process), &status, 0);
+#endif
+    }
+    processes_.clear();
+}
+
+string ShardCoordinator::executablePath() {
+#ifdef _WIN32
+    char path[MAX_PATH];
+    DWORD length = GetModuleFileNameA(nullptr, path, MAX_PATH);
+    return string(path, length);
+#else
+    char path[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (length <= 0) {
+        throw runtime_error("Cannot determine executable path");
+    }
+    return string(path, static_cast<size_t>(length));
+#endif
+}
+
+string ShardCoordinator::defaultSocketPath() {
+#ifdef _WIN32
+    char tempDir[MAX_PATH];
+    GetTempPathA(MAX_PATH, tempDir);
+    return string(tempDir) + "shelfscan-" + to_string(GetCurrentProcessId()) + ".sock";
+#else
+    return "/tmp/shelfscan-" + to_string(getpid()) + ".sock";
+#endif
+}
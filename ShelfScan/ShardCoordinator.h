@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "IpcChannel.h"
+#include "BookStore.h"
+#include "DataAnalyzer.h"
+#include "FileWriter.h"
+#include "ScrapingStats.h"
+#include "ScrapeOptions.h"
+
+using namespace std;
+
+// Splits a crawl across N worker processes on the same host. URLs are owned
+// by shard hash(url) % N, links discovered by a worker are routed back to the
+// owning shard, and the workers' partial results are merged into one report.
+class ShardCoordinator {
+public:
+    ShardCoordinator(int shardCount, const string& outputPrefix);
+    ~ShardCoordinator();
+
+    // Scraper settings handed to every worker
+    void setOptions(const ScrapeOptions& options);
+
+    AnalysisResults run(const string& baseUrl);
+
+private:
+    int shardCount_;
+    string outputPrefix_;
+    string socketPath_;
+    ScrapeOptions options_;
+    vector<IpcChannel> workers_;
+    vector<intptr_t> processes_;
+    DataAnalyzer analyzer_;
+    FileWriter writer_;
+    ScrapingStats stats_;
+
+    void spawnWorkers();
+    void waitForWorkers();
+    AnalysisResults collectResults();
+    void combineShards(BookStore& books);
+
+    static string executablePath();
+    static string defaultSocketPath();
+};
@@ -0,0 +1,137 @@
+#include "ShardProtocol.h"
+#include "BookSerializer.h"
+#include "PageCache.h"
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+
+// URL space is split by hash so every shard owns a stable subset of pages
+size_t ShardProtocol::ownerOf(const string& url, size_t shardCount) {
+    return static_cast<size_t>(PageCache::hashContent(url) % shardCount);
+}
+
+string ShardProtocol::splitCommand(const string& line, string& argument) {
+    size_t space = line.find(' ');
+    if (space == string::npos) {
+        argument.clear();
+        return line;
+    }
+    argument = line.substr(space + 1);
+    return line.substr(0, space);
+}
+
+// "<sketch>|<histogram>"
+string ShardProtocol::encodeDistribution(const PriceDistribution& distribution) {
+    return distribution.quantiles.serialize() + "|" + distribution.histogram.serialize();
+}
+
+PriceDistribution ShardProtocol::decodeDistribution(const string& text) {
+    size_t separator = text.find('|');
+
+    PriceDistribution distribution;
+    distribution.quantiles = QuantileSketch::deserialize(text.substr(0, separator));
+    if (separator != string::npos) {
+        distribution.histogram = PriceHistogram::deserialize(text.substr(separator + 1));
+    }
+    return distribution;
+}
+
+vector<string> ShardProtocol::encodeResults(const AnalysisResults& results, const ScrapingStats& stats) {
+    vector<string> lines;
+
+    lines.push_back("RESULT books " + to_string(results.bookCount));
+    lines.push_back("RESULT fiveStar " + to_string(results.fiveStarBooks));
+    lines.push_back("RESULT totalValue " + to_string(results.totalValueMinor));
+    lines.push_back("RESULT inStock " + to_string(results.booksInStock));
+    lines.push_back("RESULT ratingSum " + to_string(results.ratingSum));
+    lines.push_back("RESULT maxBook " + BookSerializer::formatBook(results.mostExpensiveBook));
+    lines.push_back("RESULT minBook " + BookSerializer::formatBook(results.cheapestBook));
+
+    for (const auto& pair : results.ratingDistribution) {
+        lines.push_back("RESULT rating " + to_string(pair.first) + "\t" + to_string(pair.second));
+    }
+    for (const auto& pair : results.availabilityStats) {
+        lines.push_back("RESULT availability " + BookSerializer::escapeField(pair.first) + "\t" + to_string(pair.second));
+    }
+
+    // Sketches and histograms travel whole so the coordinator can merge them
+    const PriceDistributions& distributions = results.priceDistributions;
+    lines.push_back("RESULT distribution overall\t" + encodeDistribution(distributions.overall));
+    for (const auto& pair : distributions.byRating) {
+        lines.push_back("RESULT distribution rating:" + to_string(pair.first) + "\t" + encodeDistribution(pair.second));
+    }
+    for (const auto& pair : distributions.byAvailability) {
+        lines.push_back("RESULT distribution availability:" + BookSerializer::escapeField(pair.first) + "\t" + encodeDistribution(pair.second));
+    }
+
+    lines.push_back("RESULT stats " + to_string(stats.pagesProcessed.load()) + "\t" +
+        to_string(stats.booksFound.load()) + "\t" +
+        to_string(stats.failedRequests.load()) + "\t" +
+        to_string(stats.pagesUnchanged.load()));
+
+    return lines;
+}
+
+// Applies one RESULT line to a worker's partial results,
+// stats counters are added straight into the coordinator's totals
+void ShardProtocol::decodeResult(const string& argument, AnalysisResults& results, ScrapingStats& stats) {
+    string payload;
+    string field = splitCommand(argument, payload);
+
+    size_t tab = payload.find('\t');
+    string first = payload.substr(0, tab);
+    string second = tab == string::npos ? "" : payload.substr(tab + 1);
+
+    if (field == "books") {
+        results.bookCount = stoi(payload);
+    }
+    else if (field == "fiveStar") {
+        results.fiveStarBooks = stoi(payload);
+    }
+    else if (field == "totalValue") {
+        results.totalValueMinor = stoll(payload);
+    }
+    else if (field == "inStock") {
+        results.booksInStock = stoi(payload);
+    }
+    else if (field == "ratingSum") {
+        results.ratingSum = stoll(payload);
+    }
+    else if (field == "maxBook") {
+        BookSerializer::parseBook(payload, results.mostExpensiveBook);
+    }
+    else if (field == "minBook") {
+        BookSerializer::parseBook(payload, results.cheapestBook);
+    }
+    else if (field == "rating") {
+        results.ratingDistribution[stoi(first)] = stoi(second);
+    }
+    else if (field == "availability") {
+        results.availabilityStats[BookSerializer::unescapeField(first)] = stoi(second);
+    }
+    else if (field == "distribution") {
+        PriceDistribution distribution = decodeDistribution(second);
+        PriceDistributions& distributions = results.priceDistributions;
+
+        if (first == "overall") {
+            distributions.overall = distribution;
+        }
+        else if (first.compare(0, 7, "rating:") == 0) {
+            distributions.byRating[stoi(first.substr(7))] = distribution;
+        }
+        else if (first.compare(0, 13, "availability:") == 0) {
+            distributions.byAvailability[BookSerializer::unescapeField(first.substr(13))] = distribution;
+        }
+    }
+    else if (field == "stats") {
+        istringstream counters(payload);
+        int pages = 0, books = 0, failed = 0, unchanged = 0;
+        counters >> pages >> books >> failed >> unchanged;
+
+        stats.pagesProcessed += pages;
+        stats.booksFound += books;
+        stats.failedRequests += failed;
+        stats.pagesUnchanged += unchanged;
+    }
+}
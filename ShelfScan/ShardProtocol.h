@@ -0,0 +1,23 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "DataAnalyzer.h"
+#include "ScrapingStats.h"
+
+using namespace std;
+
+// Messages exchanged between the coordinator and shard workers, one per line:
+//   coordinator -> worker:  URL <url>, LINKS <url>, CRAWL, STOP
+//   worker -> coordinator:  HELLO <shard>, FOUND <url>, IDLE, RESULT <field> <value>, BYE
+class ShardProtocol {
+public:
+    static size_t ownerOf(const string& url, size_t shardCount);
+    static string splitCommand(const string& line, string& argument);
+
+    static vector<string> encodeResults(const AnalysisResults& results, const ScrapingStats& stats);
+    static void decodeResult(const string& argument, AnalysisResults& results, ScrapingStats& stats);
+
+private:
+    static string encodeDistribution(const PriceDistribution& distribution);
+    static PriceDistribution decodeDistribution(const string& text);
+};
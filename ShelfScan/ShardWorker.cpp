@@ -0,0 +1,79 @@
+#include "ShardWorker.h"
+#include "ShardProtocol.h"
+#include "IpcChannel.h"
+#include "ShelfScan.h"
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+ShardWorker::ShardWorker(int shardId, const string& socketPath, const string& outputPrefix, const ScrapeOptions& options)
+    : shardId_(shardId), socketPath_(socketPath), outputPrefix_(outputPrefix), options_(options) {
+}
+
+int ShardWorker::run() {
+    IpcChannel channel = IpcChannel::connectTo(socketPath_);
+    channel.sendLine("HELLO " + to_string(shardId_));
+
+    // Every shard keeps its own raw data and page cache
+    string shardOutput = outputPrefix_ + ".shard-" + to_string(shardId_);
+
+    ShelfScan scraper;
+    scraper.applyOptions(options_);
+    scraper.loadPreviousRun(shardOutput);
+    scraper.streamRawData(shardOutput);
+    scraper.enableLinkCollection();
+
+    vector<string> batch;
+    vector<string> linkOnly;
+    string line;
+
+    while (channel.receiveLine(line)) {
+        string argument;
+        string command = ShardProtocol::splitCommand(line, argument);
+
+        if (command == "URL") {
+            batch.push_back(argument);
+        }
+        else if (command == "LINKS") {
+            linkOnly.push_back(argument);
+        }
+        else if (command == "CRAWL") {
+            // Pages used only for discovery (e.g. index.html duplicates page 1)
+            for (const auto& url : linkOnly) {
+                try {
+                    for (const auto& link : scraper.exploreLinks(url)) {
+                        channel.sendLine("FOUND " + link);
+                    }
+                }
+                catch (const exception& e) {
+                    cerr << "[Shard " << shardId_ << "] Discovery error for " << url << ": " << e.what() << endl;
+                }
+            }
+
+            if (!batch.empty()) {
+                scraper.scrape(batch);
+            }
+
+            for (const auto& link : scraper.takeDiscoveredLinks()) {
+                channel.sendLine("FOUND " + link);
+            }
+
+            channel.sendLine("IDLE");
+            batch.clear();
+            linkOnly.clear();
+        }
+        else if (command == "STOP") {
+            AnalysisResults results = scraper.saveResults(shardOutput);
+
+            for (const auto& resultLine : ShardProtocol::encodeResults(results, scraper.stats())) {
+                channel.sendLine(resultLine);
+            }
+            channel.sendLine("BYE");
+            return 0;
+        }
+    }
+
+    cerr << "[Shard " << shardId_ << "] Coordinator closed the connection" << endl;
+    return 1;
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <string>
+#include "ScrapeOptions.h"
+
+using namespace std;
+
+// Worker process of a sharded crawl. Connects to the coordinator, scrapes the
+// URLs it is given (all owned by this shard), reports discovered links and
+// finally sends its partial AnalysisResults back for merging.
+class ShardWorker {
+public:
+    ShardWorker(int shardId, const string& socketPath, const string& outputPrefix, const ScrapeOptions& options);
+
+    int run();
+
+private:
+    int shardId_;
+    string socketPath_;
+    string outputPrefix_;
+    ScrapeOptions options_;
+};
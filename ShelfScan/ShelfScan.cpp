@@ -2,15 +2,19 @@
 #include <iostream>
 #include <iomanip>
 
-#include <tbb/parallel_pipeline.h>
-#include <tbb/task_group.h>
-#include <tbb/concurrent_queue.h>
+#include <tbb/flow_graph.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_for_each.h>
 
 using namespace chrono;
 
+// Pages between fetch and the end of the crawl graph
 const size_t PIPELINE_TOKENS = max<unsigned int>(2, thread::hardware_concurrency() * 2);
-const int DISCOVERY_GROUP_WORKERS = max<unsigned int>(2, thread::hardware_concurrency());
-const int MAX_PAGES = 50;
+// Listing pages whose product pages are fetched at the same time, each one
+// fans out to all of its books
+const size_t DETAIL_STAGE_CONCURRENCY = max<unsigned int>(2, thread::hardware_concurrency());
+// Pages whose covers are downloaded at the same time
+const size_t COVER_STAGE_CONCURRENCY = max<unsigned int>(1, thread::hardware_concurrency() / 2);
 
 ShelfScan::ShelfScan() {
     cout << "ShelfScan initialized." << endl;
@@ -21,183 +25,615 @@ ShelfScan::~ShelfScan() {
     cout << "ShelfScan finished." << endl;
 }
 
-// TBB Pipeline divided into 3 stages:
-// (1) Generate URLs
-// (2) Download pages
-// (3) Parse & store results
-void ShelfScan::scrapeWithPipeline(const vector<string>& urls) {
-    cout << "Starting parallel scraping for " << urls.size() << " URL(s)." << endl;
+// Loads page validators and books saved by the previous run (<filename>.cache),
+// afterwards unchanged pages are detected and skipped instead of re-parsed
+bool ShelfScan::loadPreviousRun(const string& filename) {
+    incremental_ = previousPages_.load(filename + ".cache");
+    budget_.reserve(MemoryUse::PageCache, previousPages_.memoryBytes());
+    if (!incremental_) {
+        cout << "No previous run found, doing a full scrape." << endl;
+    }
+    return incremental_;
+}
 
-    stats_.startTime = steady_clock::now();
+// Downloads a page, conditionally if the previous run saw it.
+// Page is unchanged when the server answers 304 or the body hashes the same.
+HttpResponse ShelfScan::fetchPage(const string& url, PageCacheEntry& cached, bool& unchanged) {
+    unchanged = false;
+    bool known = incremental_ && previousPages_.lookup(url, cached);
 
-    atomic<size_t> url_index{ 0 };
+    HttpResponse response = known
+        ? downloader_.fetchWithRetry(url, cached.etag, cached.lastModified)
+        : downloader_.fetchWithRetry(url);
 
-    tbb::parallel_pipeline(PIPELINE_TOKENS, tbb::make_filter<void, string>(
-        tbb::filter_mode::serial_in_order,
-        // Stage 1: Get next URL
-        [&](tbb::flow_control& fc) -> string {
-            size_t index = url_index.fetch_add(1);
-            if (index >= urls.size()) {
-                fc.stop();  // stop pipeline when all URLs processed
-                return "";
-            }
-            cout << "Pipeline: Generating URL " << (index + 1) << "/" << urls.size() << "\n";
-            return urls[index];
+    uint64_t contentHash;
+    if (response.notModified()) {
+        unchanged = true;
+        contentHash = cached.contentHash;
+
+        // 304 may omit validators, keep the old ones then
+        if (response.etag.empty()) {
+            response.etag = cached.etag;
+        }
+        if (response.lastModified.empty()) {
+            response.lastModified = cached.lastModified;
         }
-    ) &
+    }
+    else {
+        contentHash = PageCache::hashContent(response.body);
+        unchanged = known && contentHash == cached.contentHash;
+    }
 
-        // Stage 2: Download HTML content from URL
-        tbb::make_filter<string, pair<string, string>>(tbb::filter_mode::parallel,
-            [this](string url) -> pair<string, string> {
-                try {
-                    if (visitedUrls_.count(url) > 0) {
-                        return make_pair(url, "");  // skip already visited
-                    }
+    currentPages_.storeValidators(url, contentHash, response.etag, response.lastModified);
+    return response;
+}
 
-                    visitedUrls_.insert(url);
+// Books are also written to <filename>.json while the crawl runs
+void ShelfScan::streamRawData(const string& filename) {
+    // UPC repeats, duplicates and the output order are only known after the
+    // crawl, the raw data is written then
+    if (fetchDetails_ || dedup_ || outputOrder_ != SortKey::None) {
+        return;
+    }
+    writer_.openRawData(filename);
+}
 
-                    // Download page
-                    cout << "Pipeline: Downloading " << url << "\n";
-                    string html_content = downloader_.downloadWithRetry(url);
-                    stats_.pagesProcessed++;
+static void copyDetails(const BookData& from, BookData& to) {
+    to.upc = from.upc;
+    to.stockCount = from.stockCount;
+    to.category = from.category;
+    to.description = from.description;
+}
 
-                    return make_pair(url, html_content);
+// Reads a book's product page, conditionally if the previous run saw it. The
+// parsed fields are cached with the page, so an unchanged one isn't read again.
+// False if the page failed or has no UPC.
+bool ShelfScan::fetchDetail(const string& pageUrl, BookData& book) {
+    book.detailUrl = HtmlParser::resolveUrl(pageUrl, book.detailUrl);
 
-                }
-                catch (const exception& e) {
-                    stats_.failedRequests++;
-                    cerr << "Pipeline download error for " << url << ": " << e.what() << endl;
-                    return make_pair(url, "");
-                }
-            }
-        ) &
+    try {
+        PageCacheEntry cached;
+        bool unchanged = false;
+        HttpResponse response = fetchPage(book.detailUrl, cached, unchanged);
+        stats_.detailPages++;
 
-        // Stage 3: Parse HTML content and store extracted books
-        tbb::make_filter<pair<string, string>, void>(tbb::filter_mode::parallel, [this](pair<string, string> urlContent) {
-            if (urlContent.second.empty()) {
-                return;
+        if (unchanged && cached.productPage && !cached.books.empty()) {
+            copyDetails(cached.books.front(), book);
+        }
+        else {
+            if (response.notModified()) {
+                response = downloader_.fetchWithRetry(book.detailUrl);
+            }
+            if (!parser_.parseProductPage(response.body, book)) {
+                return false;
             }
+        }
 
-            try {
-                cout << "Pipeline: Parsing " << urlContent.first << endl;
+        BookData details;
+        copyDetails(book, details);
+        currentPages_.storeDetails(book.detailUrl, details);
+        return true;
+    }
+    catch (const exception& e) {
+        stats_.failedRequests++;
+        cerr << "Detail page error for " << book.detailUrl << ": " << e.what() << endl;
 
-                auto books = parser_.parseBooksFromHtml(urlContent.second);
+        PageCacheEntry cached;
+        if (incremental_ && previousPages_.lookup(book.detailUrl, cached)) {
+            currentPages_.store(book.detailUrl, cached);
+        }
+        return false;
+    }
+}
 
-                for (const auto& book : books) {
-                    scrapedBooks_.push_back(book);
-                }
+// Fans a listing page out to the product pages of its books
+void ShelfScan::fetchDetails(CrawlPage& page) {
+    tbb::parallel_for_each(page.books.begin(), page.books.end(), [&](BookData& book) {
+        if (!book.detailUrl.empty()) {
+            fetchDetail(page.url, book);
+        }
+    });
+}
+
+// Downloads covers of a page's books into the image store and records their hashes
+void ShelfScan::fetchCovers(vector<BookData>& books) {
+    tbb::parallel_for_each(books.begin(), books.end(), [this](BookData& book) {
+        // Reused books from an unchanged page may already have theirs
+        if (book.imageUrl.empty() || images_->contains(book.imageHash)) {
+            return;
+        }
+        book.imageHash = images_->fetch(downloader_, book.imageUrl);
+    });
+}
+
+vector<ShelfScan::PageStage> ShelfScan::pageStages() {
+    vector<PageStage> stages;
+
+    if (fetchDetails_) {
+        stages.push_back(PageStage{ "details", DETAIL_STAGE_CONCURRENCY, [this](CrawlPage& page) {
+            fetchDetails(page);
+        } });
+    }
+
+    if (images_) {
+        stages.push_back(PageStage{ "covers", COVER_STAGE_CONCURRENCY, [this](CrawlPage& page) {
+            fetchCovers(page.books);
+        } });
+    }
 
-                stats_.booksFound += static_cast<int>(books.size());
+    return stages;
+}
+
+// Crawls from seedUrl. Listing pages known up front (sitemap, page count)
+// all enter the frontier at once; pagination links found while parsing are
+// still fed back, so pages the seeding missed are discovered as before.
+void ShelfScan::crawl(const string& seedUrl) {
+    startDeadline();
+
+    vector<string> seeds = seeder_.seed(seedUrl);
+    if (seeds.empty()) {
+        seeds.push_back(seedUrl);
+    }
+    runGraph(seeds, true);
+}
 
-                cout << "Pipeline: Stored " << books.size() << " books from " << urlContent.first << endl;
+// Scrapes exactly the given pages, links are collected instead of followed
+void ShelfScan::scrape(const vector<string>& urls) {
+    startDeadline();
+    runGraph(urls, false);
+}
 
+void ShelfScan::startDeadline() {
+    if (timeLimit_.count() > 0 && !deadlineStarted_) {
+        downloader_.setDeadline(steady_clock::now() + timeLimit_);
+        deadlineStarted_ = true;
+    }
+}
+
+// Download stage, failures are counted and leave page.html empty
+void ShelfScan::downloadPage(CrawlPage& page, bool needLinks) {
+    try {
+        cout << "Graph: Downloading " << page.url << "\n";
+        HttpResponse response = fetchPage(page.url, page.cached, page.unchanged);
+
+        // Unchanged page we never parsed (e.g. seen only by discovery),
+        // needs a real parse after all
+        bool missingBooks = !page.linksOnly && page.cached.books.empty();
+        bool missingLinks = needLinks && page.cached.links.empty();
+        if (page.unchanged && (missingBooks || missingLinks)) {
+            page.unchanged = false;
+            if (response.notModified()) {
+                response = downloader_.fetchWithRetry(page.url);
             }
-            catch (const exception& e) {
-                cerr << "Pipeline parse error for " << urlContent.first << ": " << e.what() << endl;
+        }
+
+        page.html = move(response.body);
+        page.bufferBytes = page.html.capacity();
+        budget_.reserve(MemoryUse::PageBuffers, page.bufferBytes);
+        stats_.pagesProcessed++;
+    }
+    catch (const exception& e) {
+        stats_.failedRequests++;
+        failedUrls_.insert(page.url);
+        cerr << "Graph download error for " << page.url << ": " << e.what() << endl;
+
+        // Keep what we knew about the page for the next run
+        PageCacheEntry cached;
+        if (incremental_ && previousPages_.lookup(page.url, cached)) {
+            currentPages_.store(page.url, cached);
+        }
+    }
+}
+
+// Parse stage, fills page.books and the pagination links of the page
+void ShelfScan::parsePage(CrawlPage& page, vector<string>& links) {
+    if (page.unchanged) {
+        // Nothing changed since the last run, reuse its books and links
+        if (!page.linksOnly) {
+            page.books = move(page.cached.books);
+        }
+        links = page.cached.links;
+        page.parsed = true;
+        stats_.pagesUnchanged++;
+
+        cout << "Graph: Unchanged " << page.url << ", reused " << page.books.size() << " books" << endl;
+    }
+    else if (!page.html.empty()) {
+        try {
+            cout << "Graph: Parsing " << page.url << endl;
+
+            if (page.linksOnly) {
+                links = parser_.extractPageLinks(page.html, page.url);
             }
+            else {
+                parser_.parsePage(page.html, page.url, page.books, links);
             }
-        )
-    );
+            page.parsed = true;
+        }
+        catch (const exception& e) {
+            cerr << "Graph parse error for " << page.url << ": " << e.what() << endl;
+        }
+    }
 
-    stats_.endTime = steady_clock::now();
+    // Page buffers aren't needed past this point
+    string().swap(page.html);
+    budget_.release(MemoryUse::PageBuffers, page.bufferBytes);
+    page.bufferBytes = 0;
+    page.cached = PageCacheEntry();
 
-    cout << "Pipeline scraping finished!\n";
-    printStatistics();
+    if (page.parsed) {
+        currentPages_.storeLinks(page.url, links);
+    }
 }
 
-// Auto-discover multiple page URLs starting from a base URL
-vector<string> ShelfScan::autoDiscoverUrls(const string& baseUrl) {
-    cout << "Auto URL indexing for " << baseUrl << "..." << endl;
-
-    tbb::concurrent_unordered_set<string> discoveredUrls;
-    tbb::concurrent_bounded_queue<string> urlsToProcess;
-
-    urlsToProcess.push(baseUrl);
-
-    atomic<int> totalProcessed{ 0 };
-    tbb::task_group discoveryGroup;
-
-    // thread::hardware_concurrency() can return 0 if the number of cores is unknown,
-    // so in that case it's set to 1
-    int numWorkers = DISCOVERY_GROUP_WORKERS;
-    if (numWorkers == 0) {
-        numWorkers = 1;
-    }
-
-    // Launch workers to explore new URLs concurrently
-    for (int i = 0; i < numWorkers; ++i) {
-        discoveryGroup.run([&, i] {
-            try {
-                while (true) {
-                    string currentUrl;
-                    // Worker waits for next url if it's empty
-                    urlsToProcess.pop(currentUrl);
-
-                    // Skip if already processed
-                    if (discoveredUrls.count(currentUrl) > 0) {
-                        continue;
-                    }
-
-                    discoveredUrls.insert(currentUrl);
-                    int processedNow = ++totalProcessed;
-
-                    cout << "[Discovery Worker " << i << "] Exploring: " << currentUrl
-                        << " (" << processedNow << " processed)" << endl;
-
-                    // Download current page & extract links
-                    string htmlContent = downloader_.downloadWithRetry(currentUrl);
-                    auto newUrls = parser_.extractPageLinks(htmlContent);
-
-                    int newFound = 0;
-                    for (const auto& newUrl : newUrls) {
-                        // Accept only catalogue or site links
-                        if ((newUrl.find("catalogue/page-") != string::npos ||
-                            newUrl.find("books.toscrape.com") != string::npos) &&
-                            discoveredUrls.count(newUrl) == 0) {
-                            urlsToProcess.push(newUrl);
-                            newFound++;
-                        }
-                    }
-
-                    cout << "[Discovery Worker " << i << "] Found " << newFound
-                        << " new URLs from " << currentUrl << endl;
-
-                    // Stop discovery when page limit reached
-                    if (processedNow >= MAX_PAGES) {
-                        cout << "Reached maximum page limit (" << MAX_PAGES << ")" << endl;
-                        urlsToProcess.abort();
-                        break;
-                    }
+void ShelfScan::storePage(CrawlPage& page) {
+    if (!page.parsed || page.linksOnly) {
+        return;
+    }
+
+    // The store keeps the only copy, the page cache reads it back on save
+    scrapedBooks_.append(page.url, page.books);
+    stats_.booksFound += static_cast<int>(page.books.size());
+
+    cout << "Graph: Stored " << page.books.size() << " books from " << page.url << endl;
+}
+
+void ShelfScan::updateLiveResults(const CrawlPage& page) {
+    if (page.books.empty()) {
+        return;
+    }
+
+    tbb::concurrent_vector<BookData> books(page.books.begin(), page.books.end());
+    AnalysisResults pageResults = analyzer_.analyzeData(books);
+
+    lock_guard<mutex> lock(liveMutex_);
+    liveResults_ = DataAnalyzer::mergeResults(liveResults_, pageResults);
+
+    cout << "Live: " << liveResults_.bookCount << " books, average price "
+        << fixed << setprecision(2) << liveResults_.averagePrice << " GBP" << endl;
+}
+
+// Flow graph of the crawl:
+//
+//   frontier -> queue -> limiter -> throttle -> fetch -> parse --(links)--> frontier
+//                          ^                               |
+//                          |                 page stages (details, covers)
+//                          |                               |
+//                          |                             store -> live analytics --+
+//                          |                               |                       |
+//                          |                               +----> raw data writer -+-> join
+//                          |                                                            |
+//                          +------------------------------------------------------------+
+//
+// The limiter bounds pages between fetch and the end of the graph, so page
+// buffers are bounded no matter how many URLs wait in the frontier queue;
+// the throttle holds downloads back while the memory budget is exceeded.
+void ShelfScan::runGraph(const vector<string>& seeds, bool followLinks) {
+    using namespace tbb::flow;
+
+    cout << "Starting crawl graph for " << seeds.size() << " seed URL(s)." << endl;
+
+    stats_.startTime = steady_clock::now();
+
+    graph g;
+    int pagesAccepted = 0;
+    bool needLinks = followLinks || collectLinks_;
+
+    // Frontier: drops visited URLs and caps the crawl at maxPages_ scraped pages.
+    // Past the deadline nothing new gets in, so the graph drains and the
+    // pages stored so far make up the results.
+    multifunction_node<string, tuple<CrawlPageRef>> frontier(g, serial,
+        [&](const string& url, multifunction_node<string, tuple<CrawlPageRef>>::output_ports_type& ports) {
+            if (visitedUrls_.count(url) > 0 || downloader_.expired()) {
+                return;
+            }
+
+            auto page = make_shared<CrawlPage>();
+            page->url = url;
+            page->linksOnly = followLinks && url.find("index.html") != string::npos;
+
+            if (followLinks && !page->linksOnly) {
+                if (pagesAccepted >= maxPages_) {
+                    return;
                 }
+                pagesAccepted++;
             }
-            catch (const tbb::user_abort&) {
-                cout << "[Discovery Worker " << i << "] Aborted (queue closed)" << endl;
+
+            visitedUrls_.insert(url);
+            budget_.reserve(MemoryUse::Urls, sizeof(string) + url.size());
+            get<0>(ports).try_put(page);
+        });
+
+    queue_node<CrawlPageRef> pending(g);
+    limiter_node<CrawlPageRef> inFlight(g, PIPELINE_TOKENS);
+
+    // Holds downloads back while over the memory budget, serial so that only
+    // one thread waits and the others keep parsing and storing
+    function_node<CrawlPageRef, CrawlPageRef> throttle(g, serial, [&](CrawlPageRef page) {
+        budget_.waitForRoom();
+        return page;
+    });
+
+    function_node<CrawlPageRef, CrawlPageRef> fetch(g, unlimited, [&](CrawlPageRef page) {
+        downloadPage(*page, needLinks);
+        return page;
+    });
+
+    // Parse: books go on, links go back to the frontier (or to the coordinator)
+    typedef multifunction_node<CrawlPageRef, tuple<CrawlPageRef, string>> ParseNode;
+    ParseNode parse(g, unlimited, [&](CrawlPageRef page, ParseNode::output_ports_type& ports) {
+        vector<string> links;
+        parsePage(*page, links);
+
+        for (const auto& link : links) {
+            if (!followLinks) {
+                if (collectLinks_) {
+                    discoveredLinks_.push_back(link);
+                }
             }
-            catch (const exception& e) {
-                cerr << "Discovery error in worker " << i << ": " << e.what() << endl;
+            else if (isCatalogueUrl(link)) {
+                get<1>(ports).try_put(link);
             }
+        }
+        get<0>(ports).try_put(page);
+    });
+
+    vector<unique_ptr<function_node<CrawlPageRef, CrawlPageRef>>> stages;
+    for (auto& stage : pageStages()) {
+        auto run = stage.run;
+        stages.emplace_back(new function_node<CrawlPageRef, CrawlPageRef>(g, stage.concurrency,
+            [run](CrawlPageRef page) {
+                if (page->parsed && !page->linksOnly) {
+                    run(*page);
+                }
+                return page;
+            }));
+    }
+
+    function_node<CrawlPageRef, CrawlPageRef> store(g, unlimited, [&](CrawlPageRef page) {
+        storePage(*page);
+        return page;
+    });
 
-            cout << "[Discovery Worker " << i << "] Finished" << endl;
-            });
+    function_node<CrawlPageRef, continue_msg> analytics(g, serial, [&](CrawlPageRef page) {
+        if (page->parsed && !page->linksOnly) {
+            updateLiveResults(*page);
+        }
+        return continue_msg();
+    });
+
+    function_node<CrawlPageRef, continue_msg> rawWriter(g, serial, [&](CrawlPageRef page) {
+        if (page->parsed && !page->linksOnly && writer_.isStreamingRawData()) {
+            writer_.appendRawData(page->books);
+        }
+        return continue_msg();
+    });
+
+    // A page leaves the graph once both sinks are done with it
+    join_node<tuple<continue_msg, continue_msg>> done(g);
+    function_node<tuple<continue_msg, continue_msg>, continue_msg> release(g, unlimited,
+        [](const tuple<continue_msg, continue_msg>&) { return continue_msg(); });
+
+    make_edge(frontier, pending);
+    make_edge(pending, inFlight);
+    make_edge(inFlight, throttle);
+    make_edge(throttle, fetch);
+    make_edge(fetch, parse);
+    make_edge(output_port<1>(parse), frontier);
+
+    sender<CrawlPageRef>* last = &output_port<0>(parse);
+    for (auto& stage : stages) {
+        make_edge(*last, *stage);
+        last = stage.get();
     }
+    make_edge(*last, store);
 
-    discoveryGroup.wait();
+    make_edge(store, analytics);
+    make_edge(store, rawWriter);
+    make_edge(analytics, input_port<0>(done));
+    make_edge(rawWriter, input_port<1>(done));
+    make_edge(done, release);
+    make_edge(release, inFlight.decrementer());
+
+    for (const auto& url : seeds) {
+        frontier.try_put(url);
+    }
+    g.wait_for_all();
 
-    // Convert discovered URLs into normal vector for sorting
-    vector<string> result;
-    for (const auto& url : discoveredUrls) {
-        // Skip index.html since we already processed it during discovery
-        if (url.find("index.html") == string::npos) {
-            result.push_back(url);
+    stats_.endTime = steady_clock::now();
+
+    if (downloader_.expired()) {
+        cout << "Crawl stopped at the time limit or by cancellation, results are partial.\n";
+    }
+    cout << "Crawl graph finished!\n";
+    printStatistics();
+}
+
+// Prepares the next run in the same process. What this run saw becomes the
+// previous run, kept in memory instead of going through the .cache file;
+// downloader connections, parser, seeder and image store stay as they are.
+void ShelfScan::reset() {
+    scrapedBooks_.forEachPage([this](const string& url, const vector<BookData>& books) {
+        currentPages_.storeBooks(url, books);
+    });
+
+    budget_.release(MemoryUse::PageCache, previousPages_.memoryBytes());
+    previousPages_.swap(currentPages_);
+    currentPages_.clear();
+    budget_.reserve(MemoryUse::PageCache, previousPages_.memoryBytes());
+    incremental_ = !previousPages_.empty();
+
+    scrapedBooks_.clear();
+    outputBooks_.reset();
+    budget_.release(MemoryUse::Urls, budget_.used(MemoryUse::Urls));
+    visitedUrls_.clear();
+    failedUrls_.clear();
+    discoveredLinks_.clear();
+
+    downloader_.clearDeadline();
+    downloader_.resetBreakers();
+    deadlineStarted_ = false;
+
+    stats_.pagesProcessed = 0;
+    stats_.booksFound = 0;
+    stats_.failedRequests = 0;
+    stats_.pagesUnchanged = 0;
+    stats_.detailPages = 0;
+    stats_.duplicateBooks = 0;
+
+    lock_guard<mutex> lock(liveMutex_);
+    liveResults_ = AnalysisResults();
+}
+
+// Pagination links of a page, unchanged pages reuse the links found last time
+vector<string> ShelfScan::exploreLinks(const string& url) {
+    PageCacheEntry cached;
+    bool unchanged = false;
+    HttpResponse response = fetchPage(url, cached, unchanged);
+
+    vector<string> links;
+    if (unchanged && !cached.links.empty()) {
+        links = cached.links;
+    }
+    else {
+        if (response.notModified()) {
+            response = downloader_.fetchWithRetry(url);
         }
+        links = parser_.extractPageLinks(response.body, url);
     }
 
-    sort(result.begin(), result.end());
-    cout << "Auto discovery completed. Found " << result.size() << " unique URLs." << endl;
+    currentPages_.storeLinks(url, links);
+    return links;
+}
 
-    return result;
+bool ShelfScan::isCatalogueUrl(const string& url) {
+    return url.find("catalogue/page-") != string::npos ||
+        url.find("books.toscrape.com") != string::npos;
 }
 
+// Makes the pipeline keep pagination links of parsed pages (used by shard workers)
+void ShelfScan::enableLinkCollection() {
+    collectLinks_ = true;
+}
+
+void ShelfScan::setSchema(const ExtractionSchema& schema) {
+    parser_.setSchema(schema);
+}
+
+// Adds a crawl level: every listed book's product page is read for its UPC,
+// stock count, category and description, and books are joined by UPC
+void ShelfScan::enableDetails() {
+    fetchDetails_ = true;
+}
+
+void ShelfScan::setMaxPages(int pages) {
+    maxPages_ = pages;
+}
+
+void ShelfScan::setTimeLimit(chrono::seconds limit) {
+    timeLimit_ = limit;
+}
+
+void ShelfScan::setUrlTimeout(chrono::seconds timeout) {
+    downloader_.setUrlTimeout(timeout);
+}
+
+void ShelfScan::cancel() {
+    downloader_.cancel();
+}
+
+void ShelfScan::setSitemap(const string& url) {
+    seeder_.setSitemap(url);
+}
+
+void ShelfScan::enableImages(const string& directory) {
+    images_.reset(new ImageStore(directory));
+    cout << "Cover images are stored in " << directory << endl;
+}
+
+void ShelfScan::enableHistory(const string& directory) {
+    history_.reset(new PriceHistory(directory));
+    cout << "Price history is kept in " << directory << endl;
+}
+
+void ShelfScan::enableDedup() {
+    dedup_ = true;
+    cout << "Duplicate listings are removed before the analysis" << endl;
+}
+
+void ShelfScan::enableColumnar() {
+    columnar_ = true;
+}
+
+void ShelfScan::setOutputOrder(SortKey key) {
+    outputOrder_ = key;
+    cout << "Output is ordered by " << BookSorter::keyName(key) << endl;
+}
+
+// Covers page buffers, stored books, URL sets and the page cache
+void ShelfScan::setMemoryBudget(size_t bytes) {
+    budget_.setLimit(bytes);
+    cout << "Memory budget: " << bytes / (1024 * 1024) << " MB" << endl;
+}
+
+void ShelfScan::applyOptions(const ScrapeOptions& options) {
+    if (!options.schemaFile.empty()) {
+        setSchema(ExtractionSchema::load(options.schemaFile));
+    }
+    if (!options.sitemapUrl.empty()) {
+        setSitemap(options.sitemapUrl);
+    }
+    if (options.maxPages > 0) {
+        setMaxPages(options.maxPages);
+    }
+    if (options.timeLimitSeconds > 0) {
+        setTimeLimit(chrono::seconds(options.timeLimitSeconds));
+    }
+    if (options.urlTimeoutSeconds > 0) {
+        setUrlTimeout(chrono::seconds(options.urlTimeoutSeconds));
+    }
+    if (options.fetchDetails) {
+        enableDetails();
+    }
+    if (!options.imageDir.empty()) {
+        enableImages(options.imageDir);
+    }
+    if (options.memoryBudgetMb > 0) {
+        setMemoryBudget(options.memoryBudgetMb * 1024 * 1024);
+    }
+    if (!options.historyDir.empty()) {
+        enableHistory(options.historyDir);
+    }
+    if (options.dedup) {
+        enableDedup();
+    }
+    if (options.columnar) {
+        enableColumnar();
+    }
+    if (!options.outputOrder.empty()) {
+        setOutputOrder(BookSorter::parseKey(options.outputOrder));
+    }
+}
+
+vector<string> ShelfScan::takeDiscoveredLinks() {
+    vector<string> links(discoveredLinks_.begin(), discoveredLinks_.end());
+    discoveredLinks_.clear();
+    return links;
+}
+
+const ScrapingStats& ShelfScan::stats() const {
+    return stats_;
+}
+
+AnalysisResults ShelfScan::liveResults() const {
+    lock_guard<mutex> lock(liveMutex_);
+    return liveResults_;
+}
+
+// The books of the output files once saved, the scraped ones before
+vector<BookData> ShelfScan::snapshotBooks() const {
+    return outputBooks_ ? outputBooks_->snapshot() : scrapedBooks_.snapshot();
+}
 
 void ShelfScan::printStatistics() const {
     auto duration = duration_cast<milliseconds>(stats_.endTime - stats_.startTime);
@@ -206,6 +642,7 @@ void ShelfScan::printStatistics() const {
     cout << "Pages processed: " << stats_.pagesProcessed.load() << "\n";
     cout << "Books found: " << stats_.booksFound.load() << "\n";
     cout << "Failed requests: " << stats_.failedRequests.load() << "\n";
+    cout << "Unchanged pages: " << stats_.pagesUnchanged.load() << "\n";
     cout << "Total time: " << duration.count() << " ms\n";
 
     if (duration.count() > 0) {
@@ -218,22 +655,127 @@ void ShelfScan::printStatistics() const {
     }
 
     cout << "Unique URLs: " << visitedUrls_.size() << "\n";
+    cout << "Memory: peak " << budget_.peak() / 1024 << " KB";
+    if (budget_.limit() > 0) {
+        cout << " of " << budget_.limit() / (1024 * 1024) << " MB budget, "
+            << budget_.throttled() << " downloads throttled, "
+            << scrapedBooks_.spilledSegments() << " segments spilled";
+    }
+    cout << "\n";
+
+    const CircuitBreaker& breakers = downloader_.breakers();
+    if (breakers.trips() > 0) {
+        cout << "Circuit breakers: " << breakers.trips() << " trips, "
+            << breakers.rejected() << " requests refused\n";
+    }
+    if (fetchDetails_) {
+        cout << "Product pages: " << stats_.detailPages.load() << " read\n";
+    }
+    if (images_) {
+        cout << "Cover images: " << images_->downloaded() << " stored, " << images_->duplicates() << " duplicates\n";
+    }
     cout << "================================\n\n";
 }
 
-void ShelfScan::saveResults(const string& filename) {
+// Keeps the first listing of every duplicate cluster and reports the clusters
+// in <filename>.duplicates.json
+void ShelfScan::removeDuplicates(BookStore& books, const string& filename) {
+    DuplicateDetector detector;
+    vector<DuplicateCluster> clusters = detector.remove(books);
+    writer_.writeDuplicates(filename, clusters);
+
+    size_t exact = 0;
+    size_t removed = 0;
+    for (const auto& cluster : clusters) {
+        exact += cluster.exact ? 1 : 0;
+        removed += cluster.positions.size() - 1;
+    }
+    cout << "Duplicates: " << removed << " listings removed from " << clusters.size()
+        << " clusters (" << exact << " exact), " << detector.candidatePairs() << " candidate pairs compared\n";
+}
+
+const BookStore& ShelfScan::prepareOutput(const string& filename) {
+    outputBooks_.reset();
+    if (!fetchDetails_ && !dedup_ && outputOrder_ == SortKey::None) {
+        return scrapedBooks_;
+    }
 
-    vector<BookData> booksCopy;
+    // Spills like the scraped store, both count against the budget
+    outputBooks_.reset(new BookStore(budget_));
+    if (outputOrder_ != SortKey::None) {
+        BookSorter sorter(budget_, outputOrder_);
+        sorter.sort(scrapedBooks_, *outputBooks_);
+        cout << "Sorted " << outputBooks_->size() << " books by " << BookSorter::keyName(outputOrder_);
+        if (sorter.runCount() > 0) {
+            cout << " (external sort, " << sorter.runCount() << " run files)";
+        }
+        cout << "\n";
+    }
+    else {
+        scrapedBooks_.forEachPage([this](const string& url, const vector<BookData>& books) {
+            outputBooks_->append(url, books);
+        });
+    }
 
-    for (const auto& book : scrapedBooks_) {
-        booksCopy.push_back(book);
+    // Same product page listed twice, the first copy in page order is kept
+    if (fetchDetails_) {
+        vector<size_t> repeated = DuplicateDetector::repeatedUpcs(*outputBooks_);
+        outputBooks_->erase(repeated);
+        stats_.duplicateBooks = static_cast<int>(repeated.size());
+        cout << "Product pages: " << repeated.size() << " listings left out by UPC\n";
     }
 
-    auto analysisResults = analyzer_.analyzeData(scrapedBooks_);
+    // Duplicate listings would be counted once per page they appear on
+    if (dedup_) {
+        removeDuplicates(*outputBooks_, filename);
+    }
+
+    return *outputBooks_;
+}
+
+AnalysisResults ShelfScan::saveResults(const string& filename) {
+    const BookStore& outputBooks = prepareOutput(filename);
+
+    auto analysisResults = analyzer_.analyzeStore(outputBooks);
     
     // Saves analysis stats to .txt file
     writer_.writeResults(filename, analysisResults, stats_);
     
-    // Saves all books to .json file
-    writer_.writeRawData(filename, scrapedBooks_);
+    // Saves all books to .json file, unless they were streamed there already
+    if (writer_.isStreamingRawData()) {
+        writer_.closeRawData();
+    }
+    else {
+        writer_.writeRawData(filename, outputBooks);
+    }
+
+    // Saves all books to the binary .columns file
+    if (columnar_) {
+        writer_.writeTable(filename, outputBooks);
+    }
+
+    // Saves analysis with price distributions to .stats.json file
+    writer_.writeAnalysis(filename, analysisResults);
+
+    // Saves added / removed / changed books compared to the previous run
+    if (incremental_) {
+        auto delta = analyzer_.computeDelta(previousPages_.allBooksExcept(failedUrls_), scrapedBooks_);
+        writer_.writeDelta(filename, delta);
+
+        cout << "Changes since last run: " << delta.added.size() << " added, "
+            << delta.removed.size() << " removed, "
+            << delta.changed.size() << " changed\n";
+    }
+
+    // Remembers page validators for the next run
+    currentPages_.save(filename + ".cache", scrapedBooks_);
+
+    // Adds this run's prices to the price history
+    if (history_) {
+        history_->record(outputBooks, duration_cast<seconds>(system_clock::now().time_since_epoch()).count());
+        cout << "Price history: " << outputBooks.size() << " observations recorded, "
+            << history_->segmentCount() << " compacted segments\n";
+    }
+
+    return analysisResults;
 }
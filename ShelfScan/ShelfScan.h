@@ -1,4 +1,8 @@
 #pragma once
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <tbb/concurrent_unordered_set.h>
@@ -7,25 +11,130 @@
 #include "HtmlParser.h"
 #include "DataAnalyzer.h"
 #include "FileWriter.h"
+#include "PageCache.h"
+#include "ImageStore.h"
+#include "ScrapeOptions.h"
+#include "CrawlPage.h"
+#include "CrawlSeeder.h"
+#include "BookStore.h"
+#include "MemoryBudget.h"
+#include "PriceHistory.h"
+#include "DuplicateDetector.h"
+#include "BookSorter.h"
 
 class ShelfScan {
 private:
     HttpDownloader downloader_;
     HtmlParser parser_;
+    CrawlSeeder seeder_{ downloader_, parser_ };
     DataAnalyzer analyzer_;
     FileWriter writer_;
-    tbb::concurrent_vector<BookData> scrapedBooks_;
+    MemoryBudget budget_;
+    BookStore scrapedBooks_{ budget_ };
     tbb::concurrent_unordered_set<string> visitedUrls_;
-    tbb::concurrent_unordered_set<std::string> seenTitles_;
+    tbb::concurrent_unordered_set<string> failedUrls_;
     ScrapingStats stats_;
 
+    // Incremental re-scrape: what the previous run saw and what this one sees
+    PageCache previousPages_;
+    PageCache currentPages_;
+    bool incremental_ = false;
+    int maxPages_ = MAX_PAGES;
+
+    // Counts from the first crawl or scrape after construction or reset()
+    chrono::seconds timeLimit_{ 0 };
+    bool deadlineStarted_ = false;
+    void startDeadline();
+
+    // Pagination links found while parsing, handed to the shard coordinator
+    bool collectLinks_ = false;
+    tbb::concurrent_vector<string> discoveredLinks_;
+
+    // Product pages of listed books, fetched only when enabled. Books with a
+    // UPC already listed on an earlier page are left out of the output.
+    bool fetchDetails_ = false;
+
+    // Cover images, fetched only when a store directory is set
+    unique_ptr<ImageStore> images_;
+
+    // Every run's prices are appended here when enabled
+    unique_ptr<PriceHistory> history_;
+
+    // Duplicate listings are left out of the output when enabled
+    bool dedup_ = false;
+    void removeDuplicates(BookStore& books, const string& filename);
+
+    // Books are also written to <filename>.columns when enabled
+    bool columnar_ = false;
+
+    // Order of the books in the output files, the store keeps crawl order
+    SortKey outputOrder_ = SortKey::None;
+
+    // The store keeps every page's books as the page lists them, for the page
+    // cache and the delta. What the output files get (UPC repeats and
+    // duplicates left out, in the output order) is derived into this one when
+    // it differs.
+    unique_ptr<BookStore> outputBooks_;
+    const BookStore& prepareOutput(const string& filename);
+
+    // Running analysis of the books stored so far
+    mutable mutex liveMutex_;
+    AnalysisResults liveResults_;
+
+    // Optional work on a parsed page before it is stored (cover images, ...),
+    // every stage is its own graph node with its own concurrency limit
+    struct PageStage {
+        string name;
+        size_t concurrency;
+        function<void(CrawlPage&)> run;
+    };
+    vector<PageStage> pageStages();
+
+    void runGraph(const vector<string>& seeds, bool followLinks);
+    void downloadPage(CrawlPage& page, bool needLinks);
+    void parsePage(CrawlPage& page, vector<string>& links);
+    void storePage(CrawlPage& page);
+    void updateLiveResults(const CrawlPage& page);
+    void fetchDetails(CrawlPage& page);
+    bool fetchDetail(const string& pageUrl, BookData& book);
+    void fetchCovers(vector<BookData>& books);
+
+    HttpResponse fetchPage(const string& url, PageCacheEntry& cached, bool& unchanged);
+
 public:
+    static const int MAX_PAGES = 50;
+
     ShelfScan();
     ~ShelfScan();
 
-    void scrapeWithPipeline(const vector<string>& urls);
-    vector<string> autoDiscoverUrls(const string& base_url);
+    bool loadPreviousRun(const string& filename);
+    void streamRawData(const string& filename);
+    void crawl(const string& seedUrl);
+    void scrape(const vector<string>& urls);
+    vector<string> exploreLinks(const string& url);
+    void enableLinkCollection();
+    void setSchema(const ExtractionSchema& schema);
+    void setSitemap(const string& url);
+    void setMaxPages(int pages);
+    void setTimeLimit(chrono::seconds limit);
+    void setUrlTimeout(chrono::seconds timeout);
+    // Cuts off running downloads and drains the crawl, safe from any thread
+    void cancel();
+    void enableImages(const string& directory);
+    void enableDetails();
+    void enableHistory(const string& directory);
+    void enableDedup();
+    void enableColumnar();
+    void setOutputOrder(SortKey key);
+    void setMemoryBudget(size_t bytes);
+    void applyOptions(const ScrapeOptions& options);
+    vector<string> takeDiscoveredLinks();
+    const ScrapingStats& stats() const;
+    vector<BookData> snapshotBooks() const;
+    AnalysisResults liveResults() const;
     void printStatistics() const;
-    void saveResults(const string& filename);
+    AnalysisResults saveResults(const string& filename);
+
+    static bool isCatalogueUrl(const string& url);
     void reset();
 };
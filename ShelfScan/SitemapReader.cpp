@@ -0,0 +1,152 @@
+#include "SitemapReader.h"
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <tbb/parallel_for_each.h>
+
+using namespace std;
+
+void SitemapParser::feed(const char* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        char ch = data[i];
+
+        if (inTag_) {
+            if (ch == '>' && !insideMarkup()) {
+                inTag_ = false;
+                closeTag();
+            }
+            else {
+                tag_ += ch;
+            }
+        }
+        else if (ch == '<') {
+            inTag_ = true;
+            tag_.clear();
+        }
+        else if (inLoc_) {
+            text_ += ch;
+        }
+    }
+}
+
+// CDATA sections and comments may contain '>' before their real end
+bool SitemapParser::insideMarkup() const {
+    if (tag_.compare(0, 8, "![CDATA[") == 0) {
+        return tag_.size() < 10 || tag_.compare(tag_.size() - 2, 2, "]]") != 0;
+    }
+    if (tag_.compare(0, 3, "!--") == 0) {
+        return tag_.size() < 5 || tag_.compare(tag_.size() - 2, 2, "--") != 0;
+    }
+    return false;
+}
+
+// Called with the text between < and >, namespace prefixes are ignored
+void SitemapParser::closeTag() {
+    // <loc><![CDATA[...]]></loc>
+    if (tag_.compare(0, 8, "![CDATA[") == 0) {
+        if (inLoc_ && tag_.size() >= 10) {
+            text_ += tag_.substr(8, tag_.size() - 10);
+        }
+        return;
+    }
+    if (tag_.empty() || tag_[0] == '?' || tag_[0] == '!') {
+        return;
+    }
+
+    bool closing = tag_[0] == '/';
+    size_t nameStart = closing ? 1 : 0;
+    size_t nameEnd = tag_.find_first_of(" \t\r\n/", nameStart);
+    string name = tag_.substr(nameStart, nameEnd == string::npos ? string::npos : nameEnd - nameStart);
+
+    size_t colon = name.find(':');
+    if (colon != string::npos) {
+        name = name.substr(colon + 1);
+    }
+
+    if (name == "sitemapindex") {
+        index_ = true;
+    }
+    else if (name == "loc") {
+        if (!closing && tag_.back() != '/') {
+            inLoc_ = true;
+            text_.clear();
+        }
+        else if (closing && inLoc_) {
+            inLoc_ = false;
+
+            size_t start = text_.find_first_not_of(" \t\r\n");
+            size_t end = text_.find_last_not_of(" \t\r\n");
+            if (start != string::npos) {
+                locations_.push_back(decodeEntities(text_.substr(start, end - start + 1)));
+            }
+        }
+    }
+}
+
+// Sitemaps must escape & < > ' " in URLs
+string SitemapParser::decodeEntities(const string& text) {
+    static const pair<const char*, char> ENTITIES[] = {
+        { "&amp;", '&' }, { "&lt;", '<' }, { "&gt;", '>' }, { "&apos;", '\'' }, { "&quot;", '"' }
+    };
+
+    string decoded;
+    decoded.reserve(text.size());
+
+    for (size_t i = 0; i < text.size(); ++i) {
+        bool replaced = false;
+        if (text[i] == '&') {
+            for (const auto& entity : ENTITIES) {
+                size_t length = strlen(entity.first);
+                if (text.compare(i, length, entity.first) == 0) {
+                    decoded += entity.second;
+                    i += length - 1;
+                    replaced = true;
+                    break;
+                }
+            }
+        }
+        if (!replaced) {
+            decoded += text[i];
+        }
+    }
+    return decoded;
+}
+
+SitemapReader::SitemapReader(HttpDownloader& downloader) : downloader_(downloader) {
+}
+
+vector<string> SitemapReader::read(const string& url) {
+    tbb::concurrent_vector<string> urls;
+    readInto(url, 0, urls);
+    return vector<string>(urls.begin(), urls.end());
+}
+
+void SitemapReader::readInto(const string& url, int depth, tbb::concurrent_vector<string>& urls) {
+    SitemapParser parser;
+    downloader_.stream(url, [&parser](const char* data, size_t length) {
+        parser.feed(data, length);
+        return true;
+    });
+
+    if (!parser.isIndex()) {
+        urls.grow_by(parser.locations().begin(), parser.locations().end());
+        return;
+    }
+
+    if (depth + 1 >= MAX_DEPTH) {
+        cerr << "Sitemap index nested too deep, skipping " << url << endl;
+        return;
+    }
+
+    cout << "Sitemap index " << url << " lists " << parser.locations().size() << " sitemaps" << endl;
+
+    // A broken child sitemap only loses its own URLs
+    tbb::parallel_for_each(parser.locations().begin(), parser.locations().end(), [&](const string& child) {
+        try {
+            readInto(child, depth + 1, urls);
+        }
+        catch (const exception& e) {
+            cerr << "Sitemap error for " << child << ": " << e.what() << endl;
+        }
+    });
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <tbb/concurrent_vector.h>
+#include "HttpDownloader.h"
+
+using namespace std;
+
+// Incremental parser for sitemap XML, fed chunks as they arrive so a large
+// sitemap is never held in memory. Collects the <loc> of every entry and
+// tells a sitemap index (<sitemapindex>) from a plain <urlset>.
+class SitemapParser {
+public:
+    void feed(const char* data, size_t length);
+
+    bool isIndex() const { return index_; }
+    const vector<string>& locations() const { return locations_; }
+
+private:
+    bool inTag_ = false;
+    bool inLoc_ = false;
+    bool index_ = false;
+    string tag_;
+    string text_;
+    vector<string> locations_;
+
+    bool insideMarkup() const;
+    void closeTag();
+    static string decodeEntities(const string& text);
+};
+
+// Reads the URLs listed by a sitemap. Sitemaps named by an index are read
+// in parallel, nested indexes up to MAX_DEPTH levels.
+class SitemapReader {
+public:
+    explicit SitemapReader(HttpDownloader& downloader);
+
+    // Throws if the top level sitemap can't be read
+    vector<string> read(const string& url);
+
+private:
+    static const int MAX_DEPTH = 3;
+
+    HttpDownloader& downloader_;
+
+    void readInto(const string& url, int depth, tbb::concurrent_vector<string>& urls);
+};
@@ -0,0 +1,177 @@
+#include "TextKernels.h"
+#include <charconv>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define SHELFSCAN_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+inline bool isSpace(unsigned char ch) {
+    return ch == ' ' || (ch >= '\t' && ch <= '\r');
+}
+
+inline char toLower(char ch) {
+    return (ch >= 'A' && ch <= 'Z') ? static_cast<char>(ch + ('a' - 'A')) : ch;
+}
+
+#ifdef SHELFSCAN_SSE2
+// Bit i set when byte i of the block is ' ' or \t..\r
+inline unsigned spaceMask(__m128i block) {
+    __m128i spaces = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+    __m128i shifted = _mm_sub_epi8(block, _mm_set1_epi8('\t'));
+    __m128i controls = _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8('\r' - '\t')), shifted);
+    return static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(spaces, controls)));
+}
+
+inline unsigned trailingZeros(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+#endif
+
+// Appends text to out[written..], pendingSpace carries a whitespace run
+// across span boundaries so spans normalize like one string
+void appendNormalized(const char* text, size_t length, char* out, size_t& written, bool& pendingSpace) {
+    size_t i = 0;
+
+#ifdef SHELFSCAN_SSE2
+    while (i + 16 <= length) {
+        unsigned mask = spaceMask(_mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i)));
+
+        if (mask == 0xFFFF) {
+            pendingSpace = true;
+            i += 16;
+            continue;
+        }
+
+        // Copy the run of non-space bytes at the start of the block
+        size_t run = mask == 0 ? 16 : trailingZeros(mask);
+        if (run > 0) {
+            if (pendingSpace && written > 0) {
+                out[written++] = ' ';
+            }
+            pendingSpace = false;
+            memcpy(out + written, text + i, run);
+            written += run;
+            i += run;
+        }
+        if (run < 16) {
+            pendingSpace = true;
+            i++;
+        }
+    }
+#endif
+
+    for (; i < length; ++i) {
+        char ch = text[i];
+        if (isSpace(static_cast<unsigned char>(ch))) {
+            pendingSpace = true;
+            continue;
+        }
+        if (pendingSpace && written > 0) {
+            out[written++] = ' ';
+        }
+        pendingSpace = false;
+        out[written++] = ch;
+    }
+}
+
+}
+
+size_t TextKernels::normalizeWhitespace(const char* text, size_t length, char* out) {
+    size_t written = 0;
+    bool pendingSpace = false;
+    appendNormalized(text, length, out, written, pendingSpace);
+    return written;
+}
+
+void TextKernels::normalizeSpans(const vector<string_view>& spans, string& out) {
+    size_t total = 0;
+    for (const auto& span : spans) {
+        total += span.size();
+    }
+
+    out.resize(total);
+
+    size_t written = 0;
+    bool pendingSpace = false;
+    for (const auto& span : spans) {
+        appendNormalized(span.data(), span.size(), &out[0], written, pendingSpace);
+    }
+
+    out.resize(written);
+}
+
+bool TextKernels::containsIgnoreCase(string_view text, string_view needle) {
+    if (needle.empty()) {
+        return true;
+    }
+    if (needle.size() > text.size()) {
+        return false;
+    }
+
+    size_t last = text.size() - needle.size();
+    char first = needle[0];
+    char firstUpper = (first >= 'a' && first <= 'z') ? static_cast<char>(first - ('a' - 'A')) : first;
+
+    auto matchesAt = [&](size_t pos) {
+        for (size_t k = 1; k < needle.size(); ++k) {
+            if (toLower(text[pos + k]) != needle[k]) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    size_t i = 0;
+
+#ifdef SHELFSCAN_SSE2
+    // Candidate positions are where the first needle byte appears in either case
+    __m128i lower = _mm_set1_epi8(first);
+    __m128i upper = _mm_set1_epi8(firstUpper);
+
+    while (i + 16 <= last + 1) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + i));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(block, lower), _mm_cmpeq_epi8(block, upper))));
+
+        while (mask != 0) {
+            size_t pos = i + trailingZeros(mask);
+            if (matchesAt(pos)) {
+                return true;
+            }
+            mask &= mask - 1;
+        }
+        i += 16;
+    }
+#endif
+
+    for (; i <= last; ++i) {
+        if ((text[i] == first || text[i] == firstUpper) && matchesAt(i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TextKernels::parseInt(string_view text, int& value) {
+    const char* end = text.data() + text.size();
+    auto result = from_chars(text.data(), end, value);
+    return result.ec == errc() && result.ptr == end && !text.empty();
+}
+
+bool TextKernels::parseInt64(string_view text, int64_t& value) {
+    const char* end = text.data() + text.size();
+    auto result = from_chars(text.data(), end, value);
+    return result.ec == errc() && result.ptr == end && !text.empty();
+}
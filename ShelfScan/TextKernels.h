@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Text helpers used on every field of every book. They write into buffers
+// owned by the caller instead of building temporary strings; whitespace
+// scanning and case-insensitive search go 16 bytes at a time with SSE2.
+class TextKernels {
+public:
+    // Trims and collapses whitespace runs to single spaces. out must have
+    // room for length bytes, returns the number of bytes written.
+    static size_t normalizeWhitespace(const char* text, size_t length, char* out);
+
+    // Normalizes the concatenation of spans into out (reusing its capacity)
+    static void normalizeSpans(const vector<string_view>& spans, string& out);
+
+    // needle must be lower case ASCII
+    static bool containsIgnoreCase(string_view text, string_view needle);
+
+    // Whole text must be a decimal number
+    static bool parseInt(string_view text, int& value);
+    static bool parseInt64(string_view text, int64_t& value);
+};
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+// LEB128 varints as used by the binary file formats
+inline void putVarint(string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline uint64_t getVarint(const char*& in, const char* end) {
+    uint64_t value = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(*in++);
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return value;
+        }
+    }
+    throw runtime_error("Corrupt varint");
+}
+
+// Small negative deltas stay small: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+inline uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
@@ -1,18 +1,245 @@
 #include "ShelfScan.h"
+#include "ShardCoordinator.h"
+#include "ShardWorker.h"
+#include "FileReader.h"
+#include "BookIndex.h"
+#include "QueryShell.h"
+#include "ScrapeDaemon.h"
+#include "PriceHistory.h"
+#include "BookTable.h"
+#include <chrono>
+#include <iomanip>
 #include <iostream>
 #include <vector>
 
 using namespace std;
 
-int main() {
+const string BASE_URL = "http://books.toscrape.com/index.html";
+const string DAEMON_SOCKET = "shelfscan.sock";
+
+// Usage:
+//   ShelfScan                      single process crawl
+//   ShelfScan --shards N           crawl split across N worker processes
+//   ShelfScan --output NAME        base name of result files (default "results")
+//   ShelfScan --url URL            start page of the crawl (default books.toscrape.com)
+//   ShelfScan --max-pages N        listing pages scraped at most (default 50)
+//   ShelfScan --schema FILE        extraction rules, see schemas/ (default: built-in books.toscrape.com rules)
+//   ShelfScan --images DIR         download covers into a content-addressed store
+//   ShelfScan --sitemap URL        seed the crawl from this sitemap (default: <site>/sitemap.xml)
+//   ShelfScan --details            read every book's product page (UPC, stock count, ...)
+//   ShelfScan --dedup              drop duplicate listings (same book on several pages or mirrors)
+//   ShelfScan --columnar           also save the books as NAME.columns, a binary columnar file
+//   ShelfScan --order KEY          order of books in the output files: page, price or title
+//                                  (default: crawl order, streamed while crawling)
+//   ShelfScan --memory MB          memory budget, stored books spill to disk beyond it
+//   ShelfScan --time-limit SECONDS whole crawl, running downloads are cut off and partial results saved
+//   ShelfScan --url-timeout SECONDS one URL including its retries
+//   ShelfScan --history DIR        append every run's prices to a price history store
+//   ShelfScan --history DIR --price-history TEXT
+//                                  prices over time of books whose UPC is TEXT or title contains it
+//   ShelfScan --history DIR --price-changes PCT [--days N]
+//                                  books whose price moved by PCT % or more in the last N days (default 30)
+//   ShelfScan --repl               open query mode after the crawl
+//   ShelfScan --query FILE.json    query mode over results of an earlier run (or FILE.columns)
+//   ShelfScan --daemon SECONDS     stay running, re-scrape every SECONDS and serve results
+//                                  on --socket PATH (default shelfscan.sock)
+//   ShelfScan --send "COMMAND"     send STATUS / QUERY ... / RESCRAPE / SHUTDOWN to a daemon
+// Workers are started by the coordinator with --worker ID --socket PATH.
+static void printPriceHistory(const PriceHistory& history, const string& text) {
+    vector<string> keys = history.findKeys(text);
+    if (keys.empty()) {
+        cout << "No book in the history matches \"" << text << "\"\n";
+    }
+
+    for (const auto& key : keys) {
+        cout << history.titleOf(key) << "\n";
+        for (const auto& point : history.history(key)) {
+            cout << "  " << PriceHistory::formatTime(point.time) << "  " << fixed << setprecision(2)
+                << point.pricePence / 100.0 << " GBP  " << (point.inStock ? "in stock" : "out of stock");
+            if (point.stockCount >= 0) {
+                cout << " (" << point.stockCount << ")";
+            }
+            cout << "\n";
+        }
+    }
+}
+
+static void printPriceChanges(const PriceHistory& history, double percent, int days) {
+    int64_t now = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+    vector<PriceChange> changes = history.priceChanges(percent / 100.0, days, now);
+
+    cout << changes.size() << " books changed price by " << percent << "% or more in the last " << days << " days\n";
+    for (const auto& change : changes) {
+        cout << fixed << setprecision(1) << setw(7) << showpos << change.change() * 100.0 << noshowpos << "%  "
+            << setprecision(2) << change.fromPence / 100.0 << " -> " << change.toPence / 100.0 << " GBP  "
+            << change.title << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
     try {
+        int shards = 1;
+        int workerId = -1;
+        string socketPath;
+        string output = "results";
+        string startUrl = BASE_URL;
+        string queryFile;
+        ScrapeOptions options;
+        bool repl = false;
+        int daemonInterval = 0;
+        string daemonCommand;
+        string priceHistoryText;
+        double priceChangePercent = -1;
+        int priceChangeDays = 30;
+
+        for (int i = 1; i < argc; ++i) {
+            string arg = argv[i];
+            bool hasValue = i + 1 < argc;
+
+            if (arg == "--shards" && hasValue) {
+                shards = stoi(argv[++i]);
+            }
+            else if (arg == "--worker" && hasValue) {
+                workerId = stoi(argv[++i]);
+            }
+            else if (arg == "--socket" && hasValue) {
+                socketPath = argv[++i];
+            }
+            else if (arg == "--output" && hasValue) {
+                output = argv[++i];
+            }
+            else if (arg == "--url" && hasValue) {
+                startUrl = argv[++i];
+            }
+            else if (arg == "--max-pages" && hasValue) {
+                options.maxPages = stoi(argv[++i]);
+            }
+            else if (arg == "--schema" && hasValue) {
+                options.schemaFile = argv[++i];
+            }
+            else if (arg == "--memory" && hasValue) {
+                options.memoryBudgetMb = stoul(argv[++i]);
+            }
+            else if (arg == "--time-limit" && hasValue) {
+                options.timeLimitSeconds = stoi(argv[++i]);
+            }
+            else if (arg == "--url-timeout" && hasValue) {
+                options.urlTimeoutSeconds = stoi(argv[++i]);
+            }
+            else if (arg == "--sitemap" && hasValue) {
+                options.sitemapUrl = argv[++i];
+            }
+            else if (arg == "--details") {
+                options.fetchDetails = true;
+            }
+            else if (arg == "--order" && hasValue) {
+                options.outputOrder = argv[++i];
+            }
+            else if (arg == "--columnar") {
+                options.columnar = true;
+            }
+            else if (arg == "--dedup") {
+                options.dedup = true;
+            }
+            else if (arg == "--images" && hasValue) {
+                options.imageDir = argv[++i];
+            }
+            else if (arg == "--history" && hasValue) {
+                options.historyDir = argv[++i];
+            }
+            else if (arg == "--price-history" && hasValue) {
+                priceHistoryText = argv[++i];
+            }
+            else if (arg == "--price-changes" && hasValue) {
+                priceChangePercent = stod(argv[++i]);
+            }
+            else if (arg == "--days" && hasValue) {
+                priceChangeDays = stoi(argv[++i]);
+            }
+            else if (arg == "--query" && hasValue) {
+                queryFile = argv[++i];
+            }
+            else if (arg == "--daemon" && hasValue) {
+                daemonInterval = stoi(argv[++i]);
+            }
+            else if (arg == "--send" && hasValue) {
+                daemonCommand = argv[++i];
+            }
+            else if (arg == "--repl") {
+                repl = true;
+            }
+            else {
+                cerr << "Unknown argument: " << arg << endl;
+                return 1;
+            }
+        }
+
+        if (workerId >= 0) {
+            ShardWorker worker(workerId, socketPath, output, options);
+            return worker.run();
+        }
+
+        if (!daemonCommand.empty()) {
+            return ScrapeDaemon::send(socketPath.empty() ? DAEMON_SOCKET : socketPath, daemonCommand, cout);
+        }
+
+        if (daemonInterval > 0) {
+            ScrapeDaemon daemon(socketPath.empty() ? DAEMON_SOCKET : socketPath, output, daemonInterval);
+            daemon.setOptions(options);
+            return daemon.run(startUrl);
+        }
+
+        if (!priceHistoryText.empty() || priceChangePercent >= 0) {
+            if (options.historyDir.empty()) {
+                cerr << "History queries need --history DIR" << endl;
+                return 1;
+            }
+            PriceHistory history(options.historyDir);
+            if (!priceHistoryText.empty()) {
+                printPriceHistory(history, priceHistoryText);
+            }
+            if (priceChangePercent >= 0) {
+                printPriceChanges(history, priceChangePercent, priceChangeDays);
+            }
+            return 0;
+        }
+
+        if (!queryFile.empty()) {
+            vector<BookData> books;
+            if (queryFile.size() > 8 && queryFile.compare(queryFile.size() - 8, 8, ".columns") == 0) {
+                books = BookTable(queryFile).readAll();
+            }
+            else {
+                books = FileReader().readRawData(queryFile);
+            }
+            BookIndex index(move(books));
+            QueryShell(index).run(cin, cout);
+            return 0;
+        }
+
+        if (shards > 1) {
+            ShardCoordinator coordinator(shards, output);
+            coordinator.setOptions(options);
+            coordinator.run(startUrl);
+
+            cout << "Sharded scraping successful! Merged results are saved in " << output << ".txt\n";
+            return 0;
+        }
+
         ShelfScan scraper;
+        scraper.applyOptions(options);
+        scraper.loadPreviousRun(output);
+
+        scraper.streamRawData(output);
+        scraper.crawl(startUrl);
+        scraper.saveResults(output);
 
-        vector<string> urls = scraper.autoDiscoverUrls("http://books.toscrape.com/index.html");
-        scraper.scrapeWithPipeline(urls);
-        scraper.saveResults("results");
+        cout << "Scraping successful! Results are saved in " << output << ".txt and " << output << ".json\n";
 
-        cout << "Scraping successful! Results are saved in results.txt and results.json\n";
+        if (repl) {
+            BookIndex index(scraper.snapshotBooks());
+            QueryShell(index).run(cin, cout);
+        }
 
     }
     catch (const exception& e) {
@@ -21,4 +248,4 @@ int main() {
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,165 @@
+// Round trip and corrupt-file checks for the .columns format (BookTable).
+// Exits with 1 on the first failed check.
+#include "BookTable.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+static int failures = 0;
+
+static void check(bool condition, const string& what) {
+    if (!condition) {
+        cerr << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+static bool throws(const function<void()>& action) {
+    try {
+        action();
+    }
+    catch (const runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+static vector<BookData> sampleBooks(size_t count) {
+    static const char* categories[] = { "Travel", "Poetry", "Mystery", "Fiction" };
+    vector<BookData> books(count);
+    for (size_t i = 0; i < count; ++i) {
+        BookData& book = books[i];
+        book.title = "Book " + to_string(i);
+        book.priceMinor = 1000 + static_cast<int64_t>(i * 37 % 5000);
+        book.starRating = static_cast<int>(i % 5) + 1;
+        book.availability = i % 7 ? "In stock" : "Out of stock";
+        book.imageUrl = "http://example.com/media/" + to_string(i) + ".jpg";
+        book.detailUrl = "http://example.com/catalogue/book_" + to_string(i) + "/index.html";
+        book.upc = i % 3 ? to_string(100000 + i) : "";
+        book.stockCount = static_cast<int>(i % 23);
+        book.category = categories[i % 4];
+        book.description = i % 2 ? "" : "Description of book " + to_string(i);
+    }
+    return books;
+}
+
+static bool sameBook(const BookData& a, const BookData& b) {
+    return a.title == b.title && a.priceMinor == b.priceMinor && a.starRating == b.starRating &&
+        a.availability == b.availability && a.imageUrl == b.imageUrl && a.imageHash == b.imageHash &&
+        a.detailUrl == b.detailUrl && a.upc == b.upc && a.stockCount == b.stockCount &&
+        a.category == b.category && a.description == b.description;
+}
+
+static string readFile(const string& path) {
+    ifstream file(path, ios::binary);
+    return string(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+}
+
+static void writeFile(const string& path, const string& content) {
+    ofstream file(path, ios::binary | ios::trunc);
+    file.write(content.data(), static_cast<streamsize>(content.size()));
+}
+
+// Offset of the first row group in the footer, read from the trailer
+static size_t footerOffset(const string& content) {
+    uint64_t offset;
+    memcpy(&offset, content.data() + content.size() - 24, sizeof(offset));
+    return static_cast<size_t>(offset);
+}
+
+// Rewrites row group 0 of a copy of the table and expects opening it to fail
+static void expectCorrupt(const string& original, const string& path, const string& what,
+    const function<void(BookTable::RowGroupInfo& group)>& corrupt) {
+    string content = original;
+    BookTable::RowGroupInfo group;
+    memcpy(&group, content.data() + footerOffset(content), sizeof(group));
+    corrupt(group);
+    memcpy(&content[footerOffset(content)], &group, sizeof(group));
+    writeFile(path, content);
+
+    check(throws([&] { BookTable table(path); }), what);
+}
+
+static void testRoundTrip(const string& path) {
+    MemoryBudget budget;
+    BookStore store(budget);
+    vector<BookData> books = sampleBooks(BookTable::ROW_GROUP_ROWS * 2 + 1234);
+    store.append("http://example.com/catalogue/page-1.html", books);
+    BookTable::write(path, store);
+
+    BookTable table(path);
+    check(table.rowCount() == books.size(), "row count after round trip");
+    check(table.rowGroupCount() == 3, "row group count after round trip");
+
+    vector<BookData> read = table.readAll();
+    bool same = read.size() == books.size();
+    for (size_t i = 0; same && i < books.size(); ++i) {
+        same = sameBook(read[i], books[i]);
+    }
+    check(same, "books read back equal the books written");
+
+    StringColumn categories = table.strings(1, BookColumn::Category);
+    check(categories[0] == books[BookTable::ROW_GROUP_ROWS].category, "string column view");
+    IntColumn prices = table.ints(2, BookColumn::Price);
+    check(prices[5] == books[BookTable::ROW_GROUP_ROWS * 2 + 5].priceMinor, "integer column view");
+}
+
+static void testCorruptFooter(const string& path) {
+    string original = readFile(path);
+    string copy = path + ".corrupt";
+
+    expectCorrupt(original, copy, "chunk offset past the footer", [&](BookTable::RowGroupInfo& group) {
+        group.chunks[0].offset = footerOffset(original) + 100;
+        group.chunks[0].size = 8;
+    });
+    expectCorrupt(original, copy, "chunk running into the footer", [&](BookTable::RowGroupInfo& group) {
+        group.chunks[3].size = footerOffset(original);
+    });
+    expectCorrupt(original, copy, "row group larger than ROW_GROUP_ROWS", [](BookTable::RowGroupInfo& group) {
+        group.rows = uint64_t(1) << 62;
+    });
+    expectCorrupt(original, copy, "row group not starting at row 0", [](BookTable::RowGroupInfo& group) {
+        group.firstRow = 7;
+    });
+
+    // Dictionary index past the dictionary, the chunk is fine otherwise
+    BookTable::RowGroupInfo group;
+    memcpy(&group, original.data() + footerOffset(original), sizeof(group));
+    const BookTable::ChunkInfo& category = group.chunks[static_cast<int>(BookColumn::Category)];
+    check(category.encoding == 1 && category.width == 1, "category chunk is dictionary encoded");
+    string content = original;
+    content[category.offset + category.size - 1] = static_cast<char>(0x7F);
+    writeFile(copy, content);
+    check(throws([&] { BookTable(copy).strings(0, BookColumn::Category); }), "dictionary index out of range");
+
+    writeFile(copy, original.substr(0, original.size() / 2));
+    check(throws([&] { BookTable table(copy); }), "truncated file");
+
+    remove(copy.c_str());
+}
+
+int main() {
+    string path = "booktable-test.columns";
+
+    try {
+        testRoundTrip(path);
+        testCorruptFooter(path);
+    }
+    catch (const exception& e) {
+        cerr << "FAILED: unexpected error: " << e.what() << endl;
+        failures++;
+    }
+    remove(path.c_str());
+
+    if (failures > 0) {
+        cerr << failures << " check(s) failed" << endl;
+        return 1;
+    }
+    cout << "BookTable tests passed" << endl;
+    return 0;
+}